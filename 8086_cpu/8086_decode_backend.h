@@ -0,0 +1,21 @@
+/* =================================================================
+    Common interface of the two 8086 decoders, so the same stream
+    can be decoded and timed through either of them
+    ================================================================== */
+#ifndef DECODE_BACKEND_H
+#define DECODE_BACKEND_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Decodes size bytes, writing one line of assembly per instruction to out. When boundaries
+   is not NULL the offset of every instruction is stored there, it needs room for size entries.
+   Returns the number of instructions decoded */
+typedef uint32_t (*Decode_Stream_Fn)(const uint8_t* bytes, const uint32_t size, FILE* out, uint32_t* boundaries);
+
+// _old_8086_decoder.c, switch on the op code bits, built with -DOLD_DECODER_LIBRARY
+uint32_t old_decode_stream(const uint8_t* bytes, const uint32_t size, FILE* out, uint32_t* boundaries);
+// 8086_simulator.h, driven by the instruction table
+uint32_t table_decode_stream(const uint8_t* bytes, const uint32_t size, FILE* out, uint32_t* boundaries);
+
+#endif
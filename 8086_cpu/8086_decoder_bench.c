@@ -0,0 +1,429 @@
+/* =================================================================
+    Decoder comparison
+    the table decoder and the old switch decoder decode the same
+    generated streams, timed and checked line by line against each other
+    gcc -O2 8086_decoder_bench.c _old_8086_decoder.c -DOLD_DECODER_LIBRARY -o 8086_decoder_bench -pthread
+    ================================================================== */
+#include "8086_simulator.h"
+
+#define DECODER_BENCH_RUNS     5
+#define DECODER_MISMATCH_LINES 8     // printed per stream, the rest are only counted
+#define DECODER_STREAM_SIZE    (1<<20)
+
+typedef struct
+{
+    const char* name;
+    Decode_Stream_Fn decode;
+} Decode_Backend;
+
+static const Decode_Backend decode_backends[] =
+{
+    {"table",  table_decode_stream},
+    {"switch", old_decode_stream},
+};
+
+/*==========================================
+  Stream generation
+  Only the encodings the old decoder knows: the mov
+  forms, add / sub / cmp and the conditional jumps
+  and loops, spread over every mod and rm
+  ========================================*/
+typedef enum : uint8_t
+{
+    STREAM_MOV,
+    STREAM_ALU,
+    STREAM_BRANCH,
+    STREAM_MIXED,
+    STREAM_COUNT
+} Stream_Mix;
+
+const char* stream_mix_string(Stream_Mix mix)
+{
+    switch (mix)
+    {
+    case STREAM_MOV:
+        return "mov";
+    case STREAM_ALU:
+        return "alu";
+    case STREAM_BRANCH:
+        return "branch";
+    case STREAM_MIXED:
+        return "mixed";
+    default:
+        assert(0 && "ERROR - failed to get stream_mix_string\n");
+    }
+}
+
+static inline uint32_t stream_random(uint64_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (uint32_t)(*state >> 32);
+}
+
+// mod reg rm byte and its displacement, mod 11 only when the form allows a register
+static uint32_t emit_mod_rm(uint8_t* out, uint64_t* rng, const uint8_t reg, const bool allow_register)
+{
+    uint8_t mod = stream_random(rng) % (allow_register ? 4 : 3);
+    uint8_t rm  = stream_random(rng) % 8;
+    uint32_t n  = 0;
+
+    out[n++] = (uint8_t)((mod << 6) | (reg << 3) | rm);
+    if (mod == 1)
+        out[n++] = (uint8_t)stream_random(rng);
+    else if (mod == 2 || (mod == 0 && rm == 6))
+    {
+        out[n++] = (uint8_t)stream_random(rng);
+        out[n++] = (uint8_t)stream_random(rng);
+    }
+    return n;
+}
+
+static uint32_t emit_immediate(uint8_t* out, uint64_t* rng, const bool wide)
+{
+    out[0] = (uint8_t)stream_random(rng);
+    if (!wide)
+        return 1;
+    out[1] = (uint8_t)stream_random(rng);
+    return 2;
+}
+
+static uint32_t emit_mov(uint8_t* out, uint64_t* rng)
+{
+    uint32_t n = 0;
+    bool w     = stream_random(rng) & 1;
+    switch (stream_random(rng) % 4)
+    {
+    case 0: // register/memory to/from register
+        out[n++] = (uint8_t)(0x88 | (stream_random(rng) & 2) | w);
+        n       += emit_mod_rm(out + n, rng, stream_random(rng) % 8, true);
+        break;
+    case 1: // immediate to register
+        out[n++] = (uint8_t)(0xB0 | (w << 3) | (stream_random(rng) % 8));
+        n       += emit_immediate(out + n, rng, w);
+        break;
+    case 2: // immediate to memory
+        out[n++] = (uint8_t)(0xC6 | w);
+        n       += emit_mod_rm(out + n, rng, 0, false);
+        n       += emit_immediate(out + n, rng, w);
+        break;
+    case 3: // accumulator to/from memory, only ax as the old decoder prints it
+        out[n++] = (uint8_t)(0xA1 | (stream_random(rng) & 2));
+        n       += emit_immediate(out + n, rng, true);
+        break;
+    }
+    return n;
+}
+
+static uint32_t emit_alu(uint8_t* out, uint64_t* rng)
+{
+    static const uint8_t alu_ops[] = {0, 5, 7}; // add, sub, cmp
+    uint8_t op = alu_ops[stream_random(rng) % array_count(alu_ops)];
+    uint32_t n = 0;
+    bool w     = stream_random(rng) & 1;
+    switch (stream_random(rng) % 3)
+    {
+    case 0: // register/memory with register
+        out[n++] = (uint8_t)((op << 3) | (stream_random(rng) & 2) | w);
+        n       += emit_mod_rm(out + n, rng, stream_random(rng) % 8, true);
+        break;
+    case 1: // immediate to register/memory, sign extended byte for the wide form
+    {
+        bool s   = w && (stream_random(rng) & 1);
+        out[n++] = (uint8_t)(0x80 | (s << 1) | w);
+        n       += emit_mod_rm(out + n, rng, op, true);
+        n       += emit_immediate(out + n, rng, w && !s);
+        break;
+    }
+    case 2: // immediate to ax
+        out[n++] = (uint8_t)((op << 3) | 0x05);
+        n       += emit_immediate(out + n, rng, true);
+        break;
+    }
+    return n;
+}
+
+static uint32_t emit_branch(uint8_t* out, uint64_t* rng)
+{
+    uint32_t pick = stream_random(rng) % 20;
+    out[0]        = (uint8_t)(pick < 16 ? 0x70 + pick : 0xE0 + (pick - 16));
+    out[1]        = (uint8_t)stream_random(rng);
+    return 2;
+}
+
+// fills size bytes, the tail that does not fit a whole instruction is left out
+uint32_t generate_stream(uint8_t* bytes, const uint32_t size, const Stream_Mix mix, uint64_t seed)
+{
+    uint64_t rng = seed * 0x9E3779B97F4A7C15ull + 1;
+    uint8_t inst[8];
+    uint32_t used = 0;
+    for (;;)
+    {
+        uint32_t n = 0;
+        Stream_Mix pick = (mix == STREAM_MIXED) ? (Stream_Mix)(stream_random(&rng) % STREAM_MIXED) : mix;
+        switch (pick)
+        {
+        case STREAM_MOV:
+            n = emit_mov(inst, &rng);
+            break;
+        case STREAM_ALU:
+            n = emit_alu(inst, &rng);
+            break;
+        case STREAM_BRANCH:
+            n = emit_branch(inst, &rng);
+            break;
+        default:
+            assert(0 && "ERROR - unknown stream mix\n");
+        }
+        if (used + n > size)
+            break;
+        memcpy(bytes + used, inst, n);
+        used += n;
+    }
+    return used;
+}
+
+/*==========================================
+  Equivalence
+  Both decoders have to split the stream at the
+  same offsets and print the same instruction. Only
+  spellings nasm assembles to the same bytes are let
+  through: size keywords, loope / loopz and numbers
+  that agree in their low byte or word
+  ========================================*/
+static const char* mnemonic_aliases[][2] =
+{
+    {"loope ",  "loopz "},
+    {"loopne ", "loopnz "},
+};
+
+static void normalise_line(const char* line, const size_t length, char* out, const size_t max)
+{
+    size_t n = 0;
+    size_t i = 0;
+    for (uint32_t a = 0; a < array_count(mnemonic_aliases); ++a)
+        if (strncmp(line, mnemonic_aliases[a][0], strlen(mnemonic_aliases[a][0])) == 0)
+        {
+            n = (size_t)snprintf(out, max, "%s", mnemonic_aliases[a][1]);
+            i = strlen(mnemonic_aliases[a][0]);
+            break;
+        }
+
+    while (i < length && n +1 < max)
+    {
+        if ((i == 0 || line[i -1] == ' ' || line[i -1] == ',') &&
+                (strncmp(line + i, "byte ", 5) == 0 || strncmp(line + i, "word ", 5) == 0))
+        {
+            i += 5;
+            continue;
+        }
+        out[n++] = line[i++];
+    }
+    out[n] = '\0';
+}
+
+static inline bool number_start(const char* text)
+{
+    return (text[0] >= '0' && text[0] <= '9') || (text[0] == '-' && text[1] >= '0' && text[1] <= '9');
+}
+
+// -33 and 223 are the same byte, -1405 and 64131 the same word
+static bool same_number(const int64_t a, const int64_t b)
+{
+    if ((a & 0xFFFF) == (b & 0xFFFF))
+        return true;
+    return (a & 0xFF) == (b & 0xFF) && a >= -128 && a <= 255 && b >= -128 && b <= 255;
+}
+
+static bool same_instruction(const char* a, const char* b)
+{
+    while (*a != '\0' && *b != '\0')
+    {
+        if (number_start(a) && number_start(b))
+        {
+            char* a_end;
+            char* b_end;
+            int64_t a_value = strtoll(a, &a_end, 10);
+            int64_t b_value = strtoll(b, &b_end, 10);
+            if (!same_number(a_value, b_value))
+                return false;
+            a = a_end;
+            b = b_end;
+        }
+        else if (*a++ != *b++)
+            return false;
+    }
+    return *a == *b;
+}
+
+// the start of every line of text, plus one past the end
+static uint32_t split_lines(char* text, const size_t size, char** lines, const uint32_t max)
+{
+    uint32_t count = 0;
+    lines[0]       = text;
+    for (size_t i = 0; i < size && count < max; ++i)
+        if (text[i] == '\n')
+            lines[++count] = text + i +1;
+    return count;
+}
+
+uint32_t decoders_compare(const uint8_t* bytes, const uint32_t size)
+{
+    char* text[array_count(decode_backends)];
+    size_t text_size[array_count(decode_backends)];
+    uint32_t* boundaries[array_count(decode_backends)];
+    char** lines[array_count(decode_backends)];
+    uint32_t count[array_count(decode_backends)];
+
+    for (uint32_t b = 0; b < array_count(decode_backends); ++b)
+    {
+        boundaries[b] = (uint32_t*)malloc(sizeof(uint32_t) * (size +1));
+        FILE* out     = open_memstream(&text[b], &text_size[b]);
+        count[b]      = decode_backends[b].decode(bytes, size, out, boundaries[b]);
+        fclose(out);
+
+        lines[b] = (char**)malloc(sizeof(char*) * (count[b] +1));
+        if (split_lines(text[b], text_size[b], lines[b], count[b]) != count[b])
+            printf("ERROR - %s printed a different number of lines than it decoded\n", decode_backends[b].name);
+    }
+
+    uint32_t mismatches = 0;
+    if (count[0] != count[1])
+    {
+        printf("; %s decoded %u instructions, %s %u\n", decode_backends[0].name, count[0], decode_backends[1].name, count[1]);
+        ++mismatches;
+    }
+
+    for (uint32_t i = 0; i < count[0] && i < count[1]; ++i)
+    {
+        if (boundaries[0][i] != boundaries[1][i])
+        {
+            printf("; instruction %u starts at %u for %s, %u for %s, the streams are out of step from here\n",
+                   i, boundaries[0][i], decode_backends[0].name, boundaries[1][i], decode_backends[1].name);
+            ++mismatches;
+            break;
+        }
+
+        char a[128];
+        char c[128];
+        normalise_line(lines[0][i], lines[0][i +1] - lines[0][i] -1, a, sizeof(a));
+        normalise_line(lines[1][i], lines[1][i +1] - lines[1][i] -1, c, sizeof(c));
+        if (same_instruction(a, c))
+            continue;
+
+        if (mismatches < DECODER_MISMATCH_LINES)
+        {
+            printf(";   %8u:", boundaries[0][i]);
+            uint32_t end = (i +1 < count[0]) ? boundaries[0][i +1] : size;
+            for (uint32_t at = boundaries[0][i]; at < end; ++at)
+                printf(" %02x", bytes[at]);
+            printf("\n;     %-8s %s\n;     %-8s %s\n", decode_backends[0].name, a, decode_backends[1].name, c);
+        }
+        ++mismatches;
+    }
+
+    for (uint32_t b = 0; b < array_count(decode_backends); ++b)
+    {
+        free(lines[b]);
+        free(text[b]);
+        free(boundaries[b]);
+    }
+    return mismatches;
+}
+
+/*==========================================
+  Timing
+  Fastest of DECODER_BENCH_RUNS per backend, the
+  text still gets formatted but goes to /dev/null
+  ========================================*/
+void decoders_benchmark(const uint8_t* bytes, const uint32_t size)
+{
+    FILE* sink = fopen("/dev/null", "w");
+    assert(sink != NULL && "ERROR - could not open /dev/null\n");
+
+    uint64_t fastest[array_count(decode_backends)];
+    for (uint32_t b = 0; b < array_count(decode_backends); ++b)
+    {
+        uint32_t count = 0;
+        fastest[b]     = UINT64_MAX;
+        for (uint32_t run = 0; run < DECODER_BENCH_RUNS; ++run)
+        {
+            Timer timer;
+            start_timer(&timer);
+            count = decode_backends[b].decode(bytes, size, sink, NULL);
+            end_timer(&timer);
+            if (timer_nano(&timer) < fastest[b])
+                fastest[b] = timer_nano(&timer);
+        }
+
+        uint64_t ns = fastest[b] ? fastest[b] : 1;
+        printf("  %-8s %12u %12lu %10.1f %10.2f %8.2fx\n", decode_backends[b].name, count, ns,
+               size * 1e3 / ns, count * 1e3 / ns, (double)fastest[0] / ns);
+    }
+    fclose(sink);
+}
+
+int main(int argc, char* argv[])
+{
+    // flags can be combined, a file path as the last argument is compared instead of the generated streams
+    uint32_t size       = DECODER_STREAM_SIZE;
+    uint64_t seed       = 1;
+    const char* file    = NULL;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-size") == 0 && i +1 < argc)
+            size = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-seed") == 0 && i +1 < argc)
+            seed = strtoull(argv[++i], NULL, 10);
+        else if (i == argc -1 && argv[i][0] != '-')
+            file = argv[i];
+        else
+        {
+            printf("ERROR - Unknown flag %s\n", argv[i]);
+            return 0;
+        }
+    }
+
+    uint32_t stream_count = STREAM_COUNT;
+    uint8_t* bytes        = NULL;
+    if (file != NULL)
+    {
+        Memory memory = {0};
+        read_file(&memory, file);
+        size         = memory.bytes_used;
+        bytes        = (uint8_t*)malloc(size);
+        memory_copy_out(&memory, 0, bytes, size);
+        free_memory(&memory);
+        stream_count = 1;
+    }
+    else
+        bytes = (uint8_t*)malloc(size);
+
+    uint32_t failed = 0;
+    printf("  %-8s %12s %12s %10s %10s %9s\n", "decoder", "instructions", "time (ns)", "MB/s", "Minst/s", "vs table");
+    for (uint32_t mix = 0; mix < stream_count; ++mix)
+    {
+        uint32_t used = size;
+        if (file != NULL)
+            printf("%s, %u bytes\n", file, size);
+        else
+        {
+            used = generate_stream(bytes, size, (Stream_Mix)mix, seed + mix);
+            printf("%s stream, %u bytes, seed %lu\n", stream_mix_string((Stream_Mix)mix), used, seed + mix);
+        }
+
+        uint32_t mismatches = decoders_compare(bytes, used);
+        decoders_benchmark(bytes, used);
+        if (mismatches != 0)
+        {
+            printf("  FAIL - %u instructions decoded differently\n", mismatches);
+            ++failed;
+        }
+        else
+            printf("  PASS - same boundaries and instructions\n");
+    }
+
+    free(bytes);
+    return failed != 0;
+}
@@ -5,7 +5,7 @@ int main(int argc, char* argv[])
 {
     if (argc < 2)
     {
-        printf("Args = file path\n");
+        printf("Args = [flags] file path\n");
         return 0;
     }
 
@@ -14,31 +14,114 @@ int main(int argc, char* argv[])
 
     //print_inst_table();
 
-    uint32_t flags = 0;
-    if (argc > 2)
+    // flags can be combined, the file path is always the last argument
+    const char* file_path    = argv[argc -1];
+    const char* fb_spec      = NULL;
+    uint32_t frame_interval  = 0;
+    uint32_t instance_count  = 0;
+    uint64_t save_at         = 0;
+    uint32_t parallel_chunks = 0;
+    bool restore             = false;
+    uint32_t flags           = 0;
+    for (int i = 1; i < argc -1; ++i)
     {
-
-        if (strcmp(argv[1], "-exec") == 0)
-            flags = EXECUTION_OF_INSTRUCTION;
-        else if (strcmp(argv[1], "-dump") == 0)
-            flags = EXECUTION_OF_INSTRUCTION | DUMP_MEMORY_AFTER_EXEC;
+        if (strcmp(argv[i], "-exec") == 0)
+            flags |= EXECUTION_OF_INSTRUCTION;
+        else if (strcmp(argv[i], "-dump") == 0)
+            flags |= EXECUTION_OF_INSTRUCTION | DUMP_MEMORY_AFTER_EXEC;
+        else if (strcmp(argv[i], "-ir") == 0)
+            flags |= EXECUTION_OF_INSTRUCTION | MICRO_OP_EXECUTION | SILENT_EXECUTION;
+        else if (strcmp(argv[i], "-trace") == 0)
+            flags |= EXECUTION_OF_INSTRUCTION | MEMORY_TRACE | SILENT_EXECUTION;
+        else if (strcmp(argv[i], "-com") == 0)
+            flags |= EXECUTION_OF_INSTRUCTION | DOS_COM_PROGRAM | SILENT_EXECUTION;
+        else if (strcmp(argv[i], "-trace_summary") == 0)
+        {
+            memory_trace_summary(file_path);
+            return 0;
+        }
+        else if (strcmp(argv[i], "-fb") == 0 && i +1 < argc -1)
+        {
+            flags  |= EXECUTION_OF_INSTRUCTION;
+            fb_spec = argv[++i];
+        }
+        else if (strcmp(argv[i], "-fb_every") == 0 && i +1 < argc -1)
+            frame_interval = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-instances") == 0 && i +1 < argc -1)
+            instance_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-save_at") == 0 && i +1 < argc -1)
+        {
+            flags  |= EXECUTION_OF_INSTRUCTION | SILENT_EXECUTION;
+            save_at = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-restore") == 0)
+        {
+            // silent only through the backend flag given with it, so -exec still traces
+            flags  |= EXECUTION_OF_INSTRUCTION;
+            restore = true;
+        }
+        else if (strcmp(argv[i], "-parallel") == 0)
+        {
+            // an optional chunk count, one thread each, the default is one per core
+            flags |= PARALLEL_DISASSEMBLY;
+            if (i +1 < argc -1 && argv[i +1][0] >= '0' && argv[i +1][0] <= '9')
+                parallel_chunks = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-predecode") == 0)
+            flags |= PREDECODE_REPORT;
+        else if (strcmp(argv[i], "-cfg") == 0)
+            flags |= CONTROL_FLOW_REPORT;
+        else if (strcmp(argv[i], "-fuse") == 0)
+            flags |= EXECUTION_OF_INSTRUCTION | MICRO_OP_EXECUTION | FUSED_EXECUTION | SILENT_EXECUTION;
+        else if (strcmp(argv[i], "-bench") == 0)
+            flags |= EXECUTION_OF_INSTRUCTION | BENCHMARK_BACKENDS | SILENT_EXECUTION;
+        else if (strcmp(argv[i], "-lockstep") == 0)
+            flags |= EXECUTION_OF_INSTRUCTION | LOCKSTEP_EXECUTION | SILENT_EXECUTION;
         else
         {
-            printf("ERROR - Unknown flag %s\n", argv[1]);
+            printf("ERROR - Unknown flag %s\n", argv[i]);
             return 0;
         }
-        read_file(&memory, argv[2]);
-        decode_instruction_stream(&memory, flags);
     }
+
+    Checkpoint_Header resume;
+    if (restore)
+    {
+        if (!checkpoint_load(&memory, file_path, &resume))
+            return 0;
+    }
+    else if (flags & DOS_COM_PROGRAM)
+        read_com_file(&memory, file_path);
     else
+        read_file(&memory, file_path);
+    if (fb_spec != NULL)
     {
-        read_file(&memory, argv[1]);
+        memory.framebuffer = framebuffer_init(fb_spec, frame_interval);
+        if (memory.framebuffer == NULL)
+        {
+            free_memory(&memory);
+            return 0;
+        }
+    }
 
-        printf("; Disassembly of %s\nbits 16\n\n", argv[1]);
-        decode_instruction_stream(&memory, flags);
+    begin_profile();
+    if (instance_count > 0)
+        instances_execute(&memory, instance_count);
+    else
+    {
+        if (flags == 0 || flags == PARALLEL_DISASSEMBLY)
+            printf("; Disassembly of %s\nbits 16\n\n", file_path);
+        decode_instruction_stream(&memory, flags, restore ? &resume : NULL, save_at, parallel_chunks);
     }
+#if PAP_PROFILER
+    // stderr so the listing on stdout still assembles
+    end_and_print_profile(stderr);
+#endif
 
+    if (memory.framebuffer != NULL)
+        framebuffer_destroy(memory.framebuffer);
     free_memory(&memory);
     return 0;
 }
 
+PROFILER_END_OF_COMPILATION_UNIT
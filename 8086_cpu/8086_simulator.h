@@ -4,8 +4,14 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #define PAP_HELPER_IMPLEMENTATION
 #include "../pap_helper.h"
+#include "8086_decode_backend.h"
 
 #define array_count(Array) (sizeof(Array) / sizeof((Array)[0]))
 #ifdef DEBUG
@@ -22,19 +28,50 @@
   Memory
   =================================================*/
 typedef struct Memory Memory;
+typedef struct Memory_Trace Memory_Trace;
+typedef struct Framebuffer Framebuffer;
+void memory_init(Memory* memory, const uint32_t size);
+void memory_copy_in(Memory* memory, const uint32_t address, const uint8_t* src, const uint32_t size);
+void memory_copy_out(const Memory* memory, const uint32_t address, uint8_t* dest, const uint32_t size);
+void memory_copy(Memory* dest, const Memory* src);
+void memory_clone(Memory* dest, const Memory* src);
+uint64_t memory_resident_bytes(const Memory* memory);
 void free_memory(Memory* memory);
 void read_file(Memory* memory, const char* file_path);
+uint16_t memory_read(Memory* memory, const uint32_t address, const uint8_t width, const uint16_t ip);
+void memory_write(Memory* memory, const uint32_t address, const uint16_t value, const uint8_t width, const uint16_t ip);
+Memory_Trace* memory_trace_open();
+void memory_trace_close(Memory_Trace* trace);
+void memory_trace_summary(const char* file_path);
+Framebuffer* framebuffer_init(const char* spec, const uint32_t frame_interval);
+void framebuffer_tick(Framebuffer* framebuffer, Memory* memory);
+void framebuffer_export(Framebuffer* framebuffer, Memory* memory);
+void framebuffer_destroy(Framebuffer* framebuffer);
 
 /*===================================================
   Decoding unit
   =================================================*/
 #define EXECUTION_OF_INSTRUCTION (1<<0)
 #define DUMP_MEMORY_AFTER_EXEC   (1<<1)
+#define SILENT_EXECUTION         (1<<2) // no per instruction printing
+#define MICRO_OP_EXECUTION       (1<<3) // lower basic blocks into micro-ops and run those instead
+#define FUSED_EXECUTION          (1<<4) // profile a training run and fuse hot micro-op idioms
+#define CONTROL_FLOW_REPORT      (1<<5) // static loop cost estimate, nothing is executed
+#define PREDECODE_REPORT         (1<<6) // boundary scan off the length table, checked against the full decoder
+#define PARALLEL_DISASSEMBLY     (1<<7) // chunks decoded on their own thread, same output as the sequential decoder
+#define MEMORY_TRACE             (1<<8) // every guest memory access of the run goes to a memory_trace file
+#define DOS_COM_PROGRAM          (1<<9) // loaded at 0x100 after a PSP, int 21h is serviced by the DOS stubs
+#define BENCHMARK_BACKENDS       (1<<10) // the program is timed on every execution backend
+#define LOCKSTEP_EXECUTION       (1<<11) // interpreter and micro-op engine side by side, state hashes compared per block
 
 typedef struct Assembly_Inst Assembly_Inst;
+typedef struct Decode_Unit Decode_Unit;
+
+typedef struct Checkpoint_Header Checkpoint_Header;
 
 void print_inst_table();
-void decode_instruction_stream(Memory* memory, uint32_t flags);
+void decode_instruction_stream(Memory* memory, uint32_t flags, const Checkpoint_Header* resume, const uint64_t save_at,
+                               const uint32_t parallel_chunks);
 
 
 /*===================================================
@@ -69,49 +106,715 @@ typedef enum
     TRAP_FLAG       = (1<<8)
 } CPU_Flags;
 
+typedef struct Micro_Block Micro_Block;
+typedef struct Dos_State Dos_State;
+
 typedef struct CP_units
 {
     uint16_t reg[12];
     uint16_t ip;
+    uint16_t inst_ip; // start of the instruction being executed
     uint16_t flags;
+    bool halted;
+    bool executed;    // set by inst_exec, a .COM program stops on an instruction that never got there
+    uint64_t instruction_count; // guest instructions retired
+    uint64_t clocks;            // their estimated 8086 clocks, see estimate_clocks
+    uint64_t checkpoint_at;     // instruction count to write a checkpoint at, 0 for never
     Memory* memory;
+    Micro_Block* record; // when set inst_exec records into the block instead of executing
+    Dos_State* dos;      // NULL unless a .COM program is loaded
 } CP_units;
 
 CP_units* registers_init(Memory* memory);
 void print_memory_status(CP_units* unit);
 void dump_memory(Memory* memory);
 
+/*===================================================
+  DOS program loader
+  =================================================*/
+void read_com_file(Memory* memory, const char* file_path);
+void dos_init(CP_units* exec);
+void dos_destroy(CP_units* exec);
+void dos_interrupt(CP_units* exec, const uint8_t number);
+
+/*===================================================
+  Micro-op IR
+  =================================================*/
+void micro_op_execute_stream(Memory* memory, Decode_Unit* d_unit, CP_units* exec);
+void superinstruction_execute_stream(Memory* memory, Decode_Unit* d_unit, CP_units* exec);
+
+/*===================================================
+  Control flow analysis
+  =================================================*/
+void control_flow_report(Memory* memory, Decode_Unit* d_unit);
+
+/*===================================================
+  Predecoder
+  =================================================*/
+void predecode_init();
+uint32_t predecode_length(Memory* memory, const uint32_t index);
+uint32_t predecode_boundaries(Memory* memory, uint32_t start, const uint32_t end, uint32_t* out, const uint32_t max);
+void predecode_report(Memory* memory, Decode_Unit* d_unit);
+
+/*===================================================
+  Parallel disassembly
+  =================================================*/
+typedef struct
+{
+    uint32_t chunk_count;         // one thread each
+    uint32_t resync_bytes;
+    uint32_t misaligned_chunks;   // guessed start fell inside an instruction
+    uint64_t scan_nano;
+    uint64_t stitch_nano;
+    uint64_t decode_nano;
+} Parallel_Stats;
+void parallel_disassembly(Memory* memory, Decode_Unit* d_unit, uint32_t chunk_count, Parallel_Stats* stats);
+void print_parallel_stats(const Parallel_Stats* stats, const uint32_t bytes);
+
+/*===================================================
+  Benchmarks
+  =================================================*/
+void benchmark_backends(Memory* memory, Decode_Unit* d_unit, CP_units* exec);
+
+/*===================================================
+  Lockstep execution
+  =================================================*/
+uint64_t machine_hash(const CP_units* exec, const bool with_flags);
+void lockstep_execute_stream(Memory* memory, Decode_Unit* d_unit, CP_units* exec);
+
+/*===================================================
+  Batch instances
+  =================================================*/
+void instances_execute(Memory* memory, const uint32_t instance_count);
+
+/*===================================================
+  Checkpoints
+  =================================================*/
+void checkpoint_save(CP_units* exec, const Decode_Unit* d_unit);
+bool checkpoint_load(Memory* memory, const char* file_path, Checkpoint_Header* state);
+void checkpoint_resume(const Checkpoint_Header* state, CP_units* exec, Decode_Unit* d_unit);
+
 /* Implementation */
 
 /*===================================================
   Memory
   =================================================*/
 #define MEMORY_SIZE 1024*1024
+#define MEMORY_PAGE_SHIFT 12
+#define MEMORY_PAGE_SIZE  (1<<MEMORY_PAGE_SHIFT)
+#define MEMORY_PAGE_MASK  (MEMORY_PAGE_SIZE -1)
+
 typedef struct Memory
 {
-    uint8_t* data;
+    uint8_t** pages;          // page table, a page is allocated on its first write and reads as memory_zero_page until then
+    uint32_t page_count;
+    uint32_t pages_allocated;
+    uint32_t last_page;       // one entry cache in front of the page table, always an allocated page
+    uint8_t* last_data;
     uint32_t bytes_used; // only counting the number of bytes needed to store the program
+    Memory_Trace* trace; // NULL unless tracing
+    Framebuffer* framebuffer; // NULL unless a region is exported as an image
+    uint8_t* mapping;         // checkpoint file the restored pages live in, copy on write
+    size_t mapping_size;
+    uint64_t hash;            // of the bytes written since it was last cleared, kept by memory_write
 } Memory;
 
+#define MEMORY_READ_SLACK 16 // the decoders read a few bytes past the last instruction
+
+// shared by every untouched page of every Memory, never written
+static const uint8_t memory_zero_page[MEMORY_PAGE_SIZE];
+
+void memory_init(Memory* memory, const uint32_t size)
+{
+    memory->page_count      = (size + MEMORY_PAGE_SIZE -1) >> MEMORY_PAGE_SHIFT;
+    memory->pages           = (uint8_t**)malloc(memory->page_count * sizeof(uint8_t*));
+    memory->pages_allocated = 0;
+    memory->last_page       = UINT32_MAX;
+    memory->last_data       = NULL;
+    for (uint32_t i = 0; i < memory->page_count; ++i)
+        memory->pages[i] = (uint8_t*)memory_zero_page;
+}
+
+static inline uint8_t memory_byte(const Memory* memory, const uint32_t address)
+{
+    return memory->pages[address >> MEMORY_PAGE_SHIFT][address & MEMORY_PAGE_MASK];
+}
+
+static inline bool memory_page_touched(const Memory* memory, const uint32_t page)
+{
+    return memory->pages[page] != memory_zero_page;
+}
+
+// restored from a checkpoint and still backed by its file mapping
+static inline bool memory_page_mapped(const Memory* memory, const uint32_t page)
+{
+    return memory->mapping != NULL && memory->pages[page] >= memory->mapping &&
+           memory->pages[page] < memory->mapping + memory->mapping_size;
+}
+
+static inline uint8_t* memory_page_for_write(Memory* memory, const uint32_t page)
+{
+    if (page == memory->last_page)
+        return memory->last_data;
+
+    if (!memory_page_touched(memory, page))
+    {
+        memory->pages[page] = (uint8_t*)calloc(1, MEMORY_PAGE_SIZE);
+        ++memory->pages_allocated;
+    }
+    memory->last_page = page;
+    memory->last_data = memory->pages[page];
+    return memory->last_data;
+}
+
+static inline void memory_set_byte(Memory* memory, const uint32_t address, const uint8_t value)
+{
+    memory_page_for_write(memory, address >> MEMORY_PAGE_SHIFT)[address & MEMORY_PAGE_MASK] = value;
+}
+
+// loader side bulk copies, neither traced nor hashed
+void memory_copy_in(Memory* memory, const uint32_t address, const uint8_t* src, const uint32_t size)
+{
+    for (uint32_t done = 0; done < size;)
+    {
+        const uint32_t offset = (address + done) & MEMORY_PAGE_MASK;
+        const uint32_t chunk  = (size - done < MEMORY_PAGE_SIZE - offset) ? size - done : MEMORY_PAGE_SIZE - offset;
+        memcpy(memory_page_for_write(memory, (address + done) >> MEMORY_PAGE_SHIFT) + offset, src + done, chunk);
+        done += chunk;
+    }
+}
+
+void memory_copy_out(const Memory* memory, const uint32_t address, uint8_t* dest, const uint32_t size)
+{
+    for (uint32_t done = 0; done < size;)
+    {
+        const uint32_t offset = (address + done) & MEMORY_PAGE_MASK;
+        const uint32_t chunk  = (size - done < MEMORY_PAGE_SIZE - offset) ? size - done : MEMORY_PAGE_SIZE - offset;
+        memcpy(dest + done, memory->pages[(address + done) >> MEMORY_PAGE_SHIFT] + offset, chunk);
+        done += chunk;
+    }
+}
+
+/* Makes dest hold the same bytes as src, used for snapshots of a run. Pages untouched in src
+   are zeroed but stay allocated in dest, a restored run is about to write them again */
+void memory_copy(Memory* dest, const Memory* src)
+{
+    assert(dest->page_count == src->page_count && "ERROR - memory copy between different sizes\n");
+    for (uint32_t i = 0; i < src->page_count; ++i)
+    {
+        if (memory_page_touched(src, i))
+            memcpy(memory_page_for_write(dest, i), src->pages[i], MEMORY_PAGE_SIZE);
+        else if (memory_page_touched(dest, i))
+            memset(dest->pages[i], 0, MEMORY_PAGE_SIZE);
+    }
+    dest->bytes_used = src->bytes_used;
+    dest->hash       = src->hash;
+}
+
+void memory_clone(Memory* dest, const Memory* src)
+{
+    memset(dest, 0, sizeof(Memory));
+    memory_init(dest, src->page_count << MEMORY_PAGE_SHIFT);
+    memory_copy(dest, src);
+}
+
+// page table and touched pages, what the instance actually costs
+uint64_t memory_resident_bytes(const Memory* memory)
+{
+    return (uint64_t)memory->pages_allocated * MEMORY_PAGE_SIZE + memory->page_count * sizeof(uint8_t*);
+}
+
+// images larger than the address space can still be disassembled, so the page table grows to fit the file
 void read_file(Memory* memory, const char* file_path)
 {
-    memory->data = (uint8_t*)malloc(sizeof(uint8_t) * MEMORY_SIZE);
     memory->bytes_used = 0;
 
     FILE* file_ptr = fopen(file_path, "rb");
-    uint8_t byte;
+    if (file_ptr == NULL)
+    {
+        printf("ERROR - could not open %s\n", file_path);
+        exit(1);
+    }
+
+    fseek(file_ptr, 0, SEEK_END);
+    uint32_t file_size = (uint32_t)ftell(file_ptr);
+    fseek(file_ptr, 0, SEEK_SET);
+
+    uint32_t size = file_size + MEMORY_READ_SLACK > MEMORY_SIZE ? file_size + MEMORY_READ_SLACK : MEMORY_SIZE;
+    memory_init(memory, size);
+
+    // straight into the pages, only the ones the image covers get allocated
+    while (memory->bytes_used < file_size)
+    {
+        uint32_t chunk = file_size - memory->bytes_used < MEMORY_PAGE_SIZE ? file_size - memory->bytes_used : MEMORY_PAGE_SIZE;
+        uint32_t moved = (uint32_t)fread(memory_page_for_write(memory, memory->bytes_used >> MEMORY_PAGE_SHIFT), 1, chunk, file_ptr);
+        memory->bytes_used += moved;
+        if (moved < chunk)
+            break;
+    }
+
+    fclose(file_ptr);
+}
+
+/*==========================================
+  Memory tracing
+  Accesses are buffered and flushed to the trace
+  file each time the buffer fills
+  ========================================*/
+typedef struct
+{
+    uint32_t address;
+    uint16_t ip;     // start of the instruction
+    uint8_t width;   // in bytes
+    uint8_t write;
+} Memory_Access;
+
+#define MEMORY_TRACE_CAPACITY 4096
+typedef struct Memory_Trace
+{
+    FILE* file;
+    char filename[64];
+    uint32_t count;
+    uint64_t total;
+    Memory_Access records[MEMORY_TRACE_CAPACITY];
+} Memory_Trace;
+
+Memory_Trace* memory_trace_open()
+{
+    Memory_Trace* trace = (Memory_Trace*)malloc(sizeof(Memory_Trace));
+    trace->count        = 0;
+    trace->total        = 0;
+    snprintf(trace->filename, 64, "memory_trace_%lu.data", time(NULL));
+
+    trace->file = fopen(trace->filename, "wb");
+    if (trace->file == NULL)
+    {
+        printf("ERROR - could not open file for the memory trace\n");
+        free(trace);
+        return NULL;
+    }
+    return trace;
+}
+
+static void memory_trace_flush(Memory_Trace* trace)
+{
+    fwrite(trace->records, sizeof(Memory_Access), trace->count, trace->file);
+    trace->count = 0;
+}
+
+void memory_trace_close(Memory_Trace* trace)
+{
+    memory_trace_flush(trace);
+    fclose(trace->file);
+    printf("%lu memory accesses traced to file: %s\n", trace->total, trace->filename);
+    free(trace);
+}
+
+static inline void memory_trace_record(Memory_Trace* trace, const uint32_t address, const uint8_t width, const uint16_t ip, const uint8_t write)
+{
+    trace->records[trace->count++] = (Memory_Access){address, ip, width, write};
+    ++trace->total;
+    if (trace->count == MEMORY_TRACE_CAPACITY)
+        memory_trace_flush(trace);
+}
+
+/*==========================================
+  Framebuffer
+  A region of guest memory read as an image. Writes
+  into it mark the rows and the rectangle they touch,
+  each export re-encodes only the marked rows of the
+  kept PPM image before writing it out
+  ========================================*/
+typedef enum : uint8_t
+{
+    PIXEL_RGBA8,
+    PIXEL_RGB8,
+    PIXEL_GRAY8
+} Pixel_Format;
+
+typedef struct Framebuffer
+{
+    uint32_t base;
+    uint32_t width;
+    uint32_t height;
+    Pixel_Format format;
+    uint8_t bytes_per_pixel;
+
+    // dirty rectangle since the last export, empty when x0 > x1
+    uint32_t x0, y0, x1, y1;
+    uint8_t* row_dirty;
+    uint8_t* row; // source row copied out of guest memory
+
+    uint32_t frame_interval; // instructions between frames, 0 only exports at the end
+    uint32_t ticks;
+    uint32_t frame;
+    time_t stamp;
+
+    uint8_t* image;        // the whole PPM file, header then rgb rows
+    uint32_t header_size;
+    uint32_t image_size;
+} Framebuffer;
+
+static void framebuffer_clear_dirty(Framebuffer* framebuffer)
+{
+    framebuffer->x0 = UINT32_MAX;
+    framebuffer->y0 = UINT32_MAX;
+    framebuffer->x1 = 0;
+    framebuffer->y1 = 0;
+    memset(framebuffer->row_dirty, 0, framebuffer->height);
+}
+
+// spec is base:width:height:format, format one of rgba, rgb or gray
+Framebuffer* framebuffer_init(const char* spec, const uint32_t frame_interval)
+{
+    char format[16] = {0};
+    unsigned long base, width, height;
+    char* end;
+
+    base   = strtoul(spec, &end, 0);
+    if (*end != ':')
+        goto bad_spec;
+    width  = strtoul(end +1, &end, 0);
+    if (*end != ':')
+        goto bad_spec;
+    height = strtoul(end +1, &end, 0);
+    if (*end != ':' || sscanf(end +1, "%15s", format) != 1 || width == 0 || height == 0)
+        goto bad_spec;
+
+    Framebuffer* framebuffer = (Framebuffer*)calloc(1, sizeof(Framebuffer));
+    if (strcmp(format, "rgba") == 0)
+    {
+        framebuffer->format          = PIXEL_RGBA8;
+        framebuffer->bytes_per_pixel = 4;
+    }
+    else if (strcmp(format, "rgb") == 0)
+    {
+        framebuffer->format          = PIXEL_RGB8;
+        framebuffer->bytes_per_pixel = 3;
+    }
+    else if (strcmp(format, "gray") == 0)
+    {
+        framebuffer->format          = PIXEL_GRAY8;
+        framebuffer->bytes_per_pixel = 1;
+    }
+    else
+    {
+        free(framebuffer);
+        goto bad_spec;
+    }
+
+    // each side is bounded first so the size can't wrap
+    if (base > MEMORY_SIZE || width > MEMORY_SIZE || height > MEMORY_SIZE
+            || (uint64_t)base + (uint64_t)width * height * framebuffer->bytes_per_pixel > MEMORY_SIZE)
+    {
+        printf("ERROR - framebuffer %s does not fit in memory\n", spec);
+        free(framebuffer);
+        return NULL;
+    }
+    framebuffer->base   = (uint32_t)base;
+    framebuffer->width  = (uint32_t)width;
+    framebuffer->height = (uint32_t)height;
+
+    framebuffer->frame_interval = frame_interval;
+    framebuffer->stamp          = time(NULL);
+    framebuffer->row_dirty      = (uint8_t*)malloc(framebuffer->height);
+    framebuffer->row            = (uint8_t*)malloc(framebuffer->width * framebuffer->bytes_per_pixel);
+
+    char header[64];
+    framebuffer->header_size = snprintf(header, 64, "P6\n%u %u\n255\n", framebuffer->width, framebuffer->height);
+    framebuffer->image_size  = framebuffer->header_size + framebuffer->width * framebuffer->height * 3;
+    framebuffer->image       = (uint8_t*)malloc(framebuffer->image_size);
+    memcpy(framebuffer->image, header, framebuffer->header_size);
+
+    // the first frame encodes everything
+    framebuffer_clear_dirty(framebuffer);
+    memset(framebuffer->row_dirty, 1, framebuffer->height);
+    framebuffer->x0 = 0;
+    framebuffer->y0 = 0;
+    framebuffer->x1 = framebuffer->width -1;
+    framebuffer->y1 = framebuffer->height -1;
+    return framebuffer;
+
+bad_spec:
+    printf("ERROR - framebuffer spec %s is not base:width:height:rgba|rgb|gray\n", spec);
+    return NULL;
+}
+
+void framebuffer_destroy(Framebuffer* framebuffer)
+{
+    free(framebuffer->image);
+    free(framebuffer->row_dirty);
+    free(framebuffer->row);
+    free(framebuffer);
+}
+
+static inline void framebuffer_mark(Framebuffer* framebuffer, const uint32_t address, const uint8_t width)
+{
+    const uint32_t size = framebuffer->width * framebuffer->height * framebuffer->bytes_per_pixel;
+    for (uint32_t a = address; a < address + width; ++a)
+    {
+        if (a < framebuffer->base || a >= framebuffer->base + size)
+            continue;
+
+        uint32_t pixel = (a - framebuffer->base) / framebuffer->bytes_per_pixel;
+        uint32_t x     = pixel % framebuffer->width;
+        uint32_t y     = pixel / framebuffer->width;
+
+        framebuffer->row_dirty[y] = 1;
+        if (x < framebuffer->x0) framebuffer->x0 = x;
+        if (x > framebuffer->x1) framebuffer->x1 = x;
+        if (y < framebuffer->y0) framebuffer->y0 = y;
+        if (y > framebuffer->y1) framebuffer->y1 = y;
+    }
+}
+
+void framebuffer_export(Framebuffer* framebuffer, Memory* memory)
+{
+    if (framebuffer->x0 > framebuffer->x1)
+        return; // nothing changed since the last frame
+
+    uint32_t rows_encoded = 0;
+    for (uint32_t y = 0; y < framebuffer->height; ++y)
+    {
+        if (!framebuffer->row_dirty[y])
+            continue;
+
+        // rows can straddle pages so they are copied out first
+        const uint32_t row_size = framebuffer->width * framebuffer->bytes_per_pixel;
+        memory_copy_out(memory, framebuffer->base + y * row_size, framebuffer->row, row_size);
+        const uint8_t* src = framebuffer->row;
+        uint8_t* dest      = &framebuffer->image[framebuffer->header_size + y * framebuffer->width * 3];
+        for (uint32_t x = 0; x < framebuffer->width; ++x)
+        {
+            if (framebuffer->format == PIXEL_GRAY8)
+            {
+                dest[0] = dest[1] = dest[2] = src[0];
+            }
+            else
+            {
+                // alpha is dropped, ppm has no channel for it
+                dest[0] = src[0];
+                dest[1] = src[1];
+                dest[2] = src[2];
+            }
+            src  += framebuffer->bytes_per_pixel;
+            dest += 3;
+        }
+        ++rows_encoded;
+    }
+
+    char filename[64];
+    snprintf(filename, 64, "framebuffer_%lu_%u.ppm", framebuffer->stamp, framebuffer->frame);
+    FILE* file_ptr = fopen(filename, "wb");
+    if (file_ptr == NULL)
+    {
+        printf("ERROR - could not open file for the framebuffer\n");
+        return;
+    }
+    fwrite(framebuffer->image, 1, framebuffer->image_size, file_ptr);
+    fclose(file_ptr);
+
+    printf("Frame %u dirty (%u,%u)-(%u,%u), %u rows encoded, written to file: %s\n", framebuffer->frame,
+           framebuffer->x0, framebuffer->y0, framebuffer->x1, framebuffer->y1, rows_encoded, filename);
+
+    ++framebuffer->frame;
+    framebuffer_clear_dirty(framebuffer);
+}
+
+// called once per executed instruction, exports a frame every frame_interval instructions
+void framebuffer_tick(Framebuffer* framebuffer, Memory* memory)
+{
+    if (framebuffer->frame_interval == 0 || ++framebuffer->ticks < framebuffer->frame_interval)
+        return;
+
+    framebuffer->ticks = 0;
+    framebuffer_export(framebuffer, memory);
+}
+
+// all guest loads and stores go through these two, words are little endian
+uint16_t memory_read(Memory* memory, const uint32_t address, const uint8_t width, const uint16_t ip)
+{
+    if (memory->trace != NULL)
+        memory_trace_record(memory->trace, address, width, ip, 0);
+
+    const uint32_t page  = address >> MEMORY_PAGE_SHIFT;
+    const uint32_t index = address & MEMORY_PAGE_MASK;
+    const uint8_t* data  = (page == memory->last_page) ? memory->last_data : memory->pages[page];
+    if (width == 1)
+        return data[index];
+    if (index == MEMORY_PAGE_MASK)
+        return data[index] | (memory_byte(memory, address +1) << 8); // word across two pages
+    return data[index] | (data[index +1] << 8);
+}
+
+// every byte gets its own value per address, a write xors the old one out and the new one in
+static inline uint64_t memory_hash_byte(const uint32_t address, const uint8_t value)
+{
+    uint64_t x = (((uint64_t)address << 8) | value) * 0x9E3779B97F4A7C15ull;
+    return x ^ (x >> 29);
+}
+
+void memory_write(Memory* memory, const uint32_t address, const uint16_t value, const uint8_t width, const uint16_t ip)
+{
+    if (memory->trace != NULL)
+        memory_trace_record(memory->trace, address, width, ip, 1);
+    if (memory->framebuffer != NULL)
+        framebuffer_mark(memory->framebuffer, address, width);
+
+    uint8_t* data        = memory_page_for_write(memory, address >> MEMORY_PAGE_SHIFT);
+    const uint32_t index = address & MEMORY_PAGE_MASK;
+    memory->hash ^= memory_hash_byte(address, data[index]) ^ memory_hash_byte(address, (uint8_t)value);
+    data[index]   = (uint8_t)value;
+    if (width == 2)
+    {
+        // the high byte may start the next page
+        const uint32_t high_index = (address +1) & MEMORY_PAGE_MASK;
+        if (high_index == 0)
+            data = memory_page_for_write(memory, (address +1) >> MEMORY_PAGE_SHIFT);
+        memory->hash    ^= memory_hash_byte(address +1, data[high_index]) ^ memory_hash_byte(address +1, (uint8_t)(value >> 8));
+        data[high_index] = (uint8_t)(value >> 8);
+    }
+}
+
+#define TRACE_TOP_ADDRESSES 16
+#define TRACE_STRIDE_RANGE  256 // strides past this are counted together
+#define TRACE_BAR_WIDTH     40
+
+// offline summary of a trace file: per 256 byte heatmap, most written addresses and the write stride
+void memory_trace_summary(const char* file_path)
+{
+    FILE* file_ptr = fopen(file_path, "rb");
+    if (file_ptr == NULL)
+    {
+        printf("ERROR - could not open trace file %s\n", file_path);
+        return;
+    }
+
+    const uint32_t page_count = MEMORY_SIZE / 256 +1;
+    uint32_t* page_reads      = (uint32_t*)calloc(page_count, sizeof(uint32_t));
+    uint32_t* page_writes     = (uint32_t*)calloc(page_count, sizeof(uint32_t));
+    uint32_t* address_writes  = (uint32_t*)calloc(MEMORY_SIZE +2, sizeof(uint32_t));
+    uint16_t* address_ip      = (uint16_t*)calloc(MEMORY_SIZE +2, sizeof(uint16_t));
+    uint64_t strides[2 * TRACE_STRIDE_RANGE +2] = {0}; // last slot is everything out of range
+
+    uint64_t reads = 0, writes = 0, bytes_read = 0, bytes_written = 0;
+    int64_t last_write = -1;
+
+    Memory_Access records[MEMORY_TRACE_CAPACITY];
+    size_t count;
+    while ((count = fread(records, sizeof(Memory_Access), MEMORY_TRACE_CAPACITY, file_ptr)) > 0)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            Memory_Access* access = &records[i];
+            if (access->address > MEMORY_SIZE)
+                continue;
+
+            if (!access->write)
+            {
+                ++reads;
+                bytes_read += access->width;
+                ++page_reads[access->address / 256];
+                continue;
+            }
 
-    while(fread(&byte, 1, 1, file_ptr) > 0)
-        memory->data[memory->bytes_used++] = byte;
+            ++writes;
+            bytes_written += access->width;
+            ++page_writes[access->address / 256];
+            if (address_writes[access->address]++ == 0)
+                address_ip[access->address] = access->ip;
 
+            if (last_write != -1)
+            {
+                int64_t stride = (int64_t)access->address - last_write;
+                if (stride >= -TRACE_STRIDE_RANGE && stride <= TRACE_STRIDE_RANGE)
+                    ++strides[stride + TRACE_STRIDE_RANGE];
+                else
+                    ++strides[2 * TRACE_STRIDE_RANGE +1];
+            }
+            last_write = access->address;
+        }
+    }
     fclose(file_ptr);
+
+    printf("; Memory trace %s\n", file_path);
+    printf("; %lu reads (%lu bytes), %lu writes (%lu bytes)\n\n", reads, bytes_read, writes, bytes_written);
+
+    uint32_t busiest = 1;
+    for (uint32_t p = 0; p < page_count; ++p)
+        if (page_reads[p] + page_writes[p] > busiest)
+            busiest = page_reads[p] + page_writes[p];
+
+    printf("; Heatmap per 256 bytes ('#' write, '.' read)\n");
+    printf(";     page     reads    writes\n");
+    for (uint32_t p = 0; p < page_count; ++p)
+    {
+        if (page_reads[p] + page_writes[p] == 0)
+            continue;
+
+        uint32_t write_bar = (uint32_t)((uint64_t)page_writes[p] * TRACE_BAR_WIDTH / busiest);
+        uint32_t read_bar  = (uint32_t)((uint64_t)page_reads[p] * TRACE_BAR_WIDTH / busiest);
+        printf("  0x%05x %9u %9u  ", p * 256, page_reads[p], page_writes[p]);
+        for (uint32_t i = 0; i < write_bar; ++i)
+            printf("#");
+        for (uint32_t i = 0; i < read_bar; ++i)
+            printf(".");
+        printf("\n");
+    }
+
+    printf("\n; Most written addresses\n");
+    printf(";  address    writes  first ip\n");
+    for (uint32_t n = 0; n < TRACE_TOP_ADDRESSES; ++n)
+    {
+        uint32_t top = 0;
+        for (uint32_t i = 1; i < MEMORY_SIZE +2; ++i)
+            if (address_writes[i] > address_writes[top])
+                top = i;
+        if (address_writes[top] == 0)
+            break;
+
+        printf("  0x%05x %9u  %8hu\n", top, address_writes[top], address_ip[top]);
+        address_writes[top] = 0;
+    }
+
+    printf("\n; Write stride (distance to the previous write)\n");
+    for (uint32_t n = 0; n < 4 && writes > 1; ++n)
+    {
+        uint32_t top = 0;
+        for (uint32_t i = 1; i < array_count(strides); ++i)
+            if (strides[i] > strides[top])
+                top = i;
+        if (strides[top] == 0)
+            break;
+
+        if (top == 2 * TRACE_STRIDE_RANGE +1)
+            printf("  >%d bytes: %5.1f%%\n", TRACE_STRIDE_RANGE, 100.0 * strides[top] / (writes -1));
+        else
+            printf("  %+d bytes: %5.1f%%\n", (int32_t)top - TRACE_STRIDE_RANGE, 100.0 * strides[top] / (writes -1));
+        strides[top] = 0;
+    }
+
+    free(address_ip);
+    free(address_writes);
+    free(page_writes);
+    free(page_reads);
 }
 
 void free_memory(Memory* memory)
 {
-    free(memory->data);
-    memory->data       = NULL;
-    memory->bytes_used = 0;
+    for (uint32_t i = 0; i < memory->page_count; ++i)
+        if (memory_page_touched(memory, i) && !memory_page_mapped(memory, i))
+            free(memory->pages[i]);
+    free(memory->pages);
+    if (memory->mapping != NULL)
+        munmap(memory->mapping, memory->mapping_size);
+    memory->mapping         = NULL;
+    memory->mapping_size    = 0;
+    memory->pages           = NULL;
+    memory->page_count      = 0;
+    memory->pages_allocated = 0;
+    memory->last_page       = UINT32_MAX;
+    memory->bytes_used      = 0;
 }
 
 /*===================================================
@@ -307,7 +1010,8 @@ enum
     FROM_REGISTER   = (1<<1),
     FROM_MEMORY     = (1<<2),
     TO_MEMORY       = (1<<3),
-    WORD_OPPERATION = (1<<4)
+    WORD_OPPERATION = (1<<4),
+    NO_FLAG_WRITE   = (1<<5)  // flags are dead, set by the micro-op passes
 };
 
 
@@ -414,15 +1118,20 @@ typedef enum
     SEGMENT_OVERRIDE_DS
 } Segment_Override;
 
-typedef struct
+typedef struct Decode_Unit
 {
     int8_t segment_override;
+    uint32_t flags;
+    Instruction_Code last_inst; // after construction, so with the final mnemonic
+    FILE* out;
 } Decode_Unit;
 
 Decode_Unit* decode_unit_init()
 {
     Decode_Unit* d_unit = (Decode_Unit*)malloc(sizeof(Decode_Unit));
     d_unit->segment_override = -1;
+    d_unit->flags            = 0;
+    d_unit->out              = stdout;
     return d_unit;
 }
 
@@ -607,6 +1316,7 @@ void location_extract(Register_Location* Rm, Register_Location* Reg, Instruction
 }
 
 void inst_exec(CP_units* exec, const Register_Location dest, const Register_Location src, const uint16_t value, const int16_t disp, const uint32_t flags, const Operation_Type op);
+bool dos_unhandled(CP_units* exec, const Operation_Type op);
 void mov_construct(Assembly_Inst* assy, Instruction_Code* inst, CP_units* exec)
 {
     int32_t d      = ffetch(inst, Bits_D);
@@ -829,12 +1539,12 @@ void arithmetic_construct(Assembly_Inst* assy, Instruction_Code* inst, Decode_Un
         const char* acc = (w) ? "ax" : "al";
         snprintf(assy->opperant1, MAX_SIZE_OF_OPPERANT, "%s", acc);
         snprintf(assy->opperant2, MAX_SIZE_OF_OPPERANT, "%hu", byte_calc(data_l, data_h));
-        return;
 
         if (exec != NULL)
         {
             inst_exec(exec, w ? AX : AL, NO_LOCATION, byte_calc(data_l, data_h), NOT_USED, FROM_IMMEDIATE, inst->type);
         }
+        return;
     }
 
 
@@ -886,7 +1596,7 @@ void arithmetic_construct(Assembly_Inst* assy, Instruction_Code* inst, Decode_Un
             location_extract(&rm_location, &reg_location, inst);
             uint32_t mode = (rm_location >= BX_SI && rm_location <= DIRECT_ADDRESS_LOCATION) ? (d > 0) ? FROM_MEMORY : TO_MEMORY : FROM_REGISTER;
 
-            inst_exec(exec, d > 0 ? reg_location : rm_location,  d > 0 ? rm_location : reg_location, byte_calc(data_l, data_h), NOT_USED, mode, inst->type);
+            inst_exec(exec, d > 0 ? reg_location : rm_location,  d > 0 ? rm_location : reg_location, byte_calc(data_l, data_h), disp_calc(disp_l, disp_h), mode, inst->type);
         }
 
         return;
@@ -926,7 +1636,8 @@ void arithmetic_construct(Assembly_Inst* assy, Instruction_Code* inst, Decode_Un
         // changing the op_code to the proper mnemonic
         inst->type = (Operation_Type)(inst->type + ffetch(inst, Bits_Literal));
 
-        if (exec != NULL)
+        // only a register destination is executed
+        if (exec != NULL && mod == REGISTER_MODE)
         {
             inst_exec(exec, location_exec(w ? WORD_REGISTERS : BYTE_REGISTERS, (uint8_t)rm), NO_LOCATION, (w && s) ? disp_calc(data_l, data_h) : byte_calc(data_l, data_h), NOT_USED, FROM_IMMEDIATE, inst->type);
         }
@@ -966,35 +1677,34 @@ enum
 const char* string_manpi[] =
 {"movs", "cmps", "stds", "lods", "scas"};
 
-void string_mani_construct(Assembly_Inst* assy, Instruction_Code* inst)
+// index into string_manpi
+static uint8_t string_op_index(const uint8_t string_op)
+{
+    switch(string_op)
+    {
+    case _movs:
+        return 0;
+    case _cmps:
+        return 1;
+    case _stds:
+        return 2;
+    case _lods:
+        return 3;
+    case _scas:
+        return 4;
+    default:
+        assert(0 && "ERROR - unknow type after rep op\n");
+    }
+}
+
+void string_mani_construct(Assembly_Inst* assy, Instruction_Code* inst, CP_units* exec)
 {
     int32_t w = ffetch(inst, Bits_W);
 
     if (inst->type == Op_rep)
     {
         int32_t z = ffetch(inst, Bits_Z);
-        uint8_t i;
-
-        switch(inst->field[2].value)
-        {
-        case _movs:
-            i = 0;
-            break;
-        case _cmps:
-            i = 1;
-            break;
-        case _stds:
-            i = 2;
-            break;
-        case _lods:
-            i = 3;
-            break;
-        case _scas:
-            i = 4;
-            break;
-        default:
-            assert(0 && "ERROR - unknow type after rep op\n");
-        }
+        uint8_t i = string_op_index(inst->field[2].value);
 
         if (i == 1 || i == 4)
             snprintf(assy->opperant1, MAX_SIZE_OF_OPPERANT, "%s", z ? "repe" : "repne");
@@ -1008,6 +1718,10 @@ void string_mani_construct(Assembly_Inst* assy, Instruction_Code* inst)
         snprintf(assy->opperant1, MAX_SIZE_OF_OPPERANT, "%s%c", instruction_string(inst->type), w ? 'w' : 'b');
     }
 
+    // the string op travels in value, rep is told apart by the op
+    if (exec != NULL)
+        inst_exec(exec, NO_LOCATION, NO_LOCATION, inst->type == Op_rep ? inst->field[2].value : inst->field[0].value,
+                  NOT_USED, w ? WORD_OPPERATION : 0, inst->type);
 }
 
 enum // for switching on op codes
@@ -1097,7 +1811,7 @@ void out_in_construct(Assembly_Inst* assy, Instruction_Code* inst)
         snprintf(assy->opperant1, MAX_SIZE_OF_OPPERANT, "%hhu", (uint8_t)data_l);
 }
 
-void call_jump_construct(Assembly_Inst* assy, Instruction_Code* inst)
+void call_jump_construct(Assembly_Inst* assy, Instruction_Code* inst, CP_units* exec)
 {
     int32_t bl       = ffetch(inst, Bits_Literal);
     int32_t disp_l   = ffetch(inst, Bits_Disp_L);
@@ -1114,6 +1828,9 @@ void call_jump_construct(Assembly_Inst* assy, Instruction_Code* inst)
     {
         snprintf(assy->opperant1, MAX_SIZE_OF_OPPERANT, "$+(%hd)", (short)((disp_h == FIELD_NOT_SET ? 2 : 3) + disp_calc(disp_l, disp_h)));
 
+        // only the direct near jump is executed
+        if (exec != NULL && inst->type == Op_jmp)
+            inst_exec(exec, NO_LOCATION, NO_LOCATION, disp_calc(disp_l, disp_h), NOT_USED, 0, Op_jmp);
     }
     else
     {
@@ -1182,16 +1899,16 @@ void pop_push_construct(Assembly_Inst* assy, Instruction_Code* inst)
     }
 }
 
-void print_assembly_inst(Assembly_Inst* assy)
+void print_assembly_inst(FILE* out, Assembly_Inst* assy)
 {
     if (assy->mnemonic >= Op_rep && assy->mnemonic <= Op_scas)
-        printf("%s %s", assy->opperant1, strlen(assy->opperant2) == 0 ? "" : assy->opperant2);
+        fprintf(out, "%s %s", assy->opperant1, strlen(assy->opperant2) == 0 ? "" : assy->opperant2);
     else if (strlen(assy->opperant1) == 0 && strlen(assy->opperant2) == 0)
-        printf("%s", instruction_string(assy->mnemonic));
+        fprintf(out, "%s", instruction_string(assy->mnemonic));
     else if (strlen(assy->opperant2) == 0)
-        printf("%s %s", instruction_string(assy->mnemonic), assy->opperant1);
+        fprintf(out, "%s %s", instruction_string(assy->mnemonic), assy->opperant1);
     else
-        printf("%s %s, %s", instruction_string(assy->mnemonic), assy->opperant1, assy->opperant2);
+        fprintf(out, "%s %s, %s", instruction_string(assy->mnemonic), assy->opperant1, assy->opperant2);
 }
 
 void construct_assembly_inst(Instruction_Code* inst, Decode_Unit* d_unit, CP_units* exec)
@@ -1202,7 +1919,10 @@ void construct_assembly_inst(Instruction_Code* inst, Decode_Unit* d_unit, CP_uni
 
     CP_units old_state = {0};
     if (exec != NULL)
+    {
         memcpy(&old_state, exec, sizeof(CP_units));
+        exec->executed = false;
+    }
 
 
     if (inst->type >= Op_je && inst->type <= Op_jcxz)
@@ -1212,7 +1932,7 @@ void construct_assembly_inst(Instruction_Code* inst, Decode_Unit* d_unit, CP_uni
     else if (inst->type >= Op_mul && inst->type <= Op_sar)
         logic_construct(&assy, inst);
     else if (inst->type >= Op_rep && inst->type <= Op_scas)
-        string_mani_construct(&assy, inst);
+        string_mani_construct(&assy, inst, exec);
     else if (inst->type >= Op_es && inst->type <= Op_ds)
         segment_override_flag(&assy, inst, d_unit);
     else if (inst->field[1].usage == Not_Used || inst->field[1].usage == Bits_Literal)
@@ -1249,11 +1969,13 @@ void construct_assembly_inst(Instruction_Code* inst, Decode_Unit* d_unit, CP_uni
             break;
         case Op_jmp:
         case Op_call:
-            call_jump_construct(&assy, inst);
+            call_jump_construct(&assy, inst, exec);
             break;
         case Op_int:
             if (ffetch(inst, Bits_Data_L) != -1)
                 snprintf(assy.opperant1, MAX_SIZE_OF_OPPERANT, "%hhu", (uint8_t)ffetch(inst, Bits_Data_L));
+            if (exec != NULL)
+                inst_exec(exec, NO_LOCATION, NO_LOCATION, (uint8_t)ffetch(inst, Bits_Data_L), NOT_USED, 0, Op_int);
             break;
         default:
             assert(0);
@@ -1261,16 +1983,23 @@ void construct_assembly_inst(Instruction_Code* inst, Decode_Unit* d_unit, CP_uni
 
     assy.mnemonic = inst->type;
 
+    // the rest of the simulator skips what it doesn't execute, a .COM program can't run past it
+    if (exec != NULL && assy.printable && !exec->executed && !exec->halted)
+        dos_unhandled(exec, inst->type);
+
 
     if (assy.printable)
     {
         if (seg_override(d_unit)) // Segmentation override
             segment_override_set(&assy, d_unit);
 
-        print_assembly_inst(&assy);
-        if (exec != NULL)
-            print_register_change(&old_state, exec);
-        printf("\n");
+        if (!(d_unit->flags & SILENT_EXECUTION))
+        {
+            print_assembly_inst(d_unit->out, &assy);
+            if (exec != NULL)
+                print_register_change(&old_state, exec);
+            fprintf(d_unit->out, "\n");
+        }
     }
 }
 
@@ -1285,26 +2014,26 @@ typedef enum
 
 void unset_bits_field(Instruction_Code* inst, Bits_Usage field)
 {
-    for(uint8_t i = 0; i < array_count(inst->field); ++i)
+    for(uint32_t i = 0; i < array_count(inst->field); ++i)
     {
         if (inst->field[i].usage == field)
         {
             inst->field[i].usage = Not_Used;
-            while (inst->field[i+1].usage != Not_Used)
+            while (i +1 < array_count(inst->field) && inst->field[i+1].usage != Not_Used)
             {
-                if (i +1 == array_count(inst->field))
-                    return;
                 inst->field[i]         = inst->field[i +1];
                 inst->field[++i].usage = Not_Used;
             }
             return;
         }
     }
-    printf("WARNING - field not found to unset\n");
+    // templates without the field (test al / in al with no data high, esc with no displacement) land here
+    DEBUG(printf("WARNING - field not found to unset\n"))
 }
 
 
-int decode_instruction(Memory* memory, Decode_Unit* d_unit, const uint32_t memory_index, const uint32_t inst_index, CP_units* exec)
+// reads the fields of the table entry at inst_index into inst, returns the byte length
+int decode_fields(Memory* memory, const uint32_t memory_index, const uint32_t inst_index, Instruction_Code* out)
 {
     // copying the "templete" instruction
     Instruction_Code inst = instruction_table[inst_index];
@@ -1321,12 +2050,12 @@ int decode_instruction(Memory* memory, Decode_Unit* d_unit, const uint32_t memor
     // starting at the 2nd as we already got the op code from the table
     uint8_t field_index = 1;
     uint8_t saftey      = 0;
-    while(1)
+    while(field_index < MAX_BITS_FIELD)
     {
         if (inst.field[field_index].usage == Not_Used)
             break;
 
-        const uint8_t read_byte = memory->data[memory_index + byte_number];
+        const uint8_t read_byte = memory_byte(memory, memory_index + byte_number);
         DEBUG(print_binary_8(read_byte, NEWLINE_P))
 
 
@@ -1424,10 +2153,54 @@ int decode_instruction(Memory* memory, Decode_Unit* d_unit, const uint32_t memor
     }
     DEBUG(debug_print_Assembly_Inst(&inst))
 
-    if (exec != NULL)
-        exec->ip += byte_number;
-
+    *out = inst;
+    return byte_number;
+}
+
+#define MAX_INSTRUCTION_BYTES 6 // prefixes are their own instruction
+// packs the fields back into bytes, the inverse of decode_fields, returns the byte length
+uint32_t encode_instruction(const Instruction_Code* inst, uint8_t* out)
+{
+    memset(out, 0, MAX_INSTRUCTION_BYTES);
+
+    uint32_t running_total = 0;
+    for (uint8_t i = 0; i < MAX_BITS_FIELD; ++i)
+    {
+        const Bits_Field* field = &inst->field[i];
+        if (i != 0 && field->usage == Not_Used)
+            break;
+        assert(running_total / 8 < MAX_INSTRUCTION_BYTES && "ERROR - instruction too long to encode\n");
+
+        // no field crosses a byte, so it is shifted into place from the top of the byte
+        const uint8_t offset   = running_total % 8;
+        out[running_total / 8] |= (uint8_t)((field->value & ((1 << field->count) -1)) << (8 - (offset + field->count)));
+        running_total         += field->count;
+    }
+    return running_total / 8;
+}
+
+void count_instruction(CP_units* exec, Instruction_Code* inst, const uint16_t next_ip);
+int decode_instruction(Memory* memory, Decode_Unit* d_unit, const uint32_t memory_index, const uint32_t inst_index, CP_units* exec)
+{
+    Instruction_Code inst;
+    uint8_t byte_number;
+    {
+        PROFILE_ZONE("decode");
+        byte_number = decode_fields(memory, memory_index, inst_index, &inst);
+    }
+
+    if (exec != NULL)
+    {
+        exec->inst_ip = exec->ip;
+        exec->ip     += byte_number;
+    }
+
+    // the listing text, and with exec the execution (or lowering when recording)
+    PROFILE_ZONE("execute");
     construct_assembly_inst(&inst, d_unit, exec);
+    d_unit->last_inst = inst;
+    if (exec != NULL)
+        count_instruction(exec, &inst, (uint16_t)(exec->inst_ip + byte_number));
 
     return byte_number;
 }
@@ -1439,35 +2212,92 @@ bool op_code_match(const uint8_t byte, Instruction_Code* inst)
     return op_code_test == inst->field[0].value;
 }
 
+// index into the instruction table of the first matching op code, -1 when there is none
+int32_t op_code_find(const uint8_t byte)
+{
+    for(uint32_t i = 0; i < array_count(instruction_table); ++i)
+        if(op_code_match(byte, &instruction_table[i]))
+            return i;
+    return -1;
+}
+
+uint32_t op_code_lookup(const uint8_t byte)
+{
+    PROFILE_ZONE("decode lookup");
+    int32_t i = op_code_find(byte);
+    assert(i != -1 && "ERROR - unknown Op code\n");
+    return i;
+}
+
+
+// the classic decode and execute loop, one instruction at a time from exec->ip
+void interpreter_run(Memory* memory, Decode_Unit* d_unit, CP_units* exec)
+{
+    PROFILE_FUNCTION;
+    while (exec->ip < memory->bytes_used && !exec->halted)
+    {
+        DEBUG(print_binary_8(memory_byte(memory, exec->ip), NEWLINE_P))
+        decode_instruction(memory, d_unit, exec->ip, op_code_lookup(memory_byte(memory, exec->ip)), exec);
+        if (memory->framebuffer != NULL)
+            framebuffer_tick(memory->framebuffer, memory);
+        if (exec->checkpoint_at != 0 && exec->instruction_count >= exec->checkpoint_at)
+            checkpoint_save(exec, d_unit);
+    }
+}
 
-void decode_instruction_stream(Memory* memory, uint32_t flags)
+void decode_instruction_stream(Memory* memory, uint32_t flags, const Checkpoint_Header* resume, const uint64_t save_at,
+                               const uint32_t parallel_chunks)
 {
     Decode_Unit* d_unit = decode_unit_init();
     uint32_t count      = 0;
 
+    d_unit->flags       = flags;
+
     CP_units* exec = NULL;
     if (flags & EXECUTION_OF_INSTRUCTION)
         exec = registers_init(memory);
+    if (flags & DOS_COM_PROGRAM)
+        dos_init(exec);
+    if (resume != NULL)
+        checkpoint_resume(resume, exec, d_unit);
+    if (save_at != 0)
+    {
+        // the timing and lockstep runs restart the machine, they would save over and over
+        if (flags & (FUSED_EXECUTION | BENCHMARK_BACKENDS | LOCKSTEP_EXECUTION | DOS_COM_PROGRAM))
+            printf("ERROR - checkpoints are only written by -exec and -ir runs of plain programs\n");
+        else if (exec != NULL)
+            exec->checkpoint_at = save_at;
+    }
+    if (flags & MEMORY_TRACE)
+        memory->trace = memory_trace_open();
 
-
-    while(count < memory->bytes_used)
+    if (flags & PARALLEL_DISASSEMBLY)
     {
-        DEBUG(print_binary_8(memory->data[count], NEWLINE_P))
-        for(uint32_t i = 0; i < array_count(instruction_table); ++i)
+        Parallel_Stats stats;
+        parallel_disassembly(memory, d_unit, parallel_chunks, &stats);
+        print_parallel_stats(&stats, memory->bytes_used);
+    }
+    else if (flags & PREDECODE_REPORT)
+        predecode_report(memory, d_unit);
+    else if (flags & CONTROL_FLOW_REPORT)
+        control_flow_report(memory, d_unit);
+    else if (flags & BENCHMARK_BACKENDS)
+        benchmark_backends(memory, d_unit, exec);
+    else if (flags & LOCKSTEP_EXECUTION)
+        lockstep_execute_stream(memory, d_unit, exec);
+    else if (flags & FUSED_EXECUTION)
+        superinstruction_execute_stream(memory, d_unit, exec);
+    else if (flags & MICRO_OP_EXECUTION)
+        micro_op_execute_stream(memory, d_unit, exec);
+    else if (exec != NULL)
+        interpreter_run(memory, d_unit, exec);
+    else
+    {
+        while(count < memory->bytes_used)
         {
-            if(op_code_match(memory->data[count], &instruction_table[i]))
-            {
-                if (exec != NULL)
-                {
-                    decode_instruction(memory, d_unit, exec->ip, i, exec);
-                    count = exec->ip;
-                }
-                else
-                    count += decode_instruction(memory, d_unit, count, i, exec);
-                DEBUG(printf("bytes parsed count: %u, total memory: %u\n\n", count, memory->bytes_used))
-                break;
-            }
-            assert((i +1) != array_count(instruction_table) && "ERROR - unknown Op code\n");
+            DEBUG(print_binary_8(memory_byte(memory, count), NEWLINE_P))
+            count += decode_instruction(memory, d_unit, count, op_code_lookup(memory_byte(memory, count)), exec);
+            DEBUG(printf("bytes parsed count: %u, total memory: %u\n\n", count, memory->bytes_used))
         }
     }
 
@@ -1475,17 +2305,54 @@ void decode_instruction_stream(Memory* memory, uint32_t flags)
     {
         printf("\nFinal state of registers");
         print_memory_status(exec);
+        printf("Instructions executed: %lu, estimated clocks: %lu\n", exec->instruction_count, exec->clocks);
 
         if (flags & DUMP_MEMORY_AFTER_EXEC)
             dump_memory(memory);
     }
 
+    if (memory->trace != NULL)
+    {
+        memory_trace_close(memory->trace);
+        memory->trace = NULL;
+    }
+    if (memory->framebuffer != NULL)
+        framebuffer_export(memory->framebuffer, memory);
+
     free(d_unit);
     if (exec != NULL)
+    {
+        if (exec->dos != NULL)
+            dos_destroy(exec);
         free(exec);
+    }
 }
 
 
+// the table decoder behind the Decode_Stream_Fn interface, the bytes are loaded into a Memory first
+uint32_t table_decode_stream(const uint8_t* bytes, const uint32_t size, FILE* out, uint32_t* boundaries)
+{
+    Memory memory = {0};
+    memory_init(&memory, size + MEMORY_READ_SLACK > MEMORY_SIZE ? size + MEMORY_READ_SLACK : MEMORY_SIZE);
+    memory_copy_in(&memory, 0, bytes, size);
+    memory.bytes_used = size;
+
+    Decode_Unit* d_unit = decode_unit_init();
+    d_unit->out         = out;
+
+    uint32_t count = 0;
+    for (uint32_t at = 0; at < size; ++count)
+    {
+        if (boundaries != NULL)
+            boundaries[count] = at;
+        at += decode_instruction(&memory, d_unit, at, op_code_lookup(memory_byte(&memory, at)), NULL);
+    }
+
+    free(d_unit);
+    free_memory(&memory);
+    return count;
+}
+
 /*==========================================
   Simulation Unit
   ========================================*/
@@ -1494,9 +2361,9 @@ void print_memory(Memory* memory)
 {
     bool data_found = false;
     for(uint32_t i = memory->bytes_used; i < MEMORY_SIZE; ++i)
-        if (memory->data[i] != 0)
+        if (memory_byte(memory, i) != 0)
         {
-            printf("\t[%u]: %hhu\n", i, memory->data[i]);
+            printf("\t[%u]: %hhu\n", i, memory_byte(memory, i));
             data_found = true;
         }
     if (!data_found)
@@ -1719,6 +2586,8 @@ uint16_t effective_address_calculation(CP_units* exec, const Register_Location l
     switch (location)
     {
     case BX_SI:
+        return exec->reg[bx] + exec->reg[si] + (disp == -1 ? 0 : disp);
+    case BX_DI:
         return exec->reg[bx] + exec->reg[di] + (disp == -1 ? 0 : disp);
     case BP_DI:
         return exec->reg[bp] + exec->reg[di] + (disp == -1 ? 0 : disp);
@@ -1819,19 +2688,89 @@ static inline bool cond_jumps_check_flag(CP_units* exec, const Operation_Type ju
     }
 }
 
+uint32_t string_op_repeat_clocks(const uint8_t string_op);
+
+// movs / stos / lods walking si and di, under rep it runs cx times and leaves cx at zero
+static void string_op_exec(CP_units* exec, const uint8_t string_op, const uint32_t flags, const bool rep)
+{
+    const uint8_t width  = (flags & WORD_OPPERATION) ? 2 : 1;
+    const uint16_t step  = (exec->flags & DIRECTION_FLAG) ? -width : width;
+    const uint32_t count = rep ? exec->reg[cx] : 1;
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        switch (string_op)
+        {
+        case _movs:
+            memory_write(exec->memory, exec->reg[di], memory_read(exec->memory, exec->reg[si], width, exec->inst_ip), width, exec->inst_ip);
+            exec->reg[si] += step;
+            exec->reg[di] += step;
+            break;
+        case _stds:
+            memory_write(exec->memory, exec->reg[di], exec->reg[ax], width, exec->inst_ip);
+            exec->reg[di] += step;
+            break;
+        case _lods:
+        {
+            uint16_t value = memory_read(exec->memory, exec->reg[si], width, exec->inst_ip);
+            exec->reg[ax]  = (width == 2) ? value : ((exec->reg[ax] & 0xFF00) | (value & 0x00FF));
+            exec->reg[si] += step;
+            break;
+        }
+        default:
+            printf("ERROR - %s is not executed\n", string_manpi[string_op_index(string_op)]);
+            assert(0 && "ERROR - compare string ops are not executed\n");
+        }
+    }
+
+    if (rep)
+    {
+        exec->clocks += (uint64_t)string_op_repeat_clocks(string_op) * count;
+        exec->reg[cx] = 0;
+    }
+}
+
+void micro_block_record(Micro_Block* block, const Register_Location dest, const Register_Location src, const uint16_t value, const int16_t disp, const uint32_t flags, const Operation_Type op, const uint16_t ip, const uint16_t next_ip);
 void inst_exec(CP_units* exec, const Register_Location dest, const Register_Location src, const uint16_t value, const int16_t disp, const uint32_t flags, const Operation_Type op)
 {
+    exec->executed = true;
+    if (exec->record != NULL)
+    {
+        micro_block_record(exec->record, dest, src, value, disp, flags, op, exec->inst_ip, exec->ip);
+        return;
+    }
 
     if (op >= Op_je && op <= Op_jcxz)
     {
+        if (op != Op_je && op != Op_jne && op != Op_jp && op != Op_jb && (op < Op_loop || op > Op_loopnz)
+                && dos_unhandled(exec, op))
+            return;
         if (cond_jumps_check_flag(exec, op, exec->flags))
             exec->ip += (int8_t)value;
         return;
     }
+    if (op == Op_jmp)
+    {
+        exec->ip += (int16_t)value;
+        return;
+    }
+    if (op == Op_int)
+    {
+        dos_interrupt(exec, (uint8_t)value);
+        return;
+    }
+    if (op >= Op_rep && op <= Op_scas)
+    {
+        if ((value == _cmps || value == _scas) && dos_unhandled(exec, op))
+            return;
+        string_op_exec(exec, (uint8_t)value, flags, op == Op_rep);
+        return;
+    }
 
     uint8_t bit_shift = 0;
     uint16_t bitmask  = 0xFFFF;
     uint8_t r_dest    = at_reg(dest, &bitmask, &bit_shift);
+    const uint8_t width = (flags & WORD_OPPERATION) ? 2 : 1;
 
     switch (op)
     {
@@ -1841,26 +2780,12 @@ void inst_exec(CP_units* exec, const Register_Location dest, const Register_Loca
             if (dest == DIRECT_ADDRESS_LOCATION)
             {
                 if (flags & FROM_IMMEDIATE)
-                {
-                    if (flags & WORD_OPPERATION)
-                    {
-                        exec->memory->data[(uint16_t)disp]    = (uint8_t)value;
-                        exec->memory->data[(uint16_t)disp +1] = (uint8_t)(value >> 8);
-                    }
-                    else
-                        exec->memory->data[(uint16_t)disp]    = (uint8_t)value;
-                }
+                    memory_write(exec->memory, (uint16_t)disp, value, width, exec->inst_ip);
                 else if (flags & FROM_REGISTER)
                 {
                     uint8_t src_shift  = 0;
                     uint8_t r_src      = at_reg(src, NULL, &src_shift);
-                    if (flags & WORD_OPPERATION)
-                    {
-                        exec->memory->data[(uint16_t)disp]    = (uint8_t)(exec->reg[r_src] >> src_shift);
-                        exec->memory->data[(uint16_t)disp +1] = (uint8_t)((exec->reg[r_src] >> src_shift) >> 8);
-                    }
-                    else
-                        exec->memory->data[(uint16_t)disp]    = (uint8_t)(exec->reg[r_src] >> src_shift);;
+                    memory_write(exec->memory, (uint16_t)disp, exec->reg[r_src] >> src_shift, width, exec->inst_ip);
                 }
                 else
                     assert(0);
@@ -1869,32 +2794,18 @@ void inst_exec(CP_units* exec, const Register_Location dest, const Register_Loca
             {
                 uint16_t memory_index = effective_address_calculation(exec, dest, disp);
                 if (flags & FROM_IMMEDIATE)
-                {
-                    if (flags & WORD_OPPERATION)
-                    {
-                        exec->memory->data[memory_index]    = (uint8_t)value;
-                        exec->memory->data[memory_index +1] = (uint8_t)(value >> 8);
-                    }
-                    else
-                        exec->memory->data[memory_index]    = (uint8_t)value;
-                }
+                    memory_write(exec->memory, memory_index, value, width, exec->inst_ip);
                 else if (flags & FROM_REGISTER)
                 {
-                    printf("memory_index: %hu\n", memory_index);
+                    DEBUG(printf("memory_index: %hu\n", memory_index))
                     uint8_t src_shift  = 0;
                     uint8_t r_src      = at_reg(src, NULL, &src_shift);
-                    printf("src reg: %hu\n", (src));
-                    printf("shift value: %hhu\n", src_shift);
-                    printf("src value: %hhu\n", (exec->reg[r_src] >> src_shift));
-                    printf("reg value: %hx\n", (exec->reg[r_src]));
-                    printf("reg value: %hx\n", exec->reg[ax]);
-                    if (flags & WORD_OPPERATION)
-                    {
-                        exec->memory->data[memory_index]    = (uint8_t)(exec->reg[r_src] >> src_shift);
-                        exec->memory->data[memory_index +1] = (uint8_t)((exec->reg[r_src] >> src_shift) >> 8);
-                    }
-                    else
-                        exec->memory->data[memory_index]    = (uint8_t)(exec->reg[r_src] >> src_shift);
+                    DEBUG(printf("src reg: %hu\n", (src)))
+                    DEBUG(printf("shift value: %hhu\n", src_shift))
+                    DEBUG(printf("src value: %hhu\n", (exec->reg[r_src] >> src_shift)))
+                    DEBUG(printf("reg value: %hx\n", (exec->reg[r_src])))
+                    DEBUG(printf("reg value: %hx\n", exec->reg[ax]))
+                    memory_write(exec->memory, memory_index, exec->reg[r_src] >> src_shift, width, exec->inst_ip);
                 }
                 else
                     assert(0);
@@ -1907,12 +2818,11 @@ void inst_exec(CP_units* exec, const Register_Location dest, const Register_Loca
             {
                 if (flags & FROM_REGISTER)
                 {
-                    uint8_t s_shift    = 0;
-                    uint8_t r_src      = at_reg(src, NULL, &s_shift);
+                    uint16_t loaded = memory_read(exec->memory, (uint16_t)disp, width, exec->inst_ip);
                     if (flags & WORD_OPPERATION)
-                        exec->reg[r_dest] = (exec->memory->data[(uint16_t)disp] << 8) | exec->memory->data[(uint16_t)disp +1];
+                        exec->reg[r_dest] = loaded;
                     else
-                        exec->reg[r_dest] = (exec->reg[r_dest] & ~bitmask) | (bitmask & (exec->memory->data[(uint16_t)disp] << bit_shift));
+                        exec->reg[r_dest] = (exec->reg[r_dest] & ~bitmask) | (bitmask & (loaded << bit_shift));
                 }
                 else
                     assert(0);
@@ -1920,10 +2830,11 @@ void inst_exec(CP_units* exec, const Register_Location dest, const Register_Loca
             else
             {
                 uint16_t memory_index = effective_address_calculation(exec, src, disp);
+                uint16_t loaded       = memory_read(exec->memory, memory_index, width, exec->inst_ip);
                 if (flags & WORD_OPPERATION)
-                    exec->reg[r_dest] = (exec->memory->data[memory_index +1] << 8) | exec->memory->data[memory_index];
+                    exec->reg[r_dest] = loaded;
                 else
-                    exec->reg[r_dest] = (exec->reg[r_dest] & ~bitmask) | (bitmask & (exec->memory->data[memory_index] << bit_shift));
+                    exec->reg[r_dest] = (exec->reg[r_dest] & ~bitmask) | (bitmask & (loaded << bit_shift));
             }
         }
         else if (flags & FROM_IMMEDIATE)
@@ -1935,8 +2846,8 @@ void inst_exec(CP_units* exec, const Register_Location dest, const Register_Loca
 
             exec->reg[r_dest]  = (exec->reg[r_dest] & ~bitmask ) | (bitmask & ((exec->reg[r_src] >> s_shift) << bit_shift));
         }
-        else if (flags & FROM_MEMORY)
-            assert(0 && "ERROR - Not yet implementated\n");
+        else if (dos_unhandled(exec, op))
+            return;
         else
             assert(0 && "ERROR - Not yet implementated\n");
         break;
@@ -1965,18 +2876,20 @@ void inst_exec(CP_units* exec, const Register_Location dest, const Register_Loca
         {
             uint16_t memory_index = effective_address_calculation(exec, src, disp);
 
-            amount             = exec->memory->data[memory_index] | (flags & WORD_OPPERATION ? (exec->memory->data[memory_index +1] << 8) : 0);
+            amount             = memory_read(exec->memory, memory_index, width, exec->inst_ip);
             result             = (exec->reg[r_dest] >> bit_shift) + amount;
             exec->reg[r_dest]  = (exec->reg[r_dest] & ~bitmask ) | (bitmask & (result << bit_shift));
         }
         else if (flags & TO_MEMORY)
         {
-
+            if (dos_unhandled(exec, op))
+                return;
         }
         else
             assert(0 && "ERROR - Not yet implementated\n");
 
-        arithmetic_set_flags(exec, result, before, amount, Op_add);
+        if (!(flags & NO_FLAG_WRITE))
+            arithmetic_set_flags(exec, result, before, amount, Op_add);
         break;
     }
     case Op_sub:
@@ -2002,11 +2915,12 @@ void inst_exec(CP_units* exec, const Register_Location dest, const Register_Loca
 
 
         }
-        else if (flags & FROM_MEMORY)
-            assert(0 && "ERROR - Not yet implementated\n");
+        else if (dos_unhandled(exec, op))
+            return;
         else
             assert(0 && "ERROR - Not yet implementated\n");
-        arithmetic_set_flags(exec, result, before, amount, Op_sub);
+        if (!(flags & NO_FLAG_WRITE))
+            arithmetic_set_flags(exec, result, before, amount, Op_sub);
         break;
     }
     case Op_cmp:
@@ -2029,15 +2943,18 @@ void inst_exec(CP_units* exec, const Register_Location dest, const Register_Loca
             result = (exec->reg[r_dest] >> bit_shift) - amount;
 
         }
-        else if (flags & FROM_MEMORY)
-            assert(0 && "ERROR - Not yet implementated\n");
+        else if (dos_unhandled(exec, op))
+            return;
         else
             assert(0 && "ERROR - Not yet implementated\n");
 
-        arithmetic_set_flags(exec, result, before, amount, Op_cmp);
+        if (!(flags & NO_FLAG_WRITE))
+            arithmetic_set_flags(exec, result, before, amount, Op_cmp);
         break;
     }
     default:
+        if (dos_unhandled(exec, op))
+            return;
         assert(0 && "ERROR - Op code not yet implementated\n");
     }
 
@@ -2055,10 +2972,2628 @@ void dump_memory(Memory* memory)
         return;
     }
 
-    for(uint32_t i = 0; i < MEMORY_SIZE; ++i)
-        fwrite(&memory->data[i], sizeof(uint8_t), 1, file_ptr);
+    // untouched pages write out the zero page
+    for(uint32_t i = 0; i < MEMORY_SIZE >> MEMORY_PAGE_SHIFT; ++i)
+        fwrite(memory->pages[i], sizeof(uint8_t), MEMORY_PAGE_SIZE, file_ptr);
 
     fclose(file_ptr);
 
     printf("Memory sucessfully dumped to file: %s\n", filename);
 }
+
+
+/*==========================================
+  DOS program loader
+  A .COM image goes to 0x100 after a PSP, with all
+  segment registers zero so the flat memory model
+  of the simulator is the program's segment.
+  int 20h and the int 21h services below are enough
+  for console output, exit and reading local files.
+  Only what inst_exec executes can run, anything the
+  rest of the simulator skips (push / pop, call / ret,
+  inc / dec, the logic ops ...) stops the program
+  ========================================*/
+#define COM_LOAD_ADDRESS 0x100
+#define DOS_MAX_HANDLES  16
+#define DOS_MAX_PATH     128
+
+typedef struct Dos_State
+{
+    FILE* handles[DOS_MAX_HANDLES]; // 0 - 2 are the standard streams
+    uint8_t exit_code;
+    bool stopped;                   // on an error, not through int 20h / 4Ch
+} Dos_State;
+
+void read_com_file(Memory* memory, const char* file_path)
+{
+    // read_file sizes the buffer, the image is then moved up past the PSP
+    read_file(memory, file_path);
+    if (memory->bytes_used + COM_LOAD_ADDRESS > 0xFF00)
+    {
+        printf("ERROR - %s is too large for a .COM program\n", file_path);
+        exit(1);
+    }
+    uint8_t* image = (uint8_t*)malloc(memory->bytes_used);
+    memory_copy_out(memory, 0, image, memory->bytes_used);
+    memory_copy_in(memory, COM_LOAD_ADDRESS, image, memory->bytes_used);
+    for (uint32_t i = 0; i < COM_LOAD_ADDRESS; ++i)
+        memory_set_byte(memory, i, 0);
+    memory->bytes_used += COM_LOAD_ADDRESS;
+    free(image);
+
+    // Program Segment Prefix
+    memory_set_byte(memory, 0x00, 0xCD); // int 20h
+    memory_set_byte(memory, 0x01, 0x20);
+    memory_set_byte(memory, 0x02, 0x00); // first segment past the program
+    memory_set_byte(memory, 0x03, 0xA0);
+    memory_set_byte(memory, 0x80, 0x00); // empty command tail
+    memory_set_byte(memory, 0x81, 0x0D);
+}
+
+void dos_init(CP_units* exec)
+{
+    exec->dos = (Dos_State*)calloc(1, sizeof(Dos_State));
+    exec->dos->handles[0] = stdin;
+    exec->dos->handles[1] = stdout;
+    exec->dos->handles[2] = stderr;
+
+    exec->ip      = COM_LOAD_ADDRESS;
+    exec->reg[sp] = 0xFFFE;
+}
+
+void dos_destroy(CP_units* exec)
+{
+    for (uint32_t i = 3; i < DOS_MAX_HANDLES; ++i)
+        if (exec->dos->handles[i] != NULL)
+            fclose(exec->dos->handles[i]);
+
+    if (exec->dos->stopped)
+        printf("\nProgram stopped at ip %hu\n", exec->inst_ip);
+    else if (!exec->halted)
+        printf("\nProgram ran off the end of its image at ip %hu without int 20h or int 21h 4Ch\n", exec->ip);
+    else
+        printf("\nProgram exited with code %hhu\n", exec->dos->exit_code);
+    free(exec->dos);
+    exec->dos = NULL;
+}
+
+// stops a .COM program on an instruction that isn't executed, false for plain programs which skip it
+bool dos_unhandled(CP_units* exec, const Operation_Type op)
+{
+    if (exec->dos == NULL)
+        return false;
+    printf("ERROR - %s at ip %hu is not executed by the simulator\n", instruction_string(op), exec->inst_ip);
+    exec->dos->stopped = true;
+    exec->halted       = true;
+    return true;
+}
+
+static inline void dos_return(CP_units* exec, const bool error, const uint16_t value)
+{
+    exec->reg[ax] = value;
+    if (error)
+        exec->flags |= CARRY_FLAG;
+    else
+        exec->flags &= ~CARRY_FLAG;
+}
+
+void dos_interrupt(CP_units* exec, const uint8_t number)
+{
+    Dos_State* dos = exec->dos;
+    if (dos == NULL)
+    {
+        printf("ERROR - int %hhu without a DOS program loaded\n", number);
+        exec->halted = true;
+        return;
+    }
+
+    if (number == 0x20)
+    {
+        exec->halted = true;
+        return;
+    }
+    if (number != 0x21)
+    {
+        printf("ERROR - int %hhu has no stub\n", number);
+        dos->stopped = true;
+        exec->halted = true;
+        return;
+    }
+
+    Memory* memory     = exec->memory;
+    const uint8_t ah   = exec->reg[ax] >> 8;
+    const uint16_t bx_ = exec->reg[bx];
+    const uint16_t cx_ = exec->reg[cx];
+    const uint16_t dx_ = exec->reg[dx];
+
+    switch (ah)
+    {
+    case 0x02: // character output
+        fputc(dx_ & 0xFF, stdout);
+        exec->reg[ax] = (exec->reg[ax] & 0xFF00) | (dx_ & 0xFF);
+        break;
+    case 0x09: // '$' terminated string output
+    {
+        for (uint32_t i = dx_; i < 0x10000 && memory_byte(memory, i) != '$'; ++i)
+            fputc(memory_byte(memory, i), stdout);
+        exec->reg[ax] = (exec->reg[ax] & 0xFF00) | '$';
+        break;
+    }
+    case 0x3D: // open file, name at ds:dx
+    {
+        char name[DOS_MAX_PATH];
+        uint32_t length = 0;
+        while (length < DOS_MAX_PATH -1 && dx_ + length < 0x10000 && memory_byte(memory, dx_ + length) != 0)
+        {
+            name[length] = memory_byte(memory, dx_ + length);
+            ++length;
+        }
+        name[length] = '\0';
+        const uint8_t mode = exec->reg[ax] & 0b11;
+        uint32_t handle = 3;
+        while (handle < DOS_MAX_HANDLES && dos->handles[handle] != NULL)
+            ++handle;
+        if (handle == DOS_MAX_HANDLES)
+        {
+            dos_return(exec, true, 4); // too many open files
+            break;
+        }
+
+        dos->handles[handle] = fopen(name, mode == 0 ? "rb" : "r+b");
+        if (dos->handles[handle] == NULL)
+            dos_return(exec, true, 2); // file not found
+        else
+            dos_return(exec, false, handle);
+        break;
+    }
+    case 0x3E: // close
+        if (bx_ < 3 || bx_ >= DOS_MAX_HANDLES || dos->handles[bx_] == NULL)
+        {
+            dos_return(exec, true, 6); // invalid handle
+            break;
+        }
+        fclose(dos->handles[bx_]);
+        dos->handles[bx_] = NULL;
+        dos_return(exec, false, exec->reg[ax]);
+        break;
+    case 0x3F: // read cx bytes from bx into ds:dx
+    case 0x40: // write cx bytes from ds:dx to bx
+    {
+        if (bx_ >= DOS_MAX_HANDLES || dos->handles[bx_] == NULL)
+        {
+            dos_return(exec, true, 6);
+            break;
+        }
+        uint32_t count = cx_;
+        if (dx_ + count > 0x10000)
+            count = 0x10000 - dx_;
+
+        // staged so reads land through memory_write like any guest store
+        uint8_t buffer[0x10000];
+        size_t moved;
+        if (ah == 0x3F)
+        {
+            moved = fread(buffer, 1, count, dos->handles[bx_]);
+            for (uint32_t i = 0; i < moved; ++i)
+                memory_write(memory, dx_ + i, buffer[i], 1, exec->inst_ip);
+        }
+        else
+        {
+            memory_copy_out(memory, dx_, buffer, count);
+            moved = fwrite(buffer, 1, count, dos->handles[bx_]);
+        }
+        dos_return(exec, false, (uint16_t)moved);
+        break;
+    }
+    case 0x4C: // exit with al
+        dos->exit_code = exec->reg[ax] & 0xFF;
+        exec->halted   = true;
+        break;
+    default:
+        printf("ERROR - int 21h function %02hhxh has no stub\n", ah);
+        dos->stopped = true;
+        exec->halted = true;
+    }
+}
+
+/*==========================================
+  Micro-op IR
+  Each basic block is lowered once into a small
+  list of micro-ops, optimised and then cached by
+  its starting ip
+  ========================================*/
+
+typedef enum : uint8_t
+{
+    UOP_MOVE,   // register <- register / immediate
+    UOP_LOAD,   // register <- memory
+    UOP_STORE,  // memory   <- register / immediate
+    UOP_ALU,    // arithmetic, writes flags unless NO_FLAG_WRITE
+    UOP_STRING, // movs / stos / lods, value holds the string op, repeated when op is rep
+    UOP_BRANCH, // conditional jump / loop, always last in the block
+    UOP_DEAD    // removed by a pass, dropped on compaction
+} Micro_Op_Kind;
+
+typedef struct
+{
+    Micro_Op_Kind kind;
+    Operation_Type op;
+    Register_Location dest;
+    Register_Location src;
+    uint16_t value;
+    int16_t disp;
+    uint32_t flags;
+    uint16_t ip;
+    uint16_t next_ip;
+} Micro_Op;
+
+#define MAX_BLOCK_OPS 64
+
+// register operands of a fused alu resolved once when it is fused, at_reg is a switch per call
+typedef struct
+{
+    uint16_t dest_mask;
+    uint8_t dest;
+    uint8_t dest_shift;
+    uint8_t src;        // unused from an immediate
+    uint8_t src_shift;
+} Fused_Operands;
+
+typedef struct Micro_Block
+{
+    uint16_t start_ip;
+    uint16_t end_ip;
+    uint16_t inst_count;    // guest instructions in the block
+    uint16_t lowered_count; // micro-ops before the passes
+    uint16_t op_count;
+    uint16_t lowered_flag_writes;
+    uint16_t flag_writes;
+    bool flags_live_taken;       // flags read first by the branch target
+    bool flags_live_fallthrough; // flags read first by the next block
+    uint64_t exec_count;
+    uint32_t clocks;       // estimated clocks leaving through the fallthrough, rep repetitions excluded
+    uint32_t clocks_taken; // the same when the closing branch is taken
+    Micro_Op ops[MAX_BLOCK_OPS];
+    uint8_t fuse[MAX_BLOCK_OPS];     // superinstruction starting at the op, see Fuse_Pattern
+    uint8_t fuse_len[MAX_BLOCK_OPS]; // micro-ops covered by it
+    Fused_Operands fuse_operands[MAX_BLOCK_OPS];
+} Micro_Block;
+
+static inline bool location_is_memory(const Register_Location location)
+{
+    return (location >= BX_SI && location <= DIRECT_ADDRESS_LOCATION);
+}
+
+void micro_block_record(Micro_Block* block, const Register_Location dest, const Register_Location src, const uint16_t value, const int16_t disp, const uint32_t flags, const Operation_Type op, const uint16_t ip, const uint16_t next_ip)
+{
+    assert(block->op_count < MAX_BLOCK_OPS && "ERROR - micro block overflow\n");
+
+    Micro_Op* uop = &block->ops[block->op_count++];
+    uop->op      = op;
+    uop->dest    = dest;
+    uop->src     = src;
+    uop->value   = value;
+    uop->disp    = disp;
+    uop->flags   = flags;
+    uop->ip      = ip;
+    uop->next_ip = next_ip;
+
+    if ((op >= Op_je && op <= Op_jcxz) || op == Op_jmp || op == Op_int)
+        uop->kind = UOP_BRANCH;
+    else if (op >= Op_rep && op <= Op_scas)
+        uop->kind = UOP_STRING;
+    else if (op != Op_mov)
+        uop->kind = UOP_ALU;
+    else if (location_is_memory(dest))
+        uop->kind = UOP_STORE;
+    else if (location_is_memory(src))
+        uop->kind = UOP_LOAD;
+    else
+        uop->kind = UOP_MOVE;
+}
+
+// registers read to form an effective address
+static uint16_t effective_address_reg_mask(const Register_Location location)
+{
+    switch (location)
+    {
+    case BX_SI:
+        return (1<<bx) | (1<<si);
+    case BX_DI:
+        return (1<<bx) | (1<<di);
+    case BP_SI:
+        return (1<<bp) | (1<<si);
+    case BP_DI:
+        return (1<<bp) | (1<<di);
+    case SI_:
+        return (1<<si);
+    case DI_:
+        return (1<<di);
+    case BP_:
+        return (1<<bp);
+    case BX_:
+        return (1<<bx);
+    default:
+        return 0;
+    }
+}
+
+static uint16_t location_reg_mask(const Register_Location location)
+{
+    if (location_is_memory(location))
+        return effective_address_reg_mask(location);
+
+    uint8_t r = at_reg(location, NULL, NULL);
+    return r == 255 ? 0 : (1<<r);
+}
+
+static inline bool location_is_partial(const Register_Location location)
+{
+    uint16_t bitmask = 0xFFFF;
+    at_reg(location, &bitmask, NULL);
+    return bitmask != 0xFFFF;
+}
+
+static inline bool uop_writes_flags(const Micro_Op* uop)
+{
+    return uop->kind == UOP_ALU && !(uop->flags & NO_FLAG_WRITE) &&
+           (uop->op == Op_add || uop->op == Op_sub || uop->op == Op_cmp);
+}
+
+static inline bool uop_reads_flags(const Micro_Op* uop)
+{
+    return uop->kind == UOP_BRANCH && uop->op != Op_loop && uop->op != Op_jcxz && uop->op != Op_jmp;
+}
+
+// registers read and registers completely overwritten, partial writes count as a read
+static void uop_reg_effects(const Micro_Op* uop, uint16_t* reads, uint16_t* writes)
+{
+    *reads  = 0;
+    *writes = 0;
+
+    switch (uop->kind)
+    {
+    case UOP_MOVE:
+    case UOP_LOAD:
+        *reads |= location_reg_mask(uop->src);
+        if (location_is_partial(uop->dest))
+            *reads  |= location_reg_mask(uop->dest);
+        else
+            *writes |= location_reg_mask(uop->dest);
+        break;
+    case UOP_STORE:
+    case UOP_ALU:
+        *reads |= location_reg_mask(uop->dest) | location_reg_mask(uop->src);
+        break;
+    case UOP_BRANCH:
+        if (uop->op >= Op_loop && uop->op <= Op_jcxz)
+            *reads |= (1<<cx);
+        else if (uop->op == Op_int)
+            *reads |= 0x0FFF; // the service reads whatever registers it needs
+        break;
+    case UOP_STRING:
+        *reads |= (1<<cx) | (1<<si) | (1<<di) | (1<<ax);
+        break;
+    case UOP_DEAD:
+        break;
+    }
+}
+
+// registers changed in any way
+static uint16_t uop_reg_modified(const Micro_Op* uop)
+{
+    switch (uop->kind)
+    {
+    case UOP_MOVE:
+    case UOP_LOAD:
+        return location_reg_mask(uop->dest);
+    case UOP_ALU:
+        return (uop->op == Op_cmp || location_is_memory(uop->dest)) ? 0 : location_reg_mask(uop->dest);
+    case UOP_STRING:
+        return (1<<cx) | (1<<si) | (1<<di) | (uop->value == _lods ? (1<<ax) : 0);
+    case UOP_BRANCH:
+        if (uop->op == Op_int)
+            return (1<<ax);
+        return (uop->op >= Op_loop && uop->op <= Op_loopnz) ? (1<<cx) : 0;
+    default:
+        return 0;
+    }
+}
+
+/* Replaces register sources holding a value known inside the block with the immediate */
+void pass_constant_propagation(Micro_Block* block)
+{
+    uint16_t known_mask[12] = {0};
+    uint16_t known_val[12]  = {0};
+
+    for (uint16_t i = 0; i < block->op_count; ++i)
+    {
+        Micro_Op* uop = &block->ops[i];
+
+        if ((uop->kind == UOP_MOVE || uop->kind == UOP_STORE || uop->kind == UOP_ALU) &&
+                (uop->flags & FROM_REGISTER) && !location_is_memory(uop->src))
+        {
+            uint8_t s_shift = 0;
+            uint8_t r_src   = at_reg(uop->src, NULL, &s_shift);
+            if (r_src != 255 && known_mask[r_src] == 0xFFFF)
+            {
+                uop->value  = known_val[r_src] >> s_shift;
+                uop->src    = NO_LOCATION;
+                uop->flags  = (uop->flags & ~FROM_REGISTER) | FROM_IMMEDIATE;
+            }
+        }
+
+        if (uop->kind == UOP_MOVE && (uop->flags & FROM_IMMEDIATE))
+        {
+            uint8_t bit_shift = 0;
+            uint16_t bitmask  = 0xFFFF;
+            uint8_t r_dest    = at_reg(uop->dest, &bitmask, &bit_shift);
+            if (r_dest != 255)
+            {
+                known_val[r_dest]   = (known_val[r_dest] & ~bitmask) | (bitmask & (uop->value << bit_shift));
+                known_mask[r_dest] |= bitmask;
+            }
+            continue;
+        }
+
+        // anything else that writes a register makes it unknown
+        uint16_t modified = uop_reg_modified(uop);
+        for (uint8_t r = 0; r < array_count(known_mask); ++r)
+            if (modified & (1<<r))
+                known_mask[r] = 0;
+    }
+}
+
+/* Forwards register to register moves to later readers and drops moves whose result is never read */
+void pass_coalesce_moves(Micro_Block* block)
+{
+    Register_Location alias[12];
+    for (uint8_t r = 0; r < array_count(alias); ++r)
+        alias[r] = NO_LOCATION;
+
+    for (uint16_t i = 0; i < block->op_count; ++i)
+    {
+        Micro_Op* uop = &block->ops[i];
+
+        // only whole word reads are forwarded
+        if ((uop->flags & FROM_REGISTER) && uop->kind != UOP_LOAD && !location_is_memory(uop->src) && !location_is_partial(uop->src))
+        {
+            uint8_t r_src = at_reg(uop->src, NULL, NULL);
+            if (r_src != 255 && alias[r_src] != NO_LOCATION)
+                uop->src = alias[r_src];
+        }
+
+        uint16_t changed = uop_reg_modified(uop);
+        for (uint8_t r = 0; r < array_count(alias); ++r)
+            if ((changed & (1<<r)) || (alias[r] != NO_LOCATION && (changed & location_reg_mask(alias[r]))))
+                alias[r] = NO_LOCATION;
+
+        if (uop->kind == UOP_MOVE && (uop->flags & FROM_REGISTER) && !location_is_partial(uop->dest) && !location_is_partial(uop->src))
+        {
+            uint8_t r_dest = at_reg(uop->dest, NULL, NULL);
+            uint8_t r_src  = at_reg(uop->src, NULL, NULL);
+            if (r_dest == r_src)
+                uop->kind = UOP_DEAD;
+            else if (r_dest != 255 && r_src != 255)
+                alias[r_dest] = uop->src;
+        }
+    }
+
+    // every register is live when leaving the block
+    uint16_t live = 0x0FFF;
+    for (int32_t i = block->op_count -1; i >= 0; --i)
+    {
+        Micro_Op* uop = &block->ops[i];
+        if (uop->kind == UOP_DEAD)
+            continue;
+
+        uint16_t reads, writes;
+        uop_reg_effects(uop, &reads, &writes);
+        if ((uop->kind == UOP_MOVE || uop->kind == UOP_LOAD) && writes && !(live & writes))
+        {
+            uop->kind = UOP_DEAD;
+            continue;
+        }
+        live &= ~writes;
+        live |= reads;
+    }
+}
+
+/* Flag results overwritten before anything reads them are never computed */
+void pass_dead_flag_elimination(Micro_Block* block, bool live_out)
+{
+    bool live = live_out;
+    for (int32_t i = block->op_count -1; i >= 0; --i)
+    {
+        Micro_Op* uop = &block->ops[i];
+        if (uop_writes_flags(uop))
+        {
+            if (!live)
+            {
+                // a compare without its flags does nothing
+                if (uop->op == Op_cmp)
+                    uop->kind = UOP_DEAD;
+                uop->flags |= NO_FLAG_WRITE;
+            }
+            live = false;
+        }
+        if (uop_reads_flags(uop))
+            live = true;
+    }
+}
+
+void micro_block_compact(Micro_Block* block)
+{
+    uint16_t count = 0;
+    for (uint16_t i = 0; i < block->op_count; ++i)
+        if (block->ops[i].kind != UOP_DEAD)
+            block->ops[count++] = block->ops[i];
+    block->op_count = count;
+}
+
+static uint16_t micro_block_flag_writes(const Micro_Block* block)
+{
+    uint16_t count = 0;
+    for (uint16_t i = 0; i < block->op_count; ++i)
+        if (uop_writes_flags(&block->ops[i]))
+            ++count;
+    return count;
+}
+
+// inst_limit of 0 lowers up to the closing branch
+void micro_block_lower(Memory* memory, Decode_Unit* d_unit, CP_units* exec, Micro_Block* block, const uint16_t ip, const uint16_t inst_limit)
+{
+    PROFILE_FUNCTION;
+    memset(block, 0, sizeof(Micro_Block));
+    block->start_ip = ip;
+
+    // decoding with record set lowers instead of executing
+    const uint16_t saved_ip = exec->ip;
+    exec->ip     = ip;
+    exec->record = block;
+    while (exec->ip < memory->bytes_used && block->op_count < MAX_BLOCK_OPS)
+    {
+        decode_instruction(memory, d_unit, exec->ip, op_code_lookup(memory_byte(memory, exec->ip)), exec);
+        ++block->inst_count;
+
+        if (block->op_count > 0 && block->ops[block->op_count -1].kind == UOP_BRANCH)
+            break;
+        if (block->inst_count == inst_limit)
+            break;
+    }
+    exec->record = NULL;
+
+    block->end_ip              = exec->ip;
+    block->lowered_count       = block->op_count;
+    block->lowered_flag_writes = micro_block_flag_writes(block);
+    exec->ip                   = saved_ip;
+}
+
+// whether the block starting at ip can read the flags before writing them
+static bool flags_live_in(Memory* memory, Decode_Unit* d_unit, CP_units* exec, const uint16_t ip)
+{
+    // the final state is printed, and data after an exit is not lowered
+    if (ip >= memory->bytes_used || op_code_find(memory_byte(memory, ip)) == -1)
+        return true;
+
+    Micro_Block successor;
+    micro_block_lower(memory, d_unit, exec, &successor, ip, 0);
+    for (uint16_t i = 0; i < successor.op_count; ++i)
+    {
+        if (uop_reads_flags(&successor.ops[i]))
+            return true;
+        if (uop_writes_flags(&successor.ops[i]))
+            return false;
+    }
+    return true;
+}
+
+Micro_Block* micro_block_build(Memory* memory, Decode_Unit* d_unit, CP_units* exec, Arena* arena, const uint16_t inst_limit)
+{
+    Micro_Block* block = (Micro_Block*)arena_alloc(arena, sizeof(Micro_Block), NULL);
+    micro_block_lower(memory, d_unit, exec, block, exec->ip, inst_limit);
+
+    // flags leaving the block are live if either successor reads them first
+    Micro_Op* branch = (block->op_count > 0 && block->ops[block->op_count -1].kind == UOP_BRANCH) ? &block->ops[block->op_count -1] : NULL;
+    block->flags_live_fallthrough = false;
+    block->flags_live_taken       = false;
+    if (branch == NULL || branch->op != Op_jmp)
+        block->flags_live_fallthrough = flags_live_in(memory, d_unit, exec, block->end_ip);
+    if (branch != NULL)
+    {
+        if (branch->op == Op_jmp)
+            block->flags_live_taken = flags_live_in(memory, d_unit, exec, (uint16_t)(block->end_ip + (int16_t)branch->value));
+        else if (branch->op == Op_int)
+            block->flags_live_taken = true; // the service may leave through carry
+        else
+            block->flags_live_taken = flags_live_in(memory, d_unit, exec, (uint16_t)(block->end_ip + (int8_t)branch->value));
+    }
+
+    pass_constant_propagation(block);
+    pass_coalesce_moves(block);
+    pass_dead_flag_elimination(block, block->flags_live_fallthrough || block->flags_live_taken);
+    micro_block_compact(block);
+    block->flag_writes = micro_block_flag_writes(block);
+
+    return block;
+}
+
+typedef enum : uint8_t
+{
+    FUSE_NONE,
+    FUSE_ALU_BRANCH, // sub / cmp / add reg + je / jne / jb, branch decided from the result
+    FUSE_ALU_LOOP,   // add / sub reg + loop
+    FUSE_STORE_RUN,  // mov [ea + n], reg / imm runs sharing one address calculation
+    FUSE_PATTERN_COUNT
+} Fuse_Pattern;
+
+static inline void micro_block_exec_fused(CP_units* exec, Micro_Block* block, uint16_t* index);
+
+static inline void micro_block_exec(CP_units* exec, Micro_Block* block)
+{
+    // only the closing branch reads ip
+    exec->ip = block->end_ip;
+    for (uint16_t i = 0; i < block->op_count; ++i)
+    {
+        if (block->fuse[i] != FUSE_NONE)
+        {
+            micro_block_exec_fused(exec, block, &i);
+            continue;
+        }
+        Micro_Op* uop = &block->ops[i];
+        exec->inst_ip = uop->ip;
+        inst_exec(exec, uop->dest, uop->src, uop->value, uop->disp, uop->flags, uop->op);
+    }
+    ++block->exec_count;
+    exec->instruction_count += block->inst_count;
+    exec->clocks            += (exec->ip != block->end_ip) ? block->clocks_taken : block->clocks;
+}
+
+typedef struct
+{
+    Arena* arena;
+    Micro_Block** cache; // indexed by block start ip
+    uint32_t block_count;
+    uint64_t inst_count;
+    uint64_t lowered_count;
+    uint64_t op_count;
+    uint64_t lowered_flags;
+    uint64_t flag_writes;
+    uint16_t block_inst_limit; // 0 for whole basic blocks, 1 runs every instruction as its own block
+} Micro_Engine;
+
+Micro_Engine* micro_engine_init()
+{
+    Micro_Engine* engine = (Micro_Engine*)malloc(sizeof(Micro_Engine));
+    memset(engine, 0, sizeof(Micro_Engine));
+    engine->arena = arena_init(ARENA_BLOCK_SIZE, 8);
+    engine->cache = (Micro_Block**)calloc(0x10000, sizeof(Micro_Block*));
+    return engine;
+}
+
+void micro_engine_destroy(Micro_Engine* engine)
+{
+    free(engine->cache);
+    arena_destroy(engine->arena);
+    free(engine);
+}
+
+// runs the block at exec->ip, built on first use
+Micro_Block* micro_engine_step(Micro_Engine* engine, Memory* memory, Decode_Unit* d_unit, CP_units* exec)
+{
+    Micro_Block* block = engine->cache[exec->ip];
+    if (block == NULL)
+    {
+        block                          = micro_block_build(memory, d_unit, exec, engine->arena, engine->block_inst_limit);
+        engine->cache[block->start_ip] = block;
+        ++engine->block_count;
+    }
+
+    micro_block_exec(exec, block);
+
+    engine->inst_count    += block->inst_count;
+    engine->lowered_count += block->lowered_count;
+    engine->op_count      += block->op_count;
+    engine->lowered_flags += block->lowered_flag_writes;
+    engine->flag_writes   += block->flag_writes;
+    return block;
+}
+
+void micro_engine_run(Micro_Engine* engine, Memory* memory, Decode_Unit* d_unit, CP_units* exec)
+{
+    PROFILE_FUNCTION;
+    while (exec->ip < memory->bytes_used && !exec->halted)
+    {
+        micro_engine_step(engine, memory, d_unit, exec);
+        if (exec->checkpoint_at != 0 && exec->instruction_count >= exec->checkpoint_at)
+            checkpoint_save(exec, d_unit);
+    }
+}
+
+const char* micro_op_kind_string(Micro_Op_Kind kind)
+{
+    switch (kind)
+    {
+    case UOP_MOVE:
+        return "move";
+    case UOP_LOAD:
+        return "load";
+    case UOP_STORE:
+        return "store";
+    case UOP_ALU:
+        return "alu";
+    case UOP_STRING:
+        return "string";
+    case UOP_BRANCH:
+        return "branch";
+    case UOP_DEAD:
+        return "dead";
+    default:
+        assert(0 && "ERROR - failed to get micro_op_kind_string\n");
+    }
+}
+
+void location_string(const Register_Location location, const int16_t disp, char* buf)
+{
+    if (location == NO_LOCATION)
+        snprintf(buf, MAX_SIZE_OF_OPPERANT, "-");
+    else if (location == DIRECT_ADDRESS_LOCATION)
+        snprintf(buf, MAX_SIZE_OF_OPPERANT, "[%hu]", (uint16_t)disp);
+    else if (location_is_memory(location))
+        snprintf(buf, MAX_SIZE_OF_OPPERANT, "[%s + %hd]", effective_addresses[location >> 12], disp);
+    else if ((location & 0xFFF0) == 0xFFF0)
+        snprintf(buf, MAX_SIZE_OF_OPPERANT, "%s", word_registers[location & 0x000F]);
+    else if ((location & 0xFF0F) == 0xFF0F)
+        snprintf(buf, MAX_SIZE_OF_OPPERANT, "%s", byte_registers[(location >> 4) & 0x000F]);
+    else
+        snprintf(buf, MAX_SIZE_OF_OPPERANT, "%s", segment_registers[(location >> 8) & 0x000F]);
+}
+
+void print_micro_block(Micro_Block* block)
+{
+    printf("block [%hu, %hu) %hu instructions, %hu -> %hu micro-ops, %hu -> %hu flag writes\n",
+           block->start_ip, block->end_ip, block->inst_count, block->lowered_count, block->op_count,
+           block->lowered_flag_writes, block->flag_writes);
+
+    for (uint16_t i = 0; i < block->op_count; ++i)
+    {
+        Micro_Op* uop = &block->ops[i];
+        if (uop->kind == UOP_BRANCH)
+        {
+            printf("\t%-6s %s %hd\n", micro_op_kind_string(uop->kind), instruction_string(uop->op),
+                   uop->op == Op_jmp ? (int16_t)uop->value : (int16_t)(int8_t)uop->value);
+            continue;
+        }
+        if (uop->kind == UOP_STRING)
+        {
+            printf("\t%-6s %s%s%c\n", micro_op_kind_string(uop->kind), uop->op == Op_rep ? "rep " : "",
+                   string_manpi[string_op_index((uint8_t)uop->value)], (uop->flags & WORD_OPPERATION) ? 'w' : 'b');
+            continue;
+        }
+
+        char dest[MAX_SIZE_OF_OPPERANT];
+        char src[MAX_SIZE_OF_OPPERANT];
+        location_string(uop->dest, uop->disp, dest);
+        if (uop->flags & FROM_IMMEDIATE)
+            snprintf(src, MAX_SIZE_OF_OPPERANT, "%hu", uop->value);
+        else
+            location_string(uop->src, uop->disp, src);
+
+        printf("\t%-6s %s %s, %s%s\n", micro_op_kind_string(uop->kind), instruction_string(uop->op), dest, src,
+               uop_writes_flags(uop) ? "  ; flags" : "");
+    }
+}
+
+void print_micro_engine(Micro_Engine* engine)
+{
+    printf("\nMicro-op blocks\n");
+    for (uint32_t i = 0; i < 0x10000; ++i)
+        if (engine->cache[i] != NULL)
+            print_micro_block(engine->cache[i]);
+
+    printf("\nBlocks built: %u\nGuest instructions: %lu\nMicro-ops executed: %lu (%lu before passes)\nFlag writes: %lu (%lu before passes)\n",
+           engine->block_count, engine->inst_count, engine->op_count, engine->lowered_count, engine->flag_writes, engine->lowered_flags);
+}
+
+void micro_op_execute_stream(Memory* memory, Decode_Unit* d_unit, CP_units* exec)
+{
+    Micro_Engine* engine = micro_engine_init();
+    micro_engine_run(engine, memory, d_unit, exec);
+    print_micro_engine(engine);
+    micro_engine_destroy(engine);
+}
+
+
+/*==========================================
+  Superinstructions
+  Adjacent micro-ops forming common guest idioms
+  run as one handler. Only sites executed often
+  in a training run get fused
+  ========================================*/
+#define FUSE_MIN_EXEC_COUNT 64
+#define FUSE_TIMING_RUNS    16
+
+const char* fuse_pattern_string(Fuse_Pattern pattern)
+{
+    switch (pattern)
+    {
+    case FUSE_NONE:
+        return "none";
+    case FUSE_ALU_BRANCH:
+        return "alu + jcc";
+    case FUSE_ALU_LOOP:
+        return "alu + loop";
+    case FUSE_STORE_RUN:
+        return "store run";
+    default:
+        assert(0 && "ERROR - failed to get fuse_pattern_string\n");
+    }
+}
+
+static inline bool uop_is_reg_alu(const Micro_Op* uop)
+{
+    return uop->kind == UOP_ALU && (uop->op == Op_add || uop->op == Op_sub || uop->op == Op_cmp) &&
+           !location_is_memory(uop->dest) && at_reg(uop->dest, NULL, NULL) != 255 &&
+           ((uop->flags & FROM_IMMEDIATE) || ((uop->flags & FROM_REGISTER) && at_reg(uop->src, NULL, NULL) != 255));
+}
+
+static inline bool uop_is_run_store(const Micro_Op* uop, const Register_Location dest)
+{
+    return uop->kind == UOP_STORE && uop->dest == dest && dest != DIRECT_ADDRESS_LOCATION &&
+           ((uop->flags & FROM_IMMEDIATE) || ((uop->flags & FROM_REGISTER) && at_reg(uop->src, NULL, NULL) != 255));
+}
+
+// superinstruction that could start at ops[i], the length is written to len
+Fuse_Pattern fuse_candidate(const Micro_Block* block, const uint16_t i, uint8_t* len)
+{
+    const Micro_Op* uop = &block->ops[i];
+
+    if (uop_is_run_store(uop, uop->dest))
+    {
+        uint16_t end = i +1;
+        while (end < block->op_count && end - i < 255 && uop_is_run_store(&block->ops[end], uop->dest))
+            ++end;
+        if (end - i >= 2)
+        {
+            *len = (uint8_t)(end - i);
+            return FUSE_STORE_RUN;
+        }
+    }
+
+    if (i +1 < block->op_count && uop_is_reg_alu(uop))
+    {
+        const Micro_Op* next = &block->ops[i +1];
+        *len = 2;
+        if (next->kind == UOP_BRANCH && (next->op == Op_je || next->op == Op_jne || next->op == Op_jb))
+            return FUSE_ALU_BRANCH;
+        if (next->kind == UOP_BRANCH && next->op == Op_loop && uop->op != Op_cmp)
+            return FUSE_ALU_LOOP;
+    }
+    return FUSE_NONE;
+}
+
+// fuses the sites of the patterns in pattern_mask executed at least FUSE_MIN_EXEC_COUNT times
+void micro_block_fuse(Micro_Block* block, const uint32_t pattern_mask)
+{
+    memset(block->fuse, FUSE_NONE, sizeof(block->fuse));
+    memset(block->fuse_len, 0, sizeof(block->fuse_len));
+    if (block->exec_count < FUSE_MIN_EXEC_COUNT)
+        return;
+
+    for (uint16_t i = 0; i < block->op_count; ++i)
+    {
+        uint8_t len          = 0;
+        Fuse_Pattern pattern = fuse_candidate(block, i, &len);
+        if (pattern != FUSE_NONE && (pattern_mask & (1<<pattern)))
+        {
+            block->fuse[i]     = pattern;
+            block->fuse_len[i] = len;
+            if (pattern == FUSE_ALU_BRANCH || pattern == FUSE_ALU_LOOP)
+            {
+                Fused_Operands* operands = &block->fuse_operands[i];
+                const Micro_Op* alu      = &block->ops[i];
+                operands->dest_mask      = 0xFFFF;
+                operands->dest_shift     = 0;
+                operands->src_shift      = 0;
+                operands->dest           = at_reg(alu->dest, &operands->dest_mask, &operands->dest_shift);
+                operands->src            = (alu->flags & FROM_IMMEDIATE) ? 0 : at_reg(alu->src, NULL, &operands->src_shift);
+            }
+            i += len -1;
+        }
+    }
+}
+
+// mirrors the add / sub / cmp paths of inst_exec
+static inline uint16_t fused_alu(CP_units* exec, const Micro_Op* uop, const Fused_Operands* operands, uint16_t* before,
+                                 uint16_t* amount)
+{
+    *before = exec->reg[operands->dest] >> operands->dest_shift;
+    *amount = (uop->flags & FROM_IMMEDIATE) ? uop->value : exec->reg[operands->src] >> operands->src_shift;
+
+    uint16_t result = (uop->op == Op_add) ? *before + *amount : *before - *amount;
+    if (uop->op != Op_cmp)
+        exec->reg[operands->dest] = (exec->reg[operands->dest] & ~operands->dest_mask) |
+                                    (operands->dest_mask & (result << operands->dest_shift));
+    return result;
+}
+
+static inline void micro_block_exec_fused(CP_units* exec, Micro_Block* block, uint16_t* index)
+{
+    const uint16_t i = *index;
+    *index += block->fuse_len[i] -1;
+
+    switch (block->fuse[i])
+    {
+    case FUSE_ALU_BRANCH:
+    {
+        const Micro_Op* alu    = &block->ops[i];
+        const Micro_Op* branch = &block->ops[i +1];
+        uint16_t before, amount;
+        uint16_t result = fused_alu(exec, alu, &block->fuse_operands[i], &before, &amount);
+
+        // same conditions arithmetic_set_flags would leave for the jump
+        bool taken;
+        if (branch->op == Op_je)
+            taken = (int16_t)result == 0;
+        else if (branch->op == Op_jne)
+            taken = (int16_t)result != 0;
+        else if (alu->op == Op_add)
+            taken = (int16_t)result < (int16_t)before;
+        else
+            taken = (int16_t)amount > (int16_t)before;
+
+        // flags only materialised when the path taken reads them
+        if (taken ? block->flags_live_taken : block->flags_live_fallthrough)
+            arithmetic_set_flags(exec, result, before, amount, alu->op);
+        if (taken)
+            exec->ip += (int8_t)branch->value;
+        break;
+    }
+    case FUSE_ALU_LOOP:
+    {
+        const Micro_Op* alu    = &block->ops[i];
+        const Micro_Op* branch = &block->ops[i +1];
+        uint16_t before, amount;
+        uint16_t result = fused_alu(exec, alu, &block->fuse_operands[i], &before, &amount);
+
+        if (!(alu->flags & NO_FLAG_WRITE))
+            arithmetic_set_flags(exec, result, before, amount, alu->op);
+        if (--exec->reg[cx] != 0)
+            exec->ip += (int8_t)branch->value;
+        break;
+    }
+    case FUSE_STORE_RUN:
+    {
+        // stores do not change registers so the base is computed once
+        const uint16_t base = effective_address_calculation(exec, block->ops[i].dest, 0);
+        for (uint16_t k = i; k < i + block->fuse_len[i]; ++k)
+        {
+            const Micro_Op* uop = &block->ops[k];
+            uint16_t value      = uop->value;
+            if (uop->flags & FROM_REGISTER)
+            {
+                uint8_t s_shift = 0;
+                uint8_t r_src   = at_reg(uop->src, NULL, &s_shift);
+                value           = exec->reg[r_src] >> s_shift;
+            }
+
+            const uint16_t memory_index = base + (uop->disp == -1 ? 0 : uop->disp);
+            memory_write(exec->memory, memory_index, value, (uop->flags & WORD_OPPERATION) ? 2 : 1, uop->ip);
+        }
+        break;
+    }
+    default:
+        assert(0 && "ERROR - unknown superinstruction\n");
+    }
+}
+
+static void micro_engine_fuse(Micro_Engine* engine, const uint32_t pattern_mask)
+{
+    for (uint32_t ip = 0; ip < 0x10000; ++ip)
+        if (engine->cache[ip] != NULL)
+            micro_block_fuse(engine->cache[ip], pattern_mask);
+}
+
+// one run from the saved start state in nanoseconds
+static uint64_t micro_engine_time(Micro_Engine* engine, Memory* memory, Decode_Unit* d_unit, CP_units* exec,
+                                  const CP_units* start_state, const Memory* start_memory)
+{
+    memory_copy(memory, start_memory);
+    memcpy(exec, start_state, sizeof(CP_units));
+
+    Timer timer;
+    start_timer(&timer);
+    micro_engine_run(engine, memory, d_unit, exec);
+    end_timer(&timer);
+    return timer_nano(&timer);
+}
+
+// fastest of FUSE_TIMING_RUNS without and with the patterns in pattern_mask. The two alternate run by run,
+// timed one after the other the first gets the colder caches and the fused side looked faster or slower
+// than it is. The machine is left in the state of the last fused run
+static void micro_engine_time_fused(Micro_Engine* engine, Memory* memory, Decode_Unit* d_unit, CP_units* exec,
+                                    const CP_units* start_state, const Memory* start_memory, const uint32_t pattern_mask,
+                                    uint64_t* plain, uint64_t* fused)
+{
+    *plain = UINT64_MAX;
+    *fused = UINT64_MAX;
+    for (uint32_t run = 0; run < FUSE_TIMING_RUNS; ++run)
+    {
+        micro_engine_fuse(engine, 0);
+        uint64_t time = micro_engine_time(engine, memory, d_unit, exec, start_state, start_memory);
+        if (time < *plain)
+            *plain = time;
+
+        micro_engine_fuse(engine, pattern_mask);
+        time = micro_engine_time(engine, memory, d_unit, exec, start_state, start_memory);
+        if (time < *fused)
+            *fused = time;
+    }
+}
+
+void superinstruction_execute_stream(Memory* memory, Decode_Unit* d_unit, CP_units* exec)
+{
+    CP_units start_state;
+    memcpy(&start_state, exec, sizeof(CP_units));
+    Memory start_memory;
+    memory_clone(&start_memory, memory);
+
+    // training run, fills the block cache and the per block execution counts
+    Micro_Engine* engine = micro_engine_init();
+    micro_engine_run(engine, memory, d_unit, exec);
+
+    uint32_t site_count[FUSE_PATTERN_COUNT] = {0};
+    uint64_t dyn_count[FUSE_PATTERN_COUNT]  = {0};
+    for (uint32_t ip = 0; ip < 0x10000; ++ip)
+    {
+        Micro_Block* block = engine->cache[ip];
+        if (block == NULL || block->exec_count < FUSE_MIN_EXEC_COUNT)
+            continue;
+        for (uint16_t i = 0; i < block->op_count; ++i)
+        {
+            uint8_t len          = 0;
+            Fuse_Pattern pattern = fuse_candidate(block, i, &len);
+            if (pattern == FUSE_NONE)
+                continue;
+            ++site_count[pattern];
+            dyn_count[pattern] += block->exec_count;
+            i += len -1;
+        }
+    }
+
+    printf("\nTraining run: %lu guest instructions in %u blocks\n", engine->inst_count, engine->block_count);
+    printf("%-12s %8s %12s %12s %12s %9s\n", "pattern", "sites", "executions", "plain (ns)", "fused (ns)", "speedup");
+
+    // only the patterns that were faster here are fused together at the end
+    uint32_t paying = 0;
+    for (uint32_t pattern = FUSE_NONE +1; pattern < FUSE_PATTERN_COUNT; ++pattern)
+    {
+        uint64_t plain, fused;
+        micro_engine_time_fused(engine, memory, d_unit, exec, &start_state, &start_memory, 1<<pattern, &plain, &fused);
+        printf("%-12s %8u %12lu %12lu %12lu %8.3fx\n", fuse_pattern_string(pattern), site_count[pattern], dyn_count[pattern],
+               plain, fused, (double)plain / (double)fused);
+        if (site_count[pattern] > 0 && fused < plain)
+            paying |= 1<<pattern;
+    }
+
+    // the machine is left in the state of the fused run
+    uint64_t plain, fused;
+    micro_engine_time_fused(engine, memory, d_unit, exec, &start_state, &start_memory, paying, &plain, &fused);
+    printf("%-12s %8s %12s %12lu %12lu %8.3fx ", "kept", "-", "-", plain, fused, (double)plain / (double)fused);
+    const char* separator = " ";
+    for (uint32_t pattern = FUSE_NONE +1; pattern < FUSE_PATTERN_COUNT; ++pattern)
+        if (paying & (1<<pattern))
+        {
+            printf("%s%s", separator, fuse_pattern_string(pattern));
+            separator = ", ";
+        }
+    printf("\n");
+
+    free_memory(&start_memory);
+    micro_engine_destroy(engine);
+}
+
+
+/*==========================================
+  Instruction timing
+  Clocks from the 8086 user manual tables, the
+  odd address word transfer penalty and per bit
+  shift costs are not counted. The repetitions
+  of a rep are added by the string op as it runs
+  ========================================*/
+
+uint32_t effective_address_clocks(const int32_t mod, const int32_t rm)
+{
+    if (mod == FIELD_NOT_SET || mod == REGISTER_MODE)
+        return 0;
+    if (mod == NO_DISPLACEMENT && rm == 0b110)
+        return 6; // direct address
+
+    switch (rm)
+    {
+    case 0b100: // si
+    case 0b101: // di
+    case 0b110: // bp
+    case 0b111: // bx
+        return mod == NO_DISPLACEMENT ? 5 : 9;
+    case 0b000: // bx + si
+    case 0b011: // bp + di
+        return mod == NO_DISPLACEMENT ? 7 : 11;
+    default:    // bx + di, bp + si
+        return mod == NO_DISPLACEMENT ? 8 : 12;
+    }
+}
+
+#define REP_BASE_CLOCKS 9
+
+// cost of one repetition under rep
+uint32_t string_op_repeat_clocks(const uint8_t string_op)
+{
+    switch (string_op)
+    {
+    case _movs:
+        return 17;
+    case _cmps:
+        return 22;
+    case _stds:
+        return 10;
+    case _lods:
+        return 13;
+    case _scas:
+        return 15;
+    default:
+        return 0;
+    }
+}
+
+// a rep counts the base and a single repetition
+static uint32_t string_op_clocks(Instruction_Code* inst)
+{
+    if (inst->type == Op_rep)
+        return REP_BASE_CLOCKS + string_op_repeat_clocks(inst->field[2].value);
+
+    switch ((uint8_t)ffetch(inst, Bits_OP))
+    {
+    case _movs:
+        return 18;
+    case _cmps:
+        return 22;
+    case _stds:
+        return 11;
+    case _lods:
+        return 12;
+    case _scas:
+        return 15;
+    default:
+        return 0;
+    }
+}
+
+/* Clocks for a constructed instruction, taken selects the cost of a conditional jump that jumps */
+uint32_t estimate_clocks(Instruction_Code* inst, const bool taken)
+{
+    int32_t mod    = ffetch(inst, Bits_MOD);
+    int32_t d      = ffetch(inst, Bits_D);
+    int32_t w      = ffetch(inst, Bits_W);
+    bool mem       = (mod != FIELD_NOT_SET && mod != REGISTER_MODE);
+    bool has_reg   = ffetch(inst, Bits_REG) != FIELD_NOT_SET;
+    bool has_data  = ffetch(inst, Bits_Data_L) != FIELD_NOT_SET;
+    bool has_sr    = ffetch(inst, Bits_SR) != FIELD_NOT_SET;
+    uint32_t ea    = effective_address_clocks(mod, ffetch(inst, Bits_RM));
+
+    switch (inst->type)
+    {
+    case Op_mov:
+        if (has_sr)
+            return mem ? ((uint8_t)ffetch(inst, Bits_OP) == 0b10001100 ? 9 : 8) + ea : 2;
+        if (mod == FIELD_NOT_SET)
+            return has_data ? 4 : 10; // immediate to register, accumulator to / from memory
+        if (has_reg)
+            return mem ? (d > 0 ? 8 : 9) + ea : 2;
+        return mem ? 10 + ea : 4;
+    case Op_add:
+    case Op_or:
+    case Op_adc:
+    case Op_sbb:
+    case Op_and:
+    case Op_sub:
+    case Op_xor:
+        if (mod == FIELD_NOT_SET)
+            return 4;
+        if (d != FIELD_NOT_SET)
+            return mem ? (d > 0 ? 9 : 16) + ea : 3;
+        return mem ? 17 + ea : 4;
+    case Op_cmp:
+        if (mod == FIELD_NOT_SET)
+            return 4;
+        if (d != FIELD_NOT_SET)
+            return mem ? 9 + ea : 3;
+        return mem ? 10 + ea : 4;
+    case Op_test:
+        if (mod == FIELD_NOT_SET)
+            return 4;
+        return mem ? 11 + ea : 5;
+    case Op_inc:
+    case Op_dec:
+        if (mod == FIELD_NOT_SET)
+            return 2;
+        return mem ? 15 + ea : 3;
+    case Op_neg:
+    case Op_not:
+        return mem ? 16 + ea : 3;
+    case Op_mul:
+        return w > 0 ? (mem ? 124 + ea : 118) : (mem ? 76 + ea : 70);
+    case Op_imul:
+        return w > 0 ? (mem ? 134 + ea : 128) : (mem ? 86 + ea : 80);
+    case Op_div:
+        return w > 0 ? (mem ? 150 + ea : 144) : (mem ? 86 + ea : 80);
+    case Op_idiv:
+        return w > 0 ? (mem ? 171 + ea : 165) : (mem ? 107 + ea : 101);
+    case Op_rol:
+    case Op_ror:
+    case Op_rcl:
+    case Op_rcr:
+    case Op_shl:
+    case Op_shr:
+    case Op_sar:
+        if (ffetch(inst, Bits_V) > 0)
+            return mem ? 20 + ea : 8;
+        return mem ? 15 + ea : 2;
+    case Op_loop:
+        return taken ? 17 : 5;
+    case Op_loopz:
+        return taken ? 18 : 6;
+    case Op_loopnz:
+        return taken ? 19 : 5;
+    case Op_jcxz:
+        return taken ? 18 : 6;
+    case Op_jmp:
+        if (mod != FIELD_NOT_SET)
+            return mem ? 18 + ea : 11;
+        return 15;
+    case Op_call:
+        if (mod != FIELD_NOT_SET)
+            return mem ? 21 + ea : 16;
+        return has_data ? 28 : 19;
+    case Op_ret:
+        return has_data ? 12 : 8;
+    case Op_retf:
+        return has_data ? 17 : 18;
+    case Op_iret:
+        return 24;
+    case Op_push:
+        if (has_sr)
+            return 10;
+        return mod == FIELD_NOT_SET ? 11 : 16 + ea;
+    case Op_pop:
+        if (has_sr || mod == FIELD_NOT_SET)
+            return 8;
+        return 17 + ea;
+    case Op_xchg:
+        if (mod == FIELD_NOT_SET)
+            return 3;
+        return mem ? 17 + ea : 4;
+    case Op_lea:
+        return 2 + ea;
+    case Op_lds:
+    case Op_les:
+        return 16 + ea;
+    case Op_in:
+    case Op_out:
+        return has_data ? 10 : 8;
+    case Op_int:
+        return has_data ? 51 : 52;
+    case Op_into:
+        return taken ? 53 : 4;
+    case Op_rep:
+    case Op_movs:
+    case Op_cmps:
+    case Op_stds:
+    case Op_lods:
+    case Op_scas:
+        return string_op_clocks(inst);
+    case Op_aam:
+        return 83;
+    case Op_aad:
+        return 60;
+    case Op_elat:
+        return 11;
+    case Op_cbd:
+        return 5;
+    case Op_aaa:
+    case Op_daa:
+    case Op_ass:
+    case Op_das:
+    case Op_lahf:
+    case Op_safh:
+        return 4;
+    case Op_pushf:
+        return 10;
+    case Op_popf:
+        return 8;
+    case Op_wait:
+        return 3;
+    case Op_esc:
+        return 8 + ea;
+    default:
+        // conditional jumps
+        if (inst->type >= Op_je && inst->type <= Op_jns)
+            return taken ? 16 : 4;
+        // flag operations, hlt, lock, cbw and segment prefixes
+        return 2;
+    }
+}
+
+/* Adds a decoded instruction to the run counters. While a block is recorded the clocks go
+   to the block instead and are added each time it runs, the repetitions of a rep are added
+   by the string op itself */
+void count_instruction(CP_units* exec, Instruction_Code* inst, const uint16_t next_ip)
+{
+    if (exec->record != NULL)
+    {
+        Micro_Block* block  = exec->record;
+        block->clocks_taken = block->clocks + (inst->type == Op_rep ? REP_BASE_CLOCKS : estimate_clocks(inst, true));
+        block->clocks      += (inst->type == Op_rep ? REP_BASE_CLOCKS : estimate_clocks(inst, false));
+        return;
+    }
+
+    ++exec->instruction_count;
+    exec->clocks += (inst->type == Op_rep ? REP_BASE_CLOCKS : estimate_clocks(inst, exec->ip != next_ip));
+}
+
+
+/*==========================================
+  Control flow analysis
+  Decode only, blocks are split at jump targets
+  and after control transfers, loops are found
+  from back edges to a dominating header
+  ========================================*/
+
+typedef enum : uint8_t
+{
+    FLOW_NEXT,   // falls through
+    FLOW_BRANCH, // conditional, falls through or jumps to target
+    FLOW_JUMP,   // only the target, -1 when indirect
+    FLOW_CALL,   // falls through, the target starts another root
+    FLOW_STOP    // ret / iret / hlt
+} Flow_Type;
+
+typedef struct
+{
+    uint16_t ip;
+    uint8_t length;
+    Flow_Type flow;
+    int32_t target;
+    uint16_t clocks;
+    uint16_t clocks_taken;
+    Instruction_Code inst;
+} Static_Inst;
+
+typedef struct
+{
+    uint32_t first;   // index into the instruction list
+    uint32_t last;
+    int32_t succ[2];  // block index, -1 when unused
+} Flow_Block;
+
+typedef struct
+{
+    uint32_t header;
+    uint32_t latch;   // block holding the back edge
+    uint64_t* body;   // bitset over blocks
+    uint32_t depth;
+} Natural_Loop;
+
+#define BIT_WORDS(n) (((n) + 63) / 64)
+static inline bool bit_test(const uint64_t* set, const uint32_t i)
+{
+    return set[i / 64] & (1ull << (i % 64));
+}
+static inline void bit_set(uint64_t* set, const uint32_t i)
+{
+    set[i / 64] |= (1ull << (i % 64));
+}
+
+static Flow_Type static_flow(Instruction_Code* inst, const uint16_t next_ip, int32_t* target)
+{
+    *target = -1;
+
+    if (inst->type >= Op_je && inst->type <= Op_jcxz)
+    {
+        *target = (uint16_t)(next_ip + (int8_t)ffetch(inst, Bits_IP_INC8));
+        return FLOW_BRANCH;
+    }
+
+    // direct near jumps and calls only carry a displacement
+    bool direct = ffetch(inst, Bits_MOD) == FIELD_NOT_SET && ffetch(inst, Bits_Data_L) == FIELD_NOT_SET;
+    switch (inst->type)
+    {
+    case Op_jmp:
+        if (direct)
+            *target = (uint16_t)(next_ip + disp_calc(ffetch(inst, Bits_Disp_L), ffetch(inst, Bits_Disp_H)));
+        return FLOW_JUMP;
+    case Op_call:
+        if (direct)
+            *target = (uint16_t)(next_ip + disp_calc(ffetch(inst, Bits_Disp_L), ffetch(inst, Bits_Disp_H)));
+        return FLOW_CALL;
+    case Op_ret:
+    case Op_retf:
+    case Op_iret:
+    case Op_hlt:
+        return FLOW_STOP;
+    default:
+        return FLOW_NEXT;
+    }
+}
+
+// trip count of a loop closed by `loop`, from a mov cx, imm in the block falling into the header
+static int32_t loop_trip_count(Static_Inst* insts, Flow_Block* blocks, Natural_Loop* loop)
+{
+    Static_Inst* latch_end = &insts[blocks[loop->latch].last];
+    if (latch_end->inst.type != Op_loop)
+        return -1;
+
+    for (int32_t i = (int32_t)blocks[loop->header].first -1; i >= 0; --i)
+    {
+        Instruction_Code* inst = &insts[i].inst;
+        if (insts[i].flow != FLOW_NEXT)
+            return -1;
+        if (inst->type == Op_mov && ffetch(inst, Bits_MOD) == FIELD_NOT_SET && ffetch(inst, Bits_Data_L) != FIELD_NOT_SET &&
+                ffetch(inst, Bits_W) == 1 && ffetch(inst, Bits_REG) == 0b001)
+            return byte_calc(ffetch(inst, Bits_Data_L), ffetch(inst, Bits_Data_H));
+        if (ffetch(inst, Bits_REG) == 0b001 || ffetch(inst, Bits_RM) == 0b001)
+            return -1; // something else touches cx
+    }
+    return -1;
+}
+
+static uint64_t block_clocks(Static_Inst* insts, Flow_Block* block, const uint64_t* body, const int32_t* block_of_ip)
+{
+    uint64_t clocks = 0;
+    for (uint32_t i = block->first; i <= block->last; ++i)
+    {
+        Static_Inst* si = &insts[i];
+        if (si->flow == FLOW_BRANCH)
+        {
+            // jumping is assumed when only the target stays inside the loop
+            uint16_t next_ip   = si->ip + si->length;
+            bool target_inside = si->target >= 0 && block_of_ip[si->target] >= 0 && bit_test(body, block_of_ip[si->target]);
+            bool next_inside   = block_of_ip[next_ip] >= 0 && bit_test(body, block_of_ip[next_ip]);
+            clocks += (target_inside && !next_inside) ? si->clocks_taken : si->clocks;
+        }
+        else
+            clocks += si->clocks;
+    }
+    return clocks;
+}
+
+// per iteration cost, nested loops are multiplied by their trip count when it is known
+static uint64_t loop_clocks(Static_Inst* insts, Flow_Block* blocks, Natural_Loop* loops, const uint32_t loop_count,
+                            const uint32_t l, const uint32_t block_count, const int32_t* block_of_ip, bool* exact)
+{
+    Natural_Loop* loop = &loops[l];
+    uint64_t* own      = (uint64_t*)calloc(BIT_WORDS(block_count), sizeof(uint64_t));
+    memcpy(own, loop->body, BIT_WORDS(block_count) * sizeof(uint64_t));
+
+    uint64_t clocks = 0;
+    for (uint32_t n = 0; n < loop_count; ++n)
+    {
+        Natural_Loop* inner = &loops[n];
+        if (n == l || inner->depth != loop->depth +1 || !bit_test(loop->body, inner->header))
+            continue;
+
+        for (uint32_t w = 0; w < BIT_WORDS(block_count); ++w)
+            own[w] &= ~inner->body[w];
+
+        uint64_t inner_clocks = loop_clocks(insts, blocks, loops, loop_count, n, block_count, block_of_ip, exact);
+        int32_t trip          = loop_trip_count(insts, blocks, inner);
+        if (trip > 0)
+        {
+            // the last iteration falls out of the loop
+            Static_Inst* back = &insts[blocks[inner->latch].last];
+            clocks += (uint64_t)trip * inner_clocks - (back->clocks_taken - back->clocks);
+        }
+        else
+        {
+            clocks += inner_clocks;
+            *exact  = false;
+        }
+    }
+
+    for (uint32_t b = 0; b < block_count; ++b)
+        if (bit_test(own, b))
+            clocks += block_clocks(insts, &blocks[b], loop->body, block_of_ip);
+
+    free(own);
+    return clocks;
+}
+
+static void print_static_inst(Memory* memory, Decode_Unit* d_unit, Static_Inst* si)
+{
+    fprintf(d_unit->out, "\t%5hu | %3hu", si->ip, si->clocks);
+    if (si->flow == FLOW_BRANCH)
+        fprintf(d_unit->out, " / %-3hu | ", si->clocks_taken);
+    else
+        fprintf(d_unit->out, "       | ");
+    decode_instruction(memory, d_unit, si->ip, op_code_lookup(memory_byte(memory, si->ip)), NULL);
+}
+
+void control_flow_report(Memory* memory, Decode_Unit* d_unit)
+{
+    // ips and the ip indexed tables are 16 bit, a bigger image would wrap onto its first 64KB
+    if (memory->bytes_used > 0x10000)
+    {
+        printf("ERROR - the control flow report takes images up to 64KB, this one is %u bytes\n", memory->bytes_used);
+        return;
+    }
+
+    const uint32_t flags = d_unit->flags;
+    d_unit->flags       |= SILENT_EXECUTION;
+
+    // decode only pass
+    Static_Inst* insts   = (Static_Inst*)malloc(sizeof(Static_Inst) * (memory->bytes_used +1));
+    int32_t* block_of_ip = (int32_t*)malloc(sizeof(int32_t) * 0x10000);
+    uint8_t* leader      = (uint8_t*)calloc(0x10000, sizeof(uint8_t));
+    for (uint32_t i = 0; i < 0x10000; ++i)
+        block_of_ip[i] = -1;
+
+    uint32_t inst_count = 0;
+    uint32_t ip         = 0;
+    leader[0]           = 1;
+    while (ip < memory->bytes_used)
+    {
+        Static_Inst* si = &insts[inst_count];
+        si->ip          = (uint16_t)ip;
+        si->length      = (uint8_t)decode_instruction(memory, d_unit, ip, op_code_lookup(memory_byte(memory, ip)), NULL);
+        si->inst        = d_unit->last_inst;
+        si->flow        = static_flow(&si->inst, (uint16_t)(ip + si->length), &si->target);
+        si->clocks       = (uint16_t)estimate_clocks(&si->inst, false);
+        si->clocks_taken = (uint16_t)estimate_clocks(&si->inst, true);
+
+        ++inst_count;
+        ip += si->length;
+
+        if (si->flow != FLOW_NEXT && ip < 0x10000)
+            leader[ip] = 1;
+        if (si->target >= 0)
+            leader[si->target] = 1;
+    }
+    d_unit->flags = flags;
+
+    // basic blocks, targets not on an instruction boundary are ignored
+    Flow_Block* blocks   = (Flow_Block*)malloc(sizeof(Flow_Block) * (inst_count +1));
+    uint32_t block_count = 0;
+    for (uint32_t i = 0; i < inst_count; ++i)
+    {
+        if (i == 0 || leader[insts[i].ip])
+        {
+            blocks[block_count].first = i;
+            ++block_count;
+        }
+        blocks[block_count -1].last = i;
+        block_of_ip[insts[i].ip]    = block_count -1;
+    }
+
+    uint64_t* roots = (uint64_t*)calloc(BIT_WORDS(block_count), sizeof(uint64_t));
+    bit_set(roots, 0);
+    uint32_t edge_count = 0;
+    for (uint32_t b = 0; b < block_count; ++b)
+    {
+        Static_Inst* end = &insts[blocks[b].last];
+        int32_t next_ip  = end->ip + end->length;
+        int32_t next     = next_ip < 0x10000 ? block_of_ip[next_ip] : -1;
+        int32_t target   = end->target >= 0 ? block_of_ip[end->target] : -1;
+
+        blocks[b].succ[0] = -1;
+        blocks[b].succ[1] = -1;
+        switch (end->flow)
+        {
+        case FLOW_NEXT:
+            blocks[b].succ[0] = next;
+            break;
+        case FLOW_BRANCH:
+            blocks[b].succ[0] = next;
+            blocks[b].succ[1] = target;
+            break;
+        case FLOW_JUMP:
+            blocks[b].succ[0] = target;
+            break;
+        case FLOW_CALL:
+            blocks[b].succ[0] = next;
+            if (target >= 0)
+                bit_set(roots, target);
+            break;
+        case FLOW_STOP:
+            break;
+        }
+        edge_count += (blocks[b].succ[0] >= 0) + (blocks[b].succ[1] >= 0);
+    }
+
+    // dominators, iterated until nothing changes
+    const uint32_t words = BIT_WORDS(block_count);
+    uint64_t* dom        = (uint64_t*)malloc(sizeof(uint64_t) * words * block_count);
+    for (uint32_t b = 0; b < block_count; ++b)
+    {
+        memset(&dom[b * words], bit_test(roots, b) ? 0 : 0xFF, sizeof(uint64_t) * words);
+        if (bit_test(roots, b))
+            bit_set(&dom[b * words], b);
+    }
+
+    uint64_t* tmp = (uint64_t*)malloc(sizeof(uint64_t) * words);
+    bool changed  = true;
+    while (changed)
+    {
+        changed = false;
+        for (uint32_t b = 0; b < block_count; ++b)
+        {
+            if (bit_test(roots, b))
+                continue;
+
+            memset(tmp, 0xFF, sizeof(uint64_t) * words);
+            bool has_pred = false;
+            for (uint32_t p = 0; p < block_count; ++p)
+                if (blocks[p].succ[0] == (int32_t)b || blocks[p].succ[1] == (int32_t)b)
+                {
+                    for (uint32_t w = 0; w < words; ++w)
+                        tmp[w] &= dom[p * words + w];
+                    has_pred = true;
+                }
+            if (!has_pred)
+                memset(tmp, 0, sizeof(uint64_t) * words);
+            bit_set(tmp, b);
+
+            if (memcmp(tmp, &dom[b * words], sizeof(uint64_t) * words) != 0)
+            {
+                memcpy(&dom[b * words], tmp, sizeof(uint64_t) * words);
+                changed = true;
+            }
+        }
+    }
+
+    // natural loops, back edges to the same header are merged
+    Natural_Loop* loops = (Natural_Loop*)malloc(sizeof(Natural_Loop) * (edge_count +1));
+    uint32_t loop_count = 0;
+    uint32_t* stack     = (uint32_t*)malloc(sizeof(uint32_t) * (block_count +1));
+    for (uint32_t b = 0; b < block_count; ++b)
+    {
+        for (uint32_t s = 0; s < 2; ++s)
+        {
+            int32_t h = blocks[b].succ[s];
+            if (h < 0 || !bit_test(&dom[b * words], h))
+                continue;
+
+            Natural_Loop* loop = NULL;
+            for (uint32_t l = 0; l < loop_count; ++l)
+                if (loops[l].header == (uint32_t)h)
+                    loop = &loops[l];
+            if (loop == NULL)
+            {
+                loop         = &loops[loop_count++];
+                loop->header = h;
+                loop->latch  = b;
+                loop->body   = (uint64_t*)calloc(words, sizeof(uint64_t));
+                bit_set(loop->body, h);
+            }
+            // with several back edges the last one is the latch, it is the one a `loop` closes
+            else if (b > loop->latch)
+                loop->latch = b;
+
+            // everything reaching the back edge without passing the header
+            uint32_t top = 0;
+            if (!bit_test(loop->body, b))
+            {
+                bit_set(loop->body, b);
+                stack[top++] = b;
+            }
+            while (top > 0)
+            {
+                uint32_t n = stack[--top];
+                for (uint32_t p = 0; p < block_count; ++p)
+                    if ((blocks[p].succ[0] == (int32_t)n || blocks[p].succ[1] == (int32_t)n) && !bit_test(loop->body, p))
+                    {
+                        bit_set(loop->body, p);
+                        stack[top++] = p;
+                    }
+            }
+        }
+    }
+
+    for (uint32_t l = 0; l < loop_count; ++l)
+    {
+        loops[l].depth = 0;
+        for (uint32_t o = 0; o < loop_count; ++o)
+            if (bit_test(loops[o].body, loops[l].header))
+                ++loops[l].depth;
+    }
+
+    fprintf(d_unit->out, "; Control flow of %u instructions: %u blocks, %u edges, %u loops\n", inst_count, block_count, edge_count, loop_count);
+    fprintf(d_unit->out, ";\t   ip | clocks       | instruction\n");
+    for (uint32_t l = 0; l < loop_count; ++l)
+    {
+        Natural_Loop* loop = &loops[l];
+        bool exact         = true;
+        uint64_t clocks    = loop_clocks(insts, blocks, loops, loop_count, l, block_count, block_of_ip, &exact);
+        int32_t trip       = loop_trip_count(insts, blocks, loop);
+
+        fprintf(d_unit->out, "\nloop at ip %hu, depth %u, ~%lu clocks per iteration%s", insts[blocks[loop->header].first].ip, loop->depth,
+                clocks, exact ? "" : " (nested loop counted once, trip count unknown)");
+        if (trip > 0)
+            fprintf(d_unit->out, ", %d iterations ~%lu clocks", trip, (uint64_t)trip * clocks - (insts[blocks[loop->latch].last].clocks_taken - insts[blocks[loop->latch].last].clocks));
+        fprintf(d_unit->out, "\n");
+
+        for (uint32_t b = 0; b < block_count; ++b)
+            if (bit_test(loop->body, b))
+                for (uint32_t i = blocks[b].first; i <= blocks[b].last; ++i)
+                    print_static_inst(memory, d_unit, &insts[i]);
+    }
+
+    for (uint32_t l = 0; l < loop_count; ++l)
+        free(loops[l].body);
+    free(loops);
+    free(stack);
+    free(tmp);
+    free(dom);
+    free(roots);
+    free(blocks);
+    free(leader);
+    free(block_of_ip);
+    free(insts);
+}
+
+
+/*==========================================
+  Predecoder
+  Instruction lengths without the operand decode,
+  one entry per op code and mod/rm bits of the
+  second byte, built once from decode_fields.
+  Prefixes (lock and segment overrides) are folded
+  into the instruction they come before
+  ========================================*/
+
+#define PREDECODE_UNKNOWN 0
+
+static uint8_t predecode_table[256][32]; // [op code][mod<<3 | rm], 0 when the op code is unknown
+static uint8_t predecode_reg0_extra[256]; // f6 / f7 only carry the immediate for test (reg 000)
+static bool predecode_prefix[256];
+static pthread_once_t predecode_once = PTHREAD_ONCE_INIT;
+
+static void predecode_build()
+{
+    // one page holding the op code and mod/rm byte under test
+    Memory scratch;
+    memset(&scratch, 0, sizeof(Memory));
+    memory_init(&scratch, MEMORY_PAGE_SIZE);
+    scratch.bytes_used = 8;
+    Instruction_Code inst;
+
+    for (uint32_t op = 0; op < 256; ++op)
+    {
+        int32_t index = op_code_find(op);
+        if (index == -1)
+            continue;
+
+        Operation_Type type  = instruction_table[index].type;
+        predecode_prefix[op] = (type == Op_lock || type == Op_es || type == Op_sc || type == Op_ss || type == Op_ds);
+
+        memory_set_byte(&scratch, 0, op);
+        for (uint32_t mod_rm = 0; mod_rm < 32; ++mod_rm)
+        {
+            uint8_t lengths[8];
+            for (uint32_t reg = 0; reg < 8; ++reg)
+            {
+                memory_set_byte(&scratch, 1, (mod_rm >> 3) << 6 | reg << 3 | (mod_rm & 0b111));
+                lengths[reg] = decode_fields(&scratch, 0, index, &inst);
+            }
+
+            for (uint32_t reg = 2; reg < 8; ++reg)
+                assert(lengths[reg] == lengths[1] && "ERROR - instruction length depends on more than reg 000\n");
+
+            predecode_table[op][mod_rm] = lengths[1];
+            if (mod_rm == 0)
+                predecode_reg0_extra[op] = lengths[0] - lengths[1];
+            else
+                assert(predecode_reg0_extra[op] == lengths[0] - lengths[1]);
+        }
+    }
+    free_memory(&scratch);
+}
+
+// the tables are filled once, also when the first users are the disassembly threads
+void predecode_init()
+{
+    pthread_once(&predecode_once, predecode_build);
+}
+
+// length of the instruction at index including its prefixes, PREDECODE_UNKNOWN on an unknown op code
+uint32_t predecode_length(Memory* memory, const uint32_t index)
+{
+    uint32_t prefixes = 0;
+    while (index + prefixes < memory->bytes_used && predecode_prefix[memory_byte(memory, index + prefixes)])
+        ++prefixes;
+
+    uint8_t op     = memory_byte(memory, index + prefixes);
+    uint8_t mod_rm = memory_byte(memory, index + prefixes +1);
+    uint32_t length = predecode_table[op][(mod_rm >> 3 & 0b11000) | (mod_rm & 0b111)];
+    if (length == PREDECODE_UNKNOWN)
+        return PREDECODE_UNKNOWN;
+
+    if ((mod_rm & 0b00111000) == 0)
+        length += predecode_reg0_extra[op];
+    return prefixes + length;
+}
+
+// start of every instruction in [start, end), returns how many were written to out
+uint32_t predecode_boundaries(Memory* memory, uint32_t start, const uint32_t end, uint32_t* out, const uint32_t max)
+{
+    uint32_t count = 0;
+    while (start < end && count < max)
+    {
+        uint32_t length = predecode_length(memory, start);
+        if (length == PREDECODE_UNKNOWN)
+        {
+            printf("ERROR - unknown Op code 0x%02x at %u in the boundary scan\n", memory_byte(memory, start), start);
+            break;
+        }
+        out[count++] = start;
+        start       += length;
+    }
+    return count;
+}
+
+#define PREDECODE_TIMING_RUNS 64
+
+void predecode_report(Memory* memory, Decode_Unit* d_unit)
+{
+    predecode_init();
+
+    uint32_t* boundaries = (uint32_t*)malloc(sizeof(uint32_t) * (memory->bytes_used +1));
+    uint32_t* decoded    = (uint32_t*)malloc(sizeof(uint32_t) * (memory->bytes_used +1));
+    uint32_t count       = 0;
+    uint32_t decoded_count = 0;
+
+    // the full decoder, prefixes are their own instruction there
+    Instruction_Code inst;
+    uint64_t decode_nano = UINT64_MAX;
+    for (uint32_t run = 0; run < PREDECODE_TIMING_RUNS; ++run)
+    {
+        Timer timer;
+        start_timer(&timer);
+        decoded_count   = 0;
+        bool prefixed   = false;
+        for (uint32_t ip = 0; ip < memory->bytes_used;)
+        {
+            int32_t index = op_code_find(memory_byte(memory, ip));
+            if (index == -1)
+                break;
+            if (!prefixed)
+                decoded[decoded_count++] = ip;
+            prefixed = predecode_prefix[memory_byte(memory, ip)];
+            ip      += decode_fields(memory, ip, index, &inst);
+        }
+        end_timer(&timer);
+        if (timer_nano(&timer) < decode_nano)
+            decode_nano = timer_nano(&timer);
+    }
+
+    uint64_t predecode_nano = UINT64_MAX;
+    for (uint32_t run = 0; run < PREDECODE_TIMING_RUNS; ++run)
+    {
+        Timer timer;
+        start_timer(&timer);
+        count = predecode_boundaries(memory, 0, memory->bytes_used, boundaries, memory->bytes_used +1);
+        end_timer(&timer);
+        if (timer_nano(&timer) < predecode_nano)
+            predecode_nano = timer_nano(&timer);
+    }
+
+    uint32_t mismatch = count != decoded_count;
+    for (uint32_t i = 0; i < count && i < decoded_count; ++i)
+        if (boundaries[i] != decoded[i])
+        {
+            printf("ERROR - boundary %u at %u from the predecoder, %u from the decoder\n", i, boundaries[i], decoded[i]);
+            ++mismatch;
+            break;
+        }
+
+    printf("; Predecoded %u instructions in %u bytes\n", count, memory->bytes_used);
+    printf("; Boundaries %s the full decoder (%u instructions)\n", mismatch ? "DIFFER from" : "match", decoded_count);
+    printf("; Field decode: %lu ns, %.1f MB/s\n", decode_nano, decode_nano ? memory->bytes_used * 1e3 / decode_nano : 0.0);
+    printf("; Length table: %lu ns, %.1f MB/s\n", predecode_nano, predecode_nano ? memory->bytes_used * 1e3 / predecode_nano : 0.0);
+
+    if (!(d_unit->flags & SILENT_EXECUTION))
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            uint32_t end = (i + 1 < count) ? boundaries[i +1] : memory->bytes_used;
+            printf("%5u:", boundaries[i]);
+            for (uint32_t b = boundaries[i]; b < end; ++b)
+                printf(" %02x", memory_byte(memory, b));
+            printf("\n");
+        }
+
+    free(decoded);
+    free(boundaries);
+}
+
+
+/*==========================================
+  Parallel disassembly
+  Every chunk finds its boundaries from a guessed
+  start (the chunk's first byte) with the predecoder.
+  The chunks are then stitched in order: from the true
+  end of the previous chunk the lengths are walked until
+  they land on a guessed boundary, after which both
+  agree. Each chunk is then fully decoded on its own
+  thread into a memory stream, written out in order
+  ========================================*/
+
+#define PARALLEL_MIN_CHUNK 0x4000 // below this a thread costs more than it decodes, unless the chunk count is given
+
+typedef struct
+{
+    Memory* memory;
+    uint32_t begin;       // the guessed start
+    uint32_t end;
+    uint32_t* boundaries; // guessed boundaries from begin, the last one is >= end
+    uint32_t count;
+
+    uint32_t true_begin;  // after stitching
+    uint32_t true_end;
+    uint32_t resync_bytes;
+
+    uint32_t flags;
+    char* text;
+    size_t text_size;
+} Disassembly_Chunk;
+
+static void* chunk_scan_thread(void* arg)
+{
+    Disassembly_Chunk* chunk = (Disassembly_Chunk*)arg;
+    Memory* memory           = chunk->memory;
+
+    uint32_t at  = chunk->begin;
+    chunk->count = 0;
+    while (at < memory->bytes_used)
+    {
+        chunk->boundaries[chunk->count++] = at;
+        if (at >= chunk->end)
+            break;
+
+        // a wrong guess can land in data, stepping a byte keeps the scan going until it resyncs
+        uint32_t length = predecode_length(memory, at);
+        at += (length == PREDECODE_UNKNOWN) ? 1 : length;
+    }
+    if (at >= memory->bytes_used)
+        chunk->boundaries[chunk->count++] = at;
+    return NULL;
+}
+
+static bool chunk_has_boundary(Disassembly_Chunk* chunk, const uint32_t at)
+{
+    uint32_t low  = 0;
+    uint32_t high = chunk->count;
+    while (low < high)
+    {
+        uint32_t mid = (low + high) / 2;
+        if (chunk->boundaries[mid] < at)
+            low = mid +1;
+        else
+            high = mid;
+    }
+    return low < chunk->count && chunk->boundaries[low] == at;
+}
+
+static void* chunk_decode_thread(void* arg)
+{
+    Disassembly_Chunk* chunk = (Disassembly_Chunk*)arg;
+    Memory* memory           = chunk->memory;
+
+    Decode_Unit* d_unit = decode_unit_init();
+    d_unit->flags       = chunk->flags;
+    d_unit->out         = open_memstream(&chunk->text, &chunk->text_size);
+
+    uint32_t at = chunk->true_begin;
+    while (at < chunk->true_end && at < memory->bytes_used)
+        at += decode_instruction(memory, d_unit, at, op_code_lookup(memory_byte(memory, at)), NULL);
+
+    fclose(d_unit->out);
+    free(d_unit);
+    return NULL;
+}
+
+// chunk_count 0 takes one chunk per core of at least PARALLEL_MIN_CHUNK bytes
+void parallel_disassembly(Memory* memory, Decode_Unit* d_unit, uint32_t chunk_count, Parallel_Stats* stats)
+{
+    predecode_init();
+
+    if (chunk_count == 0)
+    {
+        uint32_t thread_count = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+        chunk_count           = memory->bytes_used / PARALLEL_MIN_CHUNK;
+        if (chunk_count > thread_count)
+            chunk_count = thread_count;
+    }
+    if (chunk_count > memory->bytes_used)
+        chunk_count = memory->bytes_used;
+    if (chunk_count == 0)
+        chunk_count = 1;
+
+    Disassembly_Chunk* chunks = (Disassembly_Chunk*)calloc(chunk_count, sizeof(Disassembly_Chunk));
+    pthread_t* threads        = (pthread_t*)malloc(sizeof(pthread_t) * chunk_count);
+    uint32_t chunk_size       = memory->bytes_used / chunk_count;
+
+    Timer timer;
+    start_timer(&timer);
+    for (uint32_t i = 0; i < chunk_count; ++i)
+    {
+        Disassembly_Chunk* chunk = &chunks[i];
+        chunk->memory     = memory;
+        chunk->flags      = d_unit->flags;
+        chunk->begin      = i * chunk_size;
+        chunk->end        = (i == chunk_count -1) ? memory->bytes_used : (i +1) * chunk_size;
+        chunk->boundaries = (uint32_t*)malloc(sizeof(uint32_t) * (chunk->end - chunk->begin + 2));
+        pthread_create(&threads[i], NULL, chunk_scan_thread, chunk);
+    }
+    for (uint32_t i = 0; i < chunk_count; ++i)
+        pthread_join(threads[i], NULL);
+    end_timer(&timer);
+    uint64_t scan_nano = timer_nano(&timer);
+
+    // stitching, only the stretch before the guessed boundaries agree is walked again
+    start_timer(&timer);
+    uint32_t resync_bytes      = 0;
+    uint32_t misaligned_chunks = 0;
+    uint32_t at                = 0;
+    for (uint32_t i = 0; i < chunk_count; ++i)
+    {
+        Disassembly_Chunk* chunk = &chunks[i];
+        chunk->true_begin        = at;
+        misaligned_chunks       += at != chunk->begin;
+
+        while (at < chunk->end && !chunk_has_boundary(chunk, at))
+        {
+            uint32_t length = predecode_length(memory, at);
+            assert(length != PREDECODE_UNKNOWN && "ERROR - unknown Op code\n");
+            at += length;
+        }
+        chunk->resync_bytes = at - chunk->true_begin;
+        resync_bytes       += chunk->resync_bytes;
+
+        if (at < chunk->end || chunk_has_boundary(chunk, at))
+            at = chunk->boundaries[chunk->count -1];
+        chunk->true_end = at;
+    }
+    end_timer(&timer);
+    uint64_t stitch_nano = timer_nano(&timer);
+
+    start_timer(&timer);
+    for (uint32_t i = 0; i < chunk_count; ++i)
+        pthread_create(&threads[i], NULL, chunk_decode_thread, &chunks[i]);
+    for (uint32_t i = 0; i < chunk_count; ++i)
+        pthread_join(threads[i], NULL);
+    end_timer(&timer);
+    uint64_t decode_nano = timer_nano(&timer);
+
+    for (uint32_t i = 0; i < chunk_count; ++i)
+    {
+        fwrite(chunks[i].text, 1, chunks[i].text_size, d_unit->out);
+        free(chunks[i].text);
+        free(chunks[i].boundaries);
+    }
+    fflush(d_unit->out);
+
+    stats->chunk_count       = chunk_count;
+    stats->resync_bytes      = resync_bytes;
+    stats->misaligned_chunks = misaligned_chunks;
+    stats->scan_nano         = scan_nano;
+    stats->stitch_nano       = stitch_nano;
+    stats->decode_nano       = decode_nano;
+
+    free(threads);
+    free(chunks);
+}
+
+// on stderr so the listing can still be diffed against the sequential decoder
+void print_parallel_stats(const Parallel_Stats* stats, const uint32_t bytes)
+{
+    uint64_t total_nano = stats->scan_nano + stats->stitch_nano + stats->decode_nano;
+    fprintf(stderr, "; %u bytes in %u chunks, one thread each, %u started inside an instruction, %u bytes walked again to resync\n",
+            bytes, stats->chunk_count, stats->misaligned_chunks, stats->resync_bytes);
+    fprintf(stderr, "; scan %lu ns, stitch %lu ns, decode %lu ns, %.1f MB/s\n", stats->scan_nano, stats->stitch_nano,
+            stats->decode_nano, total_nano ? bytes * 1e3 / total_nano : 0.0);
+}
+
+
+/*==========================================
+  Benchmarks
+  Every backend runs the loaded program from
+  the same start state, the fastest of
+  BENCH_RUNS is reported per guest instruction
+  ========================================*/
+#define BENCH_RUNS       3
+#define BENCH_8086_CLOCK 4.77e6 // Hz of the original IBM PC
+
+typedef enum : uint8_t
+{
+    BACKEND_INTERPRETER,
+    BACKEND_MICRO_OP,
+    BACKEND_FUSED,
+    BACKEND_COUNT
+} Backend;
+
+const char* backend_string(Backend backend)
+{
+    switch (backend)
+    {
+    case BACKEND_INTERPRETER:
+        return "interpreter";
+    case BACKEND_MICRO_OP:
+        return "micro-op";
+    case BACKEND_FUSED:
+        return "fused";
+    default:
+        assert(0 && "ERROR - failed to get backend_string\n");
+    }
+}
+
+void benchmark_backends(Memory* memory, Decode_Unit* d_unit, CP_units* exec)
+{
+    CP_units start_state;
+    memcpy(&start_state, exec, sizeof(CP_units));
+    Memory start_memory;
+    memory_clone(&start_memory, memory);
+
+    CP_units end_state[BACKEND_COUNT];
+    uint64_t fastest[BACKEND_COUNT];
+    Micro_Engine* engine = micro_engine_init();
+
+    printf("\n%-12s %12s %14s %12s %9s %9s %9s\n", "backend", "instructions", "guest clocks", "time (ns)", "MIPS", "ns/inst", "x 8086");
+    for (uint32_t backend = 0; backend < BACKEND_COUNT; ++backend)
+    {
+        // the block cache is warm from the micro-op runs, fused blocks only need the execution counts
+        if (backend == BACKEND_FUSED)
+            micro_engine_fuse(engine, 0xFFFFFFFF);
+
+        fastest[backend] = UINT64_MAX;
+        for (uint32_t run = 0; run < BENCH_RUNS; ++run)
+        {
+            memory_copy(memory, &start_memory);
+            memcpy(exec, &start_state, sizeof(CP_units));
+
+            Timer timer;
+            start_timer(&timer);
+            if (backend == BACKEND_INTERPRETER)
+                interpreter_run(memory, d_unit, exec);
+            else
+                micro_engine_run(engine, memory, d_unit, exec);
+            end_timer(&timer);
+
+            if (timer_nano(&timer) < fastest[backend])
+                fastest[backend] = timer_nano(&timer);
+        }
+        memcpy(&end_state[backend], exec, sizeof(CP_units));
+
+        uint64_t ns           = fastest[backend] ? fastest[backend] : 1;
+        uint64_t instructions = exec->instruction_count;
+        double guest_ns       = exec->clocks * 1e9 / BENCH_8086_CLOCK;
+        printf("%-12s %12lu %14lu %12lu %9.2f %9.2f %8.1fx\n", backend_string(backend), instructions, exec->clocks, ns,
+               instructions * 1e3 / ns, instructions ? (double)ns / instructions : 0.0, guest_ns / ns);
+    }
+
+    // every backend has to agree with the interpreter or the timings mean nothing
+    for (uint32_t backend = BACKEND_INTERPRETER +1; backend < BACKEND_COUNT; ++backend)
+    {
+        CP_units* a = &end_state[BACKEND_INTERPRETER];
+        CP_units* b = &end_state[backend];
+        if (memcmp(a->reg, b->reg, sizeof(a->reg)) != 0 || a->ip != b->ip || a->flags != b->flags ||
+                a->instruction_count != b->instruction_count || a->clocks != b->clocks)
+            printf("ERROR - %s finished in a different state than the interpreter\n", backend_string(backend));
+    }
+
+    free_memory(&start_memory);
+    micro_engine_destroy(engine);
+}
+
+
+/*==========================================
+  Lockstep execution
+  The interpreter and the micro-op engine run
+  the same program on their own copy of the
+  machine. After every block both are hashed,
+  on a mismatch the run is replayed with one
+  instruction blocks to find the first bad one
+  ========================================*/
+#define LOCKSTEP_MEMORY_DIFFS 16 // differing bytes listed in a state diff
+
+// registers, ip and the memory hash, flags only when the engine keeps them live out of the block
+uint64_t machine_hash(const CP_units* exec, const bool with_flags)
+{
+    uint64_t hash = 0xCBF29CE484222325ull ^ exec->memory->hash;
+    for (uint8_t i = 0; i < array_count(exec->reg); ++i)
+        hash = (hash ^ exec->reg[i]) * 0x100000001B3ull;
+    hash = (hash ^ exec->ip) * 0x100000001B3ull;
+    if (with_flags)
+        hash = (hash ^ exec->flags) * 0x100000001B3ull;
+    return hash;
+}
+
+typedef struct
+{
+    Memory memory;
+    CP_units exec;
+    Decode_Unit d_unit; // blocks are lowered with their own prefix state
+    Micro_Engine* engine;
+} Lockstep_Shadow;
+
+// the engine may leave dead flags stale, only the edge the block left through counts
+static inline bool lockstep_flags_live(const Micro_Block* block, const CP_units* exec)
+{
+    return (exec->ip != block->end_ip) ? block->flags_live_taken : block->flags_live_fallthrough;
+}
+
+static void lockstep_reset(Memory* memory, CP_units* exec, Lockstep_Shadow* shadow, const CP_units* start_state, const Memory* start_memory)
+{
+    memory_copy(memory, start_memory);
+    memory_copy(&shadow->memory, start_memory);
+    memory->hash        = 0;
+    shadow->memory.hash = 0;
+
+    memcpy(exec, start_state, sizeof(CP_units));
+    memcpy(&shadow->exec, start_state, sizeof(CP_units));
+    shadow->exec.memory = &shadow->memory;
+}
+
+static void lockstep_state_diff(const CP_units* a, const CP_units* b, const bool with_flags)
+{
+    printf("%-8s %12s %12s\n", "", "interpreter", "micro-op");
+    for (uint8_t i = 0; i < array_count(a->reg); ++i)
+        if (a->reg[i] != b->reg[i])
+            printf("%-8s %#12hx %#12hx\n", register_string(i), a->reg[i], b->reg[i]);
+    if (a->ip != b->ip)
+        printf("%-8s %12hu %12hu\n", "ip", a->ip, b->ip);
+    if (with_flags && a->flags != b->flags)
+    {
+        printf("%-8s ", "flags");
+        print_set_flags((CP_units*)a);
+        printf("| ");
+        print_set_flags((CP_units*)b);
+        printf("\n");
+    }
+
+    uint32_t diffs = 0;
+    for (uint32_t i = 0; i < MEMORY_SIZE; ++i)
+    {
+        if (memory_byte(a->memory, i) == memory_byte(b->memory, i))
+            continue;
+        if (diffs < LOCKSTEP_MEMORY_DIFFS)
+            printf("[%-6u] %12hhu %12hhu\n", i, memory_byte(a->memory, i), memory_byte(b->memory, i));
+        ++diffs;
+    }
+    if (diffs > LOCKSTEP_MEMORY_DIFFS)
+        printf("... %u differing bytes in memory\n", diffs);
+}
+
+// replays up to instruction_limit with one instruction blocks, the engine keeps its passes but nothing can cross an instruction
+static void lockstep_find_instruction(Memory* memory, Decode_Unit* d_unit, CP_units* exec, Lockstep_Shadow* shadow,
+                                      const CP_units* start_state, const Memory* start_memory, const uint64_t instruction_limit)
+{
+    lockstep_reset(memory, exec, shadow, start_state, start_memory);
+    Micro_Engine* engine     = micro_engine_init();
+    engine->block_inst_limit = 1;
+
+    while (exec->instruction_count < instruction_limit && !exec->halted)
+    {
+        const uint16_t ip  = exec->ip;
+        Micro_Block* block = micro_engine_step(engine, &shadow->memory, &shadow->d_unit, &shadow->exec);
+        decode_instruction(memory, d_unit, exec->ip, op_code_lookup(memory_byte(memory, exec->ip)), exec);
+
+        const bool with_flags = lockstep_flags_live(block, &shadow->exec);
+        if (machine_hash(exec, with_flags) == machine_hash(&shadow->exec, with_flags))
+            continue;
+
+        // listing the instruction without executing it
+        Decode_Unit listing = *d_unit;
+        listing.flags      &= ~SILENT_EXECUTION;
+        printf("\nFirst differing instruction, number %lu at ip %hu:\n", exec->instruction_count, ip);
+        decode_instruction(memory, &listing, ip, op_code_lookup(memory_byte(memory, ip)), NULL);
+        print_micro_block(block);
+        lockstep_state_diff(exec, &shadow->exec, with_flags);
+        micro_engine_destroy(engine);
+        return;
+    }
+
+    printf("\nOne instruction blocks agree up to the divergence, it comes from a pass or superinstruction across instructions\n");
+    micro_engine_destroy(engine);
+}
+
+void lockstep_execute_stream(Memory* memory, Decode_Unit* d_unit, CP_units* exec)
+{
+    if (exec->dos != NULL)
+    {
+        printf("ERROR - lockstep can not run DOS programs, every service would run twice\n");
+        return;
+    }
+
+    CP_units start_state;
+    memcpy(&start_state, exec, sizeof(CP_units));
+    Memory start_memory;
+    memory_clone(&start_memory, memory);
+
+    Lockstep_Shadow shadow;
+    memset(&shadow, 0, sizeof(Lockstep_Shadow));
+    memory_clone(&shadow.memory, memory);
+    shadow.d_unit            = *d_unit;
+    shadow.engine            = micro_engine_init();
+    lockstep_reset(memory, exec, &shadow, &start_state, &start_memory);
+
+    // with -fuse every block switches to its superinstructions once it is hot, so both paths get compared
+    const bool fuse = d_unit->flags & FUSED_EXECUTION;
+    uint64_t blocks = 0;
+    bool diverged   = false;
+
+    Timer timer;
+    start_timer(&timer);
+    while (shadow.exec.ip < shadow.memory.bytes_used && !shadow.exec.halted)
+    {
+        Micro_Block* block = micro_engine_step(shadow.engine, &shadow.memory, &shadow.d_unit, &shadow.exec);
+        if (fuse && block->exec_count == FUSE_MIN_EXEC_COUNT)
+            micro_block_fuse(block, 0xFFFFFFFF);
+
+        for (uint16_t i = 0; i < block->inst_count && exec->ip < memory->bytes_used && !exec->halted; ++i)
+            decode_instruction(memory, d_unit, exec->ip, op_code_lookup(memory_byte(memory, exec->ip)), exec);
+        ++blocks;
+
+        const bool with_flags = lockstep_flags_live(block, &shadow.exec);
+        if (machine_hash(exec, with_flags) != machine_hash(&shadow.exec, with_flags))
+        {
+            printf("\nDivergence after %lu blocks, %lu instructions, in ", blocks, exec->instruction_count);
+            print_micro_block(block);
+            lockstep_state_diff(exec, &shadow.exec, with_flags);
+            lockstep_find_instruction(memory, d_unit, exec, &shadow, &start_state, &start_memory, exec->instruction_count);
+            diverged = true;
+            break;
+        }
+    }
+    end_timer(&timer);
+
+    if (!diverged)
+        printf("\nLockstep: %lu blocks, %lu instructions agree in %lu ns\n", blocks, exec->instruction_count, timer_nano(&timer));
+
+    free_memory(&start_memory);
+    free_memory(&shadow.memory);
+    micro_engine_destroy(shadow.engine);
+}
+
+
+/*==========================================
+  Batch instances
+  Copies of the loaded program resident at once,
+  each on its own sparse memory so an instance
+  costs its page table and touched pages. They
+  take turns a block at a time on one shared
+  block cache, the program is the same for all
+  ========================================*/
+void instances_execute(Memory* memory, const uint32_t instance_count)
+{
+    Decode_Unit* d_unit  = decode_unit_init();
+    d_unit->flags        = EXECUTION_OF_INSTRUCTION | SILENT_EXECUTION;
+    Micro_Engine* engine = micro_engine_init();
+
+    Memory* memories = (Memory*)malloc(instance_count * sizeof(Memory));
+    CP_units* units  = (CP_units*)calloc(instance_count, sizeof(CP_units));
+    for (uint32_t i = 0; i < instance_count; ++i)
+    {
+        memory_clone(&memories[i], memory);
+        units[i].memory = &memories[i];
+    }
+
+    Timer timer;
+    start_timer(&timer);
+    for (uint32_t running = instance_count; running > 0;)
+    {
+        running = 0;
+        for (uint32_t i = 0; i < instance_count; ++i)
+        {
+            if (units[i].ip >= memories[i].bytes_used || units[i].halted)
+                continue;
+            micro_engine_step(engine, &memories[i], d_unit, &units[i]);
+            ++running;
+        }
+    }
+    end_timer(&timer);
+
+    uint64_t instructions = 0;
+    uint64_t resident     = 0;
+    uint64_t pages        = 0;
+    uint32_t mismatches   = 0;
+    for (uint32_t i = 0; i < instance_count; ++i)
+    {
+        instructions += units[i].instruction_count;
+        resident     += memory_resident_bytes(&memories[i]);
+        pages        += memories[i].pages_allocated;
+
+        // same program, same start, so every instance has to end like the first
+        if (memcmp(units[i].reg, units[0].reg, sizeof(units[0].reg)) != 0 || units[i].ip != units[0].ip ||
+                units[i].flags != units[0].flags || memories[i].hash != memories[0].hash)
+            ++mismatches;
+    }
+
+    printf("\n%u instances, %lu guest instructions in %lu ns, %.2f MIPS\n", instance_count, instructions,
+           timer_nano(&timer), timer_nano(&timer) ? instructions * 1e3 / timer_nano(&timer) : 0.0);
+    printf("Resident guest memory: %lu pages, %.1f MB, %.1f KB per instance (dense %.1f MB)\n", pages,
+           resident / (1024.0 * 1024.0), resident / 1024.0 / instance_count,
+           (double)instance_count * (memory->page_count << MEMORY_PAGE_SHIFT) / (1024.0 * 1024.0));
+    if (mismatches > 0)
+        printf("ERROR - %u instances finished in a different state than the first\n", mismatches);
+
+    printf("\nFinal state of instance 0");
+    print_memory_status(&units[0]);
+
+    for (uint32_t i = 0; i < instance_count; ++i)
+        free_memory(&memories[i]);
+    free(memories);
+    free(units);
+    micro_engine_destroy(engine);
+    free(d_unit);
+}
+
+
+/*==========================================
+  Checkpoints
+  Registers, the pending segment prefix and the
+  touched guest pages of a run. The pages sit at
+  MEMORY_PAGE_SIZE aligned offsets after the
+  header and page index, so a restore maps the
+  file copy on write and points the page table
+  into it without reading any page
+  ========================================*/
+#define CHECKPOINT_MAGIC   0x54504B4336383038ull // "8086CKPT"
+#define CHECKPOINT_VERSION 1
+
+typedef struct Checkpoint_Header
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t page_count;  // of the page table
+    uint32_t saved_pages; // touched pages, each with its page number in the index after the header
+    uint32_t bytes_used;
+    uint64_t memory_hash;
+    uint64_t instruction_count;
+    uint64_t clocks;
+    uint16_t reg[12];
+    uint16_t ip;
+    uint16_t flags;
+    uint8_t halted;
+    int8_t segment_override;
+} Checkpoint_Header;
+
+static inline uint64_t checkpoint_data_offset(const uint32_t saved_pages)
+{
+    uint64_t index_end = sizeof(Checkpoint_Header) + (uint64_t)saved_pages * sizeof(uint32_t);
+    return (index_end + MEMORY_PAGE_SIZE -1) & ~(uint64_t)MEMORY_PAGE_MASK;
+}
+
+// writes checkpoint_<time>_<instruction count>.ckpt, the run carries on afterwards
+void checkpoint_save(CP_units* exec, const Decode_Unit* d_unit)
+{
+    Memory* memory     = exec->memory;
+    exec->checkpoint_at = 0;
+
+    Checkpoint_Header header;
+    memset(&header, 0, sizeof(Checkpoint_Header));
+    header.magic             = CHECKPOINT_MAGIC;
+    header.version           = CHECKPOINT_VERSION;
+    header.page_count        = memory->page_count;
+    header.bytes_used        = memory->bytes_used;
+    header.memory_hash       = memory->hash;
+    header.instruction_count = exec->instruction_count;
+    header.clocks            = exec->clocks;
+    header.ip                = exec->ip;
+    header.flags             = exec->flags;
+    header.halted            = exec->halted;
+    header.segment_override  = d_unit->segment_override;
+    memcpy(header.reg, exec->reg, sizeof(header.reg));
+
+    uint32_t* index = (uint32_t*)malloc(memory->page_count * sizeof(uint32_t));
+    for (uint32_t i = 0; i < memory->page_count; ++i)
+        if (memory_page_touched(memory, i))
+            index[header.saved_pages++] = i;
+
+    char filename[64];
+    snprintf(filename, 64, "checkpoint_%lu_%lu.ckpt", time(NULL), exec->instruction_count);
+    FILE* file_ptr = fopen(filename, "wb");
+    if (file_ptr == NULL)
+    {
+        printf("ERROR - could not open file for the checkpoint\n");
+        free(index);
+        return;
+    }
+
+    bool written = fwrite(&header, sizeof(Checkpoint_Header), 1, file_ptr) == 1
+                   && fwrite(index, sizeof(uint32_t), header.saved_pages, file_ptr) == header.saved_pages
+                   && fseek(file_ptr, checkpoint_data_offset(header.saved_pages), SEEK_SET) == 0;
+    for (uint32_t i = 0; i < header.saved_pages && written; ++i)
+        written = fwrite(memory->pages[index[i]], 1, MEMORY_PAGE_SIZE, file_ptr) == MEMORY_PAGE_SIZE;
+    // the close flushes, a full disk may only show up here
+    if (fclose(file_ptr) != 0 || !written)
+    {
+        printf("ERROR - could not write the checkpoint %s, it was removed\n", filename);
+        remove(filename);
+        free(index);
+        return;
+    }
+
+    printf("Checkpoint at instruction %lu written to %s, %u pages\n", exec->instruction_count, filename, header.saved_pages);
+    free(index);
+}
+
+bool checkpoint_load(Memory* memory, const char* file_path, Checkpoint_Header* state)
+{
+    Timer timer;
+    start_timer(&timer);
+
+    int fd = open(file_path, O_RDONLY);
+    if (fd == -1)
+    {
+        printf("ERROR - could not open checkpoint %s\n", file_path);
+        return false;
+    }
+
+    struct stat file_stat;
+    fstat(fd, &file_stat);
+    if ((size_t)file_stat.st_size < sizeof(Checkpoint_Header) ||
+            read(fd, state, sizeof(Checkpoint_Header)) != sizeof(Checkpoint_Header) ||
+            state->magic != CHECKPOINT_MAGIC || state->version != CHECKPOINT_VERSION ||
+            (uint64_t)file_stat.st_size < checkpoint_data_offset(state->saved_pages) + (uint64_t)state->saved_pages * MEMORY_PAGE_SIZE)
+    {
+        printf("ERROR - %s is not a checkpoint of this version\n", file_path);
+        close(fd);
+        return false;
+    }
+
+    // private and writable, the guest writes into its own copies and never into the file
+    uint8_t* mapping = (uint8_t*)mmap(NULL, file_stat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        printf("ERROR - could not map checkpoint %s\n", file_path);
+        return false;
+    }
+
+    memory_init(memory, state->page_count << MEMORY_PAGE_SHIFT);
+    memory->mapping         = mapping;
+    memory->mapping_size    = file_stat.st_size;
+    memory->bytes_used      = state->bytes_used;
+    memory->hash            = state->memory_hash;
+    memory->pages_allocated = state->saved_pages;
+
+    const uint32_t* index = (const uint32_t*)(mapping + sizeof(Checkpoint_Header));
+    uint8_t* data         = mapping + checkpoint_data_offset(state->saved_pages);
+    for (uint32_t i = 0; i < state->saved_pages; ++i)
+    {
+        if (index[i] >= memory->page_count)
+        {
+            printf("ERROR - page %u of checkpoint %s is outside the page table\n", index[i], file_path);
+            free_memory(memory);
+            return false;
+        }
+        memory->pages[index[i]] = data + (uint64_t)i * MEMORY_PAGE_SIZE;
+    }
+
+    end_timer(&timer);
+    printf("Checkpoint %s restored, %u pages mapped in %lu ns\n", file_path, state->saved_pages, timer_nano(&timer));
+    return true;
+}
+
+void checkpoint_resume(const Checkpoint_Header* state, CP_units* exec, Decode_Unit* d_unit)
+{
+    memcpy(exec->reg, state->reg, sizeof(exec->reg));
+    exec->ip                 = state->ip;
+    exec->flags              = state->flags;
+    exec->halted             = state->halted;
+    exec->instruction_count  = state->instruction_count;
+    exec->clocks             = state->clocks;
+    d_unit->segment_override = state->segment_override;
+
+    printf("\nResumed at instruction %lu", exec->instruction_count);
+    print_memory_status(exec);
+}
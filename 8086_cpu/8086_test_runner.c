@@ -0,0 +1,771 @@
+/* =================================================================
+    Decoder test runner
+    every .asm in the tests folder is assembled once, then all of them and any
+    generated cases are decoded on a pool of threads in this process.
+    Each decoded instruction is encoded again and compared to its bytes
+    The listing is also compared with the parallel decoder's over small
+    chunks, and the control flow report is checked on a fixed nested loop
+    gcc -O2 8086_test_runner.c -o 8086_test_runner -pthread
+    ================================================================== */
+#include "8086_simulator.h"
+#include <dirent.h>
+#include <sys/wait.h>
+
+#define TEST_MAX_NAME            256
+#define TEST_MAX_ERROR           160
+#define GENERATED_CASE_INSTS     256 // instructions per generated case
+
+typedef struct
+{
+    char name[TEST_MAX_NAME];
+    char asm_path[TEST_MAX_NAME];   // empty for generated cases
+    uint8_t* bytes;
+    uint32_t size;
+
+    uint32_t instructions;
+    uint64_t nano;                  // decode, encode and compare, without nasm
+    uint32_t misaligned_chunks;     // parallel chunks whose guessed start was inside an instruction
+    bool passed;
+    char error[TEST_MAX_ERROR];
+} Test_Case;
+
+typedef struct
+{
+    Test_Case* cases;
+    uint32_t count;
+    uint32_t asm_count; // the generated cases follow, each worker generates the ones it takes
+    uint64_t seed;
+    uint32_t next;      // taken with an atomic add by the workers
+    bool nasm_check;    // the listing also goes back through nasm, as the old script did
+    uint32_t parallel_chunks; // the listing is compared with the parallel decoder's over this many chunks, 0 to skip
+    const char* scratch_dir;
+} Test_Pool;
+
+/*==========================================
+  Loading
+  A .bin is only assembled again when it is missing
+  or older than its .asm
+  ========================================*/
+static bool needs_assembling(const char* asm_path, const char* bin_path)
+{
+    struct stat asm_stat;
+    struct stat bin_stat;
+    if (stat(bin_path, &bin_stat) != 0)
+        return true;
+    return stat(asm_path, &asm_stat) == 0 && asm_stat.st_mtime > bin_stat.st_mtime;
+}
+
+static uint8_t* load_bytes(const char* path, uint32_t* size)
+{
+    FILE* file_ptr = fopen(path, "rb");
+    if (file_ptr == NULL)
+        return NULL;
+    fseek(file_ptr, 0, SEEK_END);
+    *size = (uint32_t)ftell(file_ptr);
+    fseek(file_ptr, 0, SEEK_SET);
+
+    uint8_t* bytes = (uint8_t*)malloc(*size ? *size : 1);
+    *size          = (uint32_t)fread(bytes, 1, *size, file_ptr);
+    fclose(file_ptr);
+    return bytes;
+}
+
+static int compare_names(const void* a, const void* b)
+{
+    return strcmp(((const Test_Case*)a)->name, ((const Test_Case*)b)->name);
+}
+
+// the .asm files of dir, assembled into a .bin next to them, returns how many were found
+uint32_t load_asm_tests(const char* dir, Test_Case** cases, uint32_t* capacity, uint32_t* assembled)
+{
+    DIR* directory = opendir(dir);
+    if (directory == NULL)
+    {
+        printf("ERROR - could not open the tests folder %s\n", dir);
+        return 0;
+    }
+
+    uint32_t count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(directory)) != NULL)
+    {
+        size_t length = strlen(entry->d_name);
+        if (length < 5 || length >= TEST_MAX_NAME - 64 || strcmp(entry->d_name + length -4, ".asm") != 0)
+            continue;
+
+        if (count == *capacity)
+        {
+            *capacity = *capacity ? *capacity * 2 : 16;
+            *cases    = (Test_Case*)realloc(*cases, sizeof(Test_Case) * *capacity);
+        }
+        Test_Case* test = &(*cases)[count++];
+        memset(test, 0, sizeof(Test_Case));
+        snprintf(test->name, TEST_MAX_NAME, "%.*s", (int)(length -4), entry->d_name);
+        snprintf(test->asm_path, TEST_MAX_NAME, "%s/%s", dir, entry->d_name);
+    }
+    closedir(directory);
+    qsort(*cases, count, sizeof(Test_Case), compare_names);
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        Test_Case* test = &(*cases)[i];
+        char bin_path[TEST_MAX_NAME * 2];
+        snprintf(bin_path, sizeof(bin_path), "%s/%s.bin", dir, test->name);
+
+        if (needs_assembling(test->asm_path, bin_path))
+        {
+            char command[TEST_MAX_NAME * 4];
+            snprintf(command, sizeof(command), "nasm -f bin \"%s\" -o \"%s\"", test->asm_path, bin_path);
+            if (system(command) != 0)
+            {
+                snprintf(test->error, TEST_MAX_ERROR, "nasm could not assemble %.120s", test->asm_path);
+                continue;
+            }
+            ++*assembled;
+        }
+
+        test->bytes = load_bytes(bin_path, &test->size);
+        if (test->bytes == NULL)
+            snprintf(test->error, TEST_MAX_ERROR, "could not read %.120s", bin_path);
+    }
+    return count;
+}
+
+/*==========================================
+  Generated cases
+  A random table entry with random field values is
+  encoded, the decoder then says how many of the
+  bytes belong to it. Prefixes and rep are left out,
+  they take the next instruction with them, and esc
+  has no operands printed for it yet
+  ========================================*/
+static inline uint32_t case_random(uint64_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (uint32_t)(*state >> 32);
+}
+
+void generate_case(Test_Case* test, const uint32_t number, const uint64_t seed)
+{
+    uint64_t rng = (seed + number) * 0x9E3779B97F4A7C15ull + 1;
+
+    Memory scratch = {0};
+    memory_init(&scratch, MEMORY_PAGE_SIZE);
+
+    memset(test, 0, sizeof(Test_Case));
+    snprintf(test->name, TEST_MAX_NAME, "generated_%u", number);
+    test->bytes = (uint8_t*)malloc(GENERATED_CASE_INSTS * MAX_INSTRUCTION_BYTES);
+
+    for (uint32_t n = 0; n < GENERATED_CASE_INSTS;)
+    {
+        Instruction_Code inst = instruction_table[case_random(&rng) % array_count(instruction_table)];
+        if (inst.type == Op_rep || inst.type == Op_lock || inst.type == Op_esc || (inst.type >= Op_es && inst.type <= Op_ds))
+            continue;
+
+        for (uint8_t i = 1; i < MAX_BITS_FIELD && inst.field[i].usage != Not_Used; ++i)
+            if (inst.field[i].usage != Bits_Literal)
+                inst.field[i].value = (uint8_t)(case_random(&rng) & ((1 << inst.field[i].count) -1));
+
+        uint8_t bytes[MAX_INSTRUCTION_BYTES];
+        encode_instruction(&inst, bytes);
+        memory_copy_in(&scratch, 0, bytes, MAX_INSTRUCTION_BYTES);
+
+        Instruction_Code decoded;
+        uint32_t length = decode_fields(&scratch, 0, op_code_lookup(bytes[0]), &decoded);
+        memcpy(test->bytes + test->size, bytes, length);
+        test->size += length;
+        ++n;
+    }
+    free_memory(&scratch);
+}
+
+/*==========================================
+  Running
+  ========================================*/
+static bool nasm_round_trip(Test_Case* test, const char* text, const size_t text_size, const char* scratch_dir)
+{
+    char listing[TEST_MAX_NAME * 2];
+    char reassembled[TEST_MAX_NAME * 2];
+    snprintf(listing, sizeof(listing), "%s/%s_disassembled.asm", scratch_dir, test->name);
+    snprintf(reassembled, sizeof(reassembled), "%s/%s_reassembled.bin", scratch_dir, test->name);
+
+    FILE* file_ptr = fopen(listing, "w");
+    if (file_ptr == NULL)
+    {
+        snprintf(test->error, TEST_MAX_ERROR, "could not write %.120s", listing);
+        return false;
+    }
+    fprintf(file_ptr, "bits 16\n\n");
+    fwrite(text, 1, text_size, file_ptr);
+    fclose(file_ptr);
+
+    char command[TEST_MAX_NAME * 5];
+    snprintf(command, sizeof(command), "nasm -f bin \"%s\" -o \"%s\"", listing, reassembled);
+    bool passed = false;
+    if (system(command) != 0)
+        snprintf(test->error, TEST_MAX_ERROR, "nasm could not assemble the disassembly");
+    else
+    {
+        uint32_t size  = 0;
+        uint8_t* bytes = load_bytes(reassembled, &size);
+        passed         = bytes != NULL && size == test->size && memcmp(bytes, test->bytes, size) == 0;
+        if (!passed)
+            snprintf(test->error, TEST_MAX_ERROR, "nasm reassembled the disassembly into different bytes");
+        free(bytes);
+    }
+
+    remove(listing);
+    remove(reassembled);
+    return passed;
+}
+
+// chunks this small mostly start inside an instruction, so the stitching has to resync them
+static bool parallel_round_trip(Test_Case* test, Memory* memory, const char* text, const size_t text_size, const uint32_t chunk_count)
+{
+    char* parallel_text     = NULL;
+    size_t parallel_size    = 0;
+    Decode_Unit* d_unit     = decode_unit_init();
+    d_unit->out             = open_memstream(&parallel_text, &parallel_size);
+    Parallel_Stats stats;
+    parallel_disassembly(memory, d_unit, chunk_count, &stats);
+    fclose(d_unit->out);
+    free(d_unit);
+    test->misaligned_chunks = stats.misaligned_chunks;
+
+    size_t at = 0;
+    while (at < text_size && at < parallel_size && text[at] == parallel_text[at])
+        ++at;
+    bool passed = at == text_size && at == parallel_size;
+    if (!passed)
+        snprintf(test->error, TEST_MAX_ERROR, "the parallel listing over %u chunks differs at byte %zu", stats.chunk_count, at);
+    free(parallel_text);
+    return passed;
+}
+
+void run_test(Test_Case* test, const Test_Pool* pool)
+{
+    Memory memory = {0};
+    memory_init(&memory, test->size + MEMORY_READ_SLACK > MEMORY_SIZE ? test->size + MEMORY_READ_SLACK : MEMORY_SIZE);
+    memory_copy_in(&memory, 0, test->bytes, test->size);
+    memory.bytes_used = test->size;
+
+    char* text          = NULL;
+    size_t text_size    = 0;
+    Decode_Unit* d_unit = decode_unit_init();
+    d_unit->out         = open_memstream(&text, &text_size);
+
+    Timer timer;
+    start_timer(&timer);
+    test->passed = true;
+    for (uint32_t at = 0; at < test->size;)
+    {
+        int32_t index = op_code_find(test->bytes[at]);
+        if (index == -1)
+        {
+            snprintf(test->error, TEST_MAX_ERROR, "unknown op code %02x at %u", test->bytes[at], at);
+            test->passed = false;
+            break;
+        }
+
+        uint32_t length = decode_instruction(&memory, d_unit, at, index, NULL);
+        uint8_t encoded[MAX_INSTRUCTION_BYTES];
+        uint32_t encoded_length = encode_instruction(&d_unit->last_inst, encoded);
+        if (encoded_length != length || at + length > test->size || memcmp(encoded, test->bytes + at, length) != 0)
+        {
+            snprintf(test->error, TEST_MAX_ERROR, "%s at %u decoded as %u bytes, encoded again as %u bytes that differ",
+                     instruction_string(d_unit->last_inst.type), at, length, encoded_length);
+            test->passed = false;
+            break;
+        }
+        at += length;
+        ++test->instructions;
+    }
+    end_timer(&timer);
+    test->nano = timer_nano(&timer);
+    fclose(d_unit->out);
+
+    if (test->passed && pool->parallel_chunks > 0)
+        test->passed = parallel_round_trip(test, &memory, text, text_size, pool->parallel_chunks);
+    if (test->passed && pool->nasm_check)
+        test->passed = nasm_round_trip(test, text, text_size, pool->scratch_dir);
+
+    free(text);
+    free(d_unit);
+    free_memory(&memory);
+}
+
+static void* test_worker(void* arg)
+{
+    Test_Pool* pool = (Test_Pool*)arg;
+    for (;;)
+    {
+        uint32_t i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+        if (i >= pool->count)
+            break;
+        if (i >= pool->asm_count)
+            generate_case(&pool->cases[i], i - pool->asm_count, pool->seed);
+        // a case that failed to load keeps its error and is never run
+        if (pool->cases[i].bytes != NULL)
+            run_test(&pool->cases[i], pool);
+    }
+    return NULL;
+}
+
+static void print_test(const Test_Case* test)
+{
+    if (test->passed)
+        printf("  PASS - %-28s %6u instructions %8u bytes %10.1f us\n", test->name, test->instructions, test->size, test->nano / 1e3);
+    else
+        printf("  FAIL - %-28s %s\n", test->name, test->error);
+}
+
+/*==========================================
+  Control flow check
+  Nested loops where the outer one has two back
+  edges, the jnz to its header and the closing
+  loop. Its trip count is only found when the
+  loop is taken as the latch
+  ========================================*/
+static const uint8_t nested_loops[] =
+{
+    0xB9, 0x05, 0x00, //        mov cx, 5
+    0xBA, 0x03, 0x00, // outer: mov dx, 3
+    0x83, 0xC0, 0x01, // inner: add ax, 1
+    0x4A,             //        dec dx
+    0x75, 0xFA,       //        jnz inner
+    0xF6, 0xC3, 0x01, //        test bl, 1
+    0x75, 0xF2,       //        jnz outer
+    0x43,             //        inc bx
+    0xE2, 0xEF,       //        loop outer
+    0xF4              //        hlt
+};
+
+static const char* nested_loops_expected[] =
+{
+    "10 instructions: 6 blocks, 8 edges, 2 loops",
+    "loop at ip 6, depth 2, ",
+    "loop at ip 3, depth 1, ",
+    ", 5 iterations ",
+};
+
+void control_flow_check(Test_Case* test)
+{
+    memset(test, 0, sizeof(Test_Case));
+    snprintf(test->name, TEST_MAX_NAME, "control_flow_nested_loops");
+    test->size = sizeof(nested_loops);
+
+    Memory memory = {0};
+    memory_init(&memory, MEMORY_SIZE);
+    memory_copy_in(&memory, 0, nested_loops, sizeof(nested_loops));
+    memory.bytes_used = sizeof(nested_loops);
+
+    char* text          = NULL;
+    size_t text_size    = 0;
+    Decode_Unit* d_unit = decode_unit_init();
+    d_unit->out         = open_memstream(&text, &text_size);
+
+    Timer timer;
+    start_timer(&timer);
+    control_flow_report(&memory, d_unit);
+    end_timer(&timer);
+    test->nano = timer_nano(&timer);
+    fclose(d_unit->out);
+
+    test->passed = true;
+    for (uint32_t i = 0; i < array_count(nested_loops_expected); ++i)
+        if (strstr(text, nested_loops_expected[i]) == NULL)
+        {
+            snprintf(test->error, TEST_MAX_ERROR, "the report is missing \"%s\"", nested_loops_expected[i]);
+            test->passed = false;
+            break;
+        }
+    test->instructions = 10;
+
+    free(text);
+    free(d_unit);
+    free_memory(&memory);
+}
+
+/*==========================================
+  Encoding sweep
+  Every op code byte with every mod reg rm byte and
+  SWEEP_PATTERNS fillers for the displacement and
+  data bytes, each decoded on its own. The forms are
+  split over forked workers writing into a shared
+  mapping: an assert only takes its worker down, the
+  form it was on is marked crashed and a new worker
+  carries on after it
+  ========================================*/
+#define SWEEP_PATTERNS   5
+#define SWEEP_FORMS      (256 * 256 * SWEEP_PATTERNS)
+#define SWEEP_SLOWEST    8
+#define SWEEP_RUNS       3
+
+static const uint8_t sweep_fillers[SWEEP_PATTERNS] = {0x00, 0x01, 0x7F, 0x80, 0xFF};
+
+typedef enum : uint8_t
+{
+    SWEEP_PENDING,
+    SWEEP_DECODED,
+    SWEEP_UNKNOWN,
+    SWEEP_CRASHED
+} Sweep_Status;
+
+typedef struct
+{
+    Sweep_Status status;
+    uint8_t length;
+    uint16_t type;  // Operation_Type after construction
+    uint32_t nano;
+} Sweep_Form;
+
+static inline void sweep_form_bytes(const uint32_t form, uint8_t* bytes)
+{
+    bytes[0] = (uint8_t)(form / (256 * SWEEP_PATTERNS));
+    bytes[1] = (uint8_t)(form / SWEEP_PATTERNS);
+    memset(bytes + 2, sweep_fillers[form % SWEEP_PATTERNS], MAX_INSTRUCTION_BYTES -2);
+}
+
+static void sweep_worker(Sweep_Form* forms, volatile uint32_t* progress, const uint32_t begin, const uint32_t end)
+{
+    // the parent reports the asserts, their messages would only bury the summary
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDERR_FILENO);
+
+    Memory memory = {0};
+    memory_init(&memory, MEMORY_PAGE_SIZE);
+    memory.bytes_used   = MAX_INSTRUCTION_BYTES;
+    Decode_Unit* d_unit = decode_unit_init();
+    d_unit->out         = fdopen(null_fd, "w");
+
+    for (uint32_t form = begin; form < end; ++form)
+    {
+        *progress = form;
+        uint8_t bytes[MAX_INSTRUCTION_BYTES];
+        sweep_form_bytes(form, bytes);
+        memory_copy_in(&memory, 0, bytes, MAX_INSTRUCTION_BYTES);
+
+        int32_t index = op_code_find(bytes[0]);
+        if (index == -1)
+        {
+            forms[form].status = SWEEP_UNKNOWN;
+            continue;
+        }
+
+        // the fastest of a few decodes, a worker can be switched out in the middle of one
+        uint64_t fastest = UINT64_MAX;
+        uint32_t length  = 0;
+        for (uint32_t run = 0; run < SWEEP_RUNS; ++run)
+        {
+            d_unit->segment_override = -1;
+            Timer timer;
+            start_timer(&timer);
+            length = decode_instruction(&memory, d_unit, 0, index, NULL);
+            end_timer(&timer);
+            if (timer_nano(&timer) < fastest)
+                fastest = timer_nano(&timer);
+        }
+
+        forms[form].length = (uint8_t)length;
+        forms[form].type   = d_unit->last_inst.type;
+        forms[form].nano   = (uint32_t)fastest;
+        forms[form].status = SWEEP_DECODED;
+    }
+    fflush(d_unit->out);
+    _exit(0);
+}
+
+// op code bytes as ranges, 60-6f d8
+static void print_byte_ranges(const bool* set)
+{
+    for (uint32_t b = 0; b < 256; ++b)
+    {
+        if (!set[b])
+            continue;
+        uint32_t last = b;
+        while (last +1 < 256 && set[last +1])
+            ++last;
+        if (last == b)
+            printf(" %02x", b);
+        else
+            printf(" %02x-%02x", b, last);
+        b = last;
+    }
+    printf("\n");
+}
+
+uint32_t encoding_sweep(uint32_t worker_count)
+{
+    Sweep_Form* forms = (Sweep_Form*)mmap(NULL, sizeof(Sweep_Form) * SWEEP_FORMS, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    uint32_t* progress = (uint32_t*)mmap(NULL, sizeof(uint32_t) * worker_count, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    assert(forms != MAP_FAILED && progress != MAP_FAILED && "ERROR - could not map the sweep results\n");
+
+    pid_t* pids      = (pid_t*)malloc(sizeof(pid_t) * worker_count);
+    uint32_t* ends   = (uint32_t*)malloc(sizeof(uint32_t) * worker_count);
+    uint32_t restarts = 0;
+    fflush(stdout);
+
+    Timer timer;
+    start_timer(&timer);
+    for (uint32_t w = 0; w < worker_count; ++w)
+    {
+        uint32_t begin = (uint32_t)((uint64_t)SWEEP_FORMS * w / worker_count);
+        ends[w]        = (uint32_t)((uint64_t)SWEEP_FORMS * (w +1) / worker_count);
+        progress[w]    = begin;
+        pids[w]        = fork();
+        if (pids[w] == 0)
+            sweep_worker(forms, &progress[w], begin, ends[w]);
+    }
+
+    uint32_t running = worker_count;
+    while (running > 0)
+    {
+        int status;
+        pid_t pid = wait(&status);
+        if (pid == -1)
+            break;
+
+        uint32_t w = 0;
+        while (w < worker_count && pids[w] != pid)
+            ++w;
+        if (w == worker_count)
+            continue;
+
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        {
+            --running;
+            continue;
+        }
+
+        forms[progress[w]].status = SWEEP_CRASHED;
+        uint32_t resume = progress[w] +1;
+        if (resume >= ends[w])
+        {
+            --running;
+            continue;
+        }
+        ++restarts;
+        progress[w] = resume;
+        pids[w]     = fork();
+        if (pids[w] == 0)
+            sweep_worker(forms, &progress[w], resume, ends[w]);
+    }
+    end_timer(&timer);
+
+    uint32_t type_forms[Op_Count] = {0};
+    uint64_t type_nano[Op_Count]  = {0};
+    uint32_t type_max[Op_Count]   = {0};
+    uint8_t type_lengths[Op_Count] = {0}; // bit per length
+    uint32_t status_count[4]      = {0};
+    bool unknown_bytes[256]       = {0};
+    uint32_t crashed_per_byte[256] = {0};
+    uint32_t slowest[SWEEP_SLOWEST];
+    uint32_t slowest_count = 0;
+    uint32_t first_crash   = UINT32_MAX;
+
+    for (uint32_t form = 0; form < SWEEP_FORMS; ++form)
+    {
+        const Sweep_Form* f = &forms[form];
+        const uint8_t op    = (uint8_t)(form / (256 * SWEEP_PATTERNS));
+        ++status_count[f->status];
+        if (f->status == SWEEP_UNKNOWN)
+            unknown_bytes[op] = true;
+        else if (f->status == SWEEP_CRASHED)
+        {
+            ++crashed_per_byte[op];
+            if (first_crash == UINT32_MAX)
+                first_crash = form;
+        }
+        if (f->status != SWEEP_DECODED)
+            continue;
+
+        ++type_forms[f->type];
+        type_nano[f->type]    += f->nano;
+        type_lengths[f->type] |= (uint8_t)(1 << f->length);
+        if (f->nano > type_max[f->type])
+            type_max[f->type] = f->nano;
+
+        // insertion into the few slowest so far
+        uint32_t at = slowest_count < SWEEP_SLOWEST ? slowest_count++ : SWEEP_SLOWEST;
+        while (at > 0 && forms[slowest[at -1]].nano < f->nano)
+        {
+            if (at < SWEEP_SLOWEST)
+                slowest[at] = slowest[at -1];
+            --at;
+        }
+        if (at < SWEEP_SLOWEST)
+            slowest[at] = form;
+    }
+
+    printf("; %u forms (%u patterns after every op code and mod reg rm byte) in %.2f ms on %u workers, %u restarted after a crash\n",
+           SWEEP_FORMS, SWEEP_PATTERNS, timer_nano(&timer) / 1e6, worker_count, restarts);
+    printf("; decoded %u, unknown op code %u, crashed %u\n", status_count[SWEEP_DECODED], status_count[SWEEP_UNKNOWN], status_count[SWEEP_CRASHED]);
+
+    printf("\n%-8s %8s %8s %9s %9s\n", "type", "forms", "lengths", "avg ns", "max ns");
+    for (uint32_t type = 0; type < Op_Count; ++type)
+    {
+        if (type_forms[type] == 0)
+            continue;
+        char lengths[16] = {0};
+        uint32_t n       = 0;
+        for (uint32_t l = 1; l <= MAX_INSTRUCTION_BYTES; ++l)
+            if (type_lengths[type] & (1 << l))
+                n += snprintf(lengths + n, sizeof(lengths) - n, "%s%u", n ? "," : "", l);
+        printf("%-8s %8u %8s %9.1f %9u\n", instruction_string((Operation_Type)type), type_forms[type], lengths,
+               (double)type_nano[type] / type_forms[type], type_max[type]);
+    }
+
+    printf("\nnever decoded:");
+    for (uint32_t type = 0; type < Op_Count; ++type)
+        if (type_forms[type] == 0)
+            printf(" %s", instruction_string((Operation_Type)type));
+    printf("\nunknown op codes:");
+    print_byte_ranges(unknown_bytes);
+
+    if (status_count[SWEEP_CRASHED] != 0)
+    {
+        printf("crashed (op code: forms):");
+        for (uint32_t b = 0; b < 256; ++b)
+            if (crashed_per_byte[b] != 0)
+                printf(" %02x: %u", b, crashed_per_byte[b]);
+        uint8_t bytes[MAX_INSTRUCTION_BYTES];
+        sweep_form_bytes(first_crash, bytes);
+        printf("\nfirst crash:");
+        for (uint32_t i = 0; i < MAX_INSTRUCTION_BYTES; ++i)
+            printf(" %02x", bytes[i]);
+        printf("\n");
+    }
+
+    printf("\nslowest forms:\n");
+    for (uint32_t i = 0; i < slowest_count; ++i)
+    {
+        uint8_t bytes[MAX_INSTRUCTION_BYTES];
+        sweep_form_bytes(slowest[i], bytes);
+        printf("  %-8s %6u ns:", instruction_string((Operation_Type)forms[slowest[i]].type), forms[slowest[i]].nano);
+        for (uint32_t b = 0; b < forms[slowest[i]].length; ++b)
+            printf(" %02x", bytes[b]);
+        printf("\n");
+    }
+
+    uint32_t crashed = status_count[SWEEP_CRASHED];
+    munmap(progress, sizeof(uint32_t) * worker_count);
+    munmap(forms, sizeof(Sweep_Form) * SWEEP_FORMS);
+    free(ends);
+    free(pids);
+    return crashed;
+}
+
+int main(int argc, char* argv[])
+{
+    // flags can be combined, the tests folder is the last argument when given
+    const char* dir         = "tests";
+    uint32_t generate_count = 0;
+    uint64_t seed           = 1;
+    uint32_t thread_count   = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+    bool verbose            = false;
+    bool sweep              = false;
+    Test_Pool pool          = {0};
+    pool.scratch_dir        = "/tmp";
+    pool.parallel_chunks    = 8;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-generate") == 0 && i +1 < argc)
+            generate_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-seed") == 0 && i +1 < argc)
+            seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-threads") == 0 && i +1 < argc)
+            thread_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-parallel") == 0 && i +1 < argc)
+            pool.parallel_chunks = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-nasm") == 0)
+            pool.nasm_check = true;
+        else if (strcmp(argv[i], "-v") == 0)
+            verbose = true;
+        else if (strcmp(argv[i], "-sweep") == 0)
+            sweep = true;
+        else if (i == argc -1 && argv[i][0] != '-')
+            dir = argv[i];
+        else
+        {
+            printf("ERROR - Unknown flag %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (thread_count == 0)
+        thread_count = 1;
+    if (sweep)
+        return encoding_sweep(thread_count) != 0;
+
+    Timer total;
+    start_timer(&total);
+
+    Timer timer;
+    start_timer(&timer);
+    Test_Case* cases   = NULL;
+    uint32_t capacity  = 0;
+    uint32_t assembled = 0;
+    uint32_t asm_count = load_asm_tests(dir, &cases, &capacity, &assembled);
+
+    pool.count     = asm_count + generate_count;
+    pool.asm_count = asm_count;
+    pool.seed      = seed;
+    if (pool.count > capacity)
+        cases = (Test_Case*)realloc(cases, sizeof(Test_Case) * pool.count);
+    pool.cases = cases;
+    end_timer(&timer);
+    uint64_t load_nano = timer_nano(&timer);
+
+    start_timer(&timer);
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * thread_count);
+    for (uint32_t i = 0; i < thread_count; ++i)
+        pthread_create(&threads[i], NULL, test_worker, &pool);
+    for (uint32_t i = 0; i < thread_count; ++i)
+        pthread_join(threads[i], NULL);
+    end_timer(&timer);
+    uint64_t run_nano = timer_nano(&timer);
+
+    uint32_t passed            = 0;
+    uint64_t generated_nano    = 0;
+    uint64_t generated_insts   = 0;
+    uint32_t misaligned_chunks = 0;
+    const Test_Case* slowest   = NULL;
+    for (uint32_t i = 0; i < pool.count; ++i)
+    {
+        const Test_Case* test = &cases[i];
+        passed += test->passed;
+        misaligned_chunks += test->misaligned_chunks;
+        if (i < asm_count || verbose || !test->passed)
+            print_test(test);
+        if (i >= asm_count)
+        {
+            generated_nano  += test->nano;
+            generated_insts += test->instructions;
+            if (slowest == NULL || test->nano > slowest->nano)
+                slowest = test;
+        }
+    }
+    if (pool.parallel_chunks > 0)
+        printf("  parallel listings over %u chunks, %u chunk starts fell inside an instruction\n", pool.parallel_chunks, misaligned_chunks);
+
+    Test_Case flow;
+    control_flow_check(&flow);
+    print_test(&flow);
+    passed += flow.passed;
+
+    if (generate_count > 0)
+        printf("  %u generated cases, %lu instructions, %.1f us on average, slowest %s at %.1f us\n", generate_count,
+               generated_insts, generated_nano / 1e3 / generate_count, slowest->name, slowest->nano / 1e3);
+
+    for (uint32_t i = 0; i < pool.count; ++i)
+        free(cases[i].bytes);
+    free(cases);
+    free(threads);
+    end_timer(&total);
+
+    printf("\nload %.2f ms (%u assembled), run %.2f ms on %u threads, total %.2f ms\n", load_nano / 1e6, assembled,
+           run_nano / 1e6, thread_count, timer_nano(&total) / 1e6);
+    printf("Results: %u passed, %u failed\n", passed, pool.count +1 - passed);
+    return passed != pool.count +1;
+}
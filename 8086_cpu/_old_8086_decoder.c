@@ -1,6 +1,7 @@
 /* =================================================================
     8086 instruction decoder
     outputs the assembly instructions for a given binary file containing 8086 machine code,
+    with -DOLD_DECODER_LIBRARY there is no main and only old_decode_stream is exported
     ================================================================== */
 
 #include <stdio.h>
@@ -8,8 +9,11 @@
 #include <string.h>
 #include <stdint.h>
 #include <assert.h>
+#ifndef OLD_DECODER_LIBRARY
 #define PAP_HELPER_IMPLEMENTATION
+#endif
 #include "../pap_helper.h"
+#include "8086_decode_backend.h"
 
 #define WORD_BIT      (1<<0)
 #define DIRECTION_BIT (1<<1)
@@ -53,7 +57,7 @@ typedef enum
 
 } CONDITIONAL_RET;
 
-char* conditional_ret_string(CONDITIONAL_RET inst)
+static char* conditional_ret_string(CONDITIONAL_RET inst)
 {
     switch (inst)
     {
@@ -107,7 +111,7 @@ static inline uint8_t bit_check(const uint8_t byte, const uint8_t bit_check)
     return byte & (1<<bit_check) ? 1 : 0;
 }
 
-Instruction instruction_from_byte(uint8_t byte)
+static Instruction instruction_from_byte(uint8_t byte)
 {
     //print_binary_8(byte);
 
@@ -315,7 +319,7 @@ static inline short high_low_combine_unsigned(uint8_t low, uint8_t high)
     return ((high << 8) | low);
 }
 
-char* instruction_string(Instruction inst)
+static char* instruction_string(Instruction inst)
 {
     switch (inst)
     {
@@ -353,7 +357,7 @@ typedef enum
 
 
 
-char* register_address_string(REG_Address address)
+static char* register_address_string(REG_Address address)
 {
     switch(address)
     {
@@ -394,7 +398,7 @@ char* register_address_string(REG_Address address)
     }
 }
 
-char* effective_address_calculation(REG_Address rm_value)
+static char* effective_address_calculation(REG_Address rm_value)
 {
     switch(rm_value)
     {
@@ -485,7 +489,7 @@ typedef struct
 #define RM_NO_DISP_EXCEPTION 0b00000110
 
 
-char* math_op_type_string(Assembly_Inst* inst)
+static char* math_op_type_string(Assembly_Inst* inst)
 {
     switch (inst->math_typ)
     {
@@ -499,7 +503,7 @@ char* math_op_type_string(Assembly_Inst* inst)
     assert(0);
 }
 
-void mod_reg_rm_byte(const uint8_t read_byte, Assembly_Inst* inst)
+static void mod_reg_rm_byte(const uint8_t read_byte, Assembly_Inst* inst)
 {
     inst->operand_1 = read_byte & REG_BITMASK;
     inst->operand_1 >>= 3;
@@ -519,7 +523,7 @@ static inline Math_typ math_op_type(const uint8_t read_byte)
 /* ===================================================
    MATH OP - Register/Memory with either
    =================================================*/
-void math_op_reg_mem_either(const uint8_t read_byte, Assembly_Inst* inst)
+static void math_op_reg_mem_either(const uint8_t read_byte, Assembly_Inst* inst)
 {
     switch (inst->byte_count)
     {
@@ -561,32 +565,37 @@ void math_op_reg_mem_either(const uint8_t read_byte, Assembly_Inst* inst)
         break;
     }
 }
-void print_math_op_reg_mem_either(Assembly_Inst* inst)
+static void print_math_op_reg_mem_either(FILE* out, Assembly_Inst* inst)
 {
     switch (inst->mod)
     {
     case REGISTER_MODE:
-        printf("%s %s, %s\n", math_op_type_string(inst),
-               register_address_string((inst->inst_flags & DIRECTION_BIT_ON) ? inst->operand_1 : inst->operand_2_rm),
-               register_address_string((inst->inst_flags & DIRECTION_BIT_ON) ? inst->operand_2_rm : inst->operand_1));
+        fprintf(out, "%s %s, %s\n", math_op_type_string(inst),
+                register_address_string((inst->inst_flags & DIRECTION_BIT_ON) ? inst->operand_1 : inst->operand_2_rm),
+                register_address_string((inst->inst_flags & DIRECTION_BIT_ON) ? inst->operand_2_rm : inst->operand_1));
         break;
     case NO_DISPLACEMENT:
         if (inst->operand_2_rm == RM_NO_DISP_EXCEPTION || inst->operand_2_rm == (RM_NO_DISP_EXCEPTION | WORD_VAULE_ON))
         {
-            printf("%s %s, [%hu]\n", math_op_type_string(inst),
-                   register_address_string((inst->inst_flags & DIRECTION_BIT_ON) ? inst->operand_1 : inst->operand_2_rm), high_low_combine_unsigned(inst->disp_l, inst->disp_h));
+            // direct address, the reg field is the only register either way round
+            if (inst->inst_flags & DIRECTION_BIT_ON)
+                fprintf(out, "%s %s, [%hu]\n", math_op_type_string(inst),
+                        register_address_string(inst->operand_1), high_low_combine_unsigned(inst->disp_l, inst->disp_h));
+            else
+                fprintf(out, "%s [%hu], %s\n", math_op_type_string(inst),
+                        high_low_combine_unsigned(inst->disp_l, inst->disp_h), register_address_string(inst->operand_1));
         }
         else
         {
             if (inst->inst_flags & DIRECTION_BIT_ON)
             {
-                printf("%s %s, [%s]\n", math_op_type_string(inst), register_address_string(inst->operand_1),
-                       effective_address_calculation(inst->operand_2_rm));
+                fprintf(out, "%s %s, [%s]\n", math_op_type_string(inst), register_address_string(inst->operand_1),
+                        effective_address_calculation(inst->operand_2_rm));
             }
             else
             {
-                printf("%s [%s], %s\n", math_op_type_string(inst),
-                       effective_address_calculation(inst->operand_2_rm), register_address_string(inst->operand_1));
+                fprintf(out, "%s [%s], %s\n", math_op_type_string(inst),
+                        effective_address_calculation(inst->operand_2_rm), register_address_string(inst->operand_1));
             }
         }
         break;
@@ -594,13 +603,13 @@ void print_math_op_reg_mem_either(Assembly_Inst* inst)
     case _16_BIT_DISPLACEMENT:
         if (inst->inst_flags & DIRECTION_BIT_ON)
         {
-            printf("%s %s, [%s + %hd]\n", math_op_type_string(inst),
-                   register_address_string((inst->inst_flags & DIRECTION_BIT_ON) ? inst->operand_1 : inst->operand_2_rm), effective_address_calculation((inst->inst_flags & DIRECTION_BIT_ON) ? inst->operand_2_rm : inst->operand_1), high_low_combine_signed(inst->disp_l, inst->disp_h));
+            fprintf(out, "%s %s, [%s + %hd]\n", math_op_type_string(inst),
+                    register_address_string((inst->inst_flags & DIRECTION_BIT_ON) ? inst->operand_1 : inst->operand_2_rm), effective_address_calculation((inst->inst_flags & DIRECTION_BIT_ON) ? inst->operand_2_rm : inst->operand_1), high_low_combine_signed(inst->disp_l, inst->disp_h));
         }
         else
         {
-            printf("%s [%s + %hd], %s\n", math_op_type_string(inst),
-                   effective_address_calculation(inst->operand_2_rm), high_low_combine_signed(inst->disp_l, inst->disp_h), register_address_string(inst->operand_1));
+            fprintf(out, "%s [%s + %hd], %s\n", math_op_type_string(inst),
+                    effective_address_calculation(inst->operand_2_rm), high_low_combine_signed(inst->disp_l, inst->disp_h), register_address_string(inst->operand_1));
         }
         break;
     }
@@ -610,7 +619,7 @@ void print_math_op_reg_mem_either(Assembly_Inst* inst)
    MATH OP - Immediate to memory/register
    =================================================*/
 
-void math_op_imm_reg_mem(const uint8_t read_byte, Assembly_Inst* inst)
+static void math_op_imm_reg_mem(const uint8_t read_byte, Assembly_Inst* inst)
 {
     switch (inst->byte_count)
     {
@@ -717,28 +726,28 @@ void math_op_imm_reg_mem(const uint8_t read_byte, Assembly_Inst* inst)
     }
 }
 
-void print_math_op_imm_reg_mem(Assembly_Inst* inst)
+static void print_math_op_imm_reg_mem(FILE* out, Assembly_Inst* inst)
 {
     switch (inst->mod)
     {
     case REGISTER_MODE:
-        printf("%s %s, %hd\n", math_op_type_string(inst),  register_address_string(inst->operand_1), high_low_combine_signed(inst->data_l, inst->data_h));
+        fprintf(out, "%s %s, %hd\n", math_op_type_string(inst),  register_address_string(inst->operand_2_rm), high_low_combine_signed(inst->data_l, inst->data_h));
         break;
     case NO_DISPLACEMENT:
         if (inst->operand_2_rm == RM_NO_DISP_EXCEPTION || (inst->inst_flags & WORD_BIT_ON && inst->operand_2_rm == (RM_NO_DISP_EXCEPTION | WORD_VAULE_ON)))
         {
-            printf("%s %s [%hd], %hd\n", math_op_type_string(inst),inst->inst_flags & WORD_BIT_ON ? "word" : "byte", high_low_combine_signed(inst->disp_l, inst->disp_h), high_low_combine_signed(inst->data_l, inst->data_h));
+            fprintf(out, "%s %s [%hd], %hd\n", math_op_type_string(inst),inst->inst_flags & WORD_BIT_ON ? "word" : "byte", high_low_combine_signed(inst->disp_l, inst->disp_h), high_low_combine_signed(inst->data_l, inst->data_h));
         }
         else
         {
-            printf("%s %s [%s], %hd\n", math_op_type_string(inst),inst->inst_flags & WORD_BIT_ON ? "word" : "byte",
-                   effective_address_calculation(inst->operand_2_rm), high_low_combine_signed(inst->data_l, inst->data_h));
+            fprintf(out, "%s %s [%s], %hd\n", math_op_type_string(inst),inst->inst_flags & WORD_BIT_ON ? "word" : "byte",
+                    effective_address_calculation(inst->operand_2_rm), high_low_combine_signed(inst->data_l, inst->data_h));
         }
         break;
     case _8_BIT_DISPLACEMENT:
     case _16_BIT_DISPLACEMENT:
-        printf("%s %s [%s + %hd], %hd\n", math_op_type_string(inst),inst->inst_flags & WORD_BIT_ON ? "word" : "byte",
-               effective_address_calculation(inst->operand_2_rm), high_low_combine_signed(inst->disp_l, inst->disp_h),  high_low_combine_signed(inst->data_l, inst->data_h));
+        fprintf(out, "%s %s [%s + %hd], %hd\n", math_op_type_string(inst),inst->inst_flags & WORD_BIT_ON ? "word" : "byte",
+                effective_address_calculation(inst->operand_2_rm), high_low_combine_signed(inst->disp_l, inst->disp_h),  high_low_combine_signed(inst->data_l, inst->data_h));
         break;
     }
 }
@@ -746,7 +755,7 @@ void print_math_op_imm_reg_mem(Assembly_Inst* inst)
 /* ===================================================
    MATH OP - Immediate to accumulator
    =================================================*/
-void math_op_imm_acc_parse(const uint8_t read_byte, Assembly_Inst* inst)
+static void math_op_imm_acc_parse(const uint8_t read_byte, Assembly_Inst* inst)
 {
     switch (inst->byte_count)
     {
@@ -770,7 +779,7 @@ void math_op_imm_acc_parse(const uint8_t read_byte, Assembly_Inst* inst)
 /* ===================================================
    MOV - Accumulator/Memory to memory/accumulator
    =================================================*/
-void mov_accumulator_memory_parse(const uint8_t read_byte, Assembly_Inst* inst)
+static void mov_accumulator_memory_parse(const uint8_t read_byte, Assembly_Inst* inst)
 {
     switch(inst->byte_count)
     {
@@ -794,7 +803,7 @@ void mov_accumulator_memory_parse(const uint8_t read_byte, Assembly_Inst* inst)
 /* ===================================================
    MOV - Immediate to registar/memory
    =================================================*/
-void mov_imm_reg_mem_parse(const uint8_t read_byte, Assembly_Inst* inst)
+static void mov_imm_reg_mem_parse(const uint8_t read_byte, Assembly_Inst* inst)
 {
     switch(inst->byte_count)
     {
@@ -889,30 +898,30 @@ void mov_imm_reg_mem_parse(const uint8_t read_byte, Assembly_Inst* inst)
     }
 }
 
-void print_mov_imm_reg_mem(Assembly_Inst* inst)
+static void print_mov_imm_reg_mem(FILE* out, Assembly_Inst* inst)
 {
     switch (inst->mod)
     {
     case REGISTER_MODE:
-        printf("%s %s, %s %hd\n", instruction_string(inst->inst),
-               register_address_string(inst->operand_1), inst->data_h == 0 ? "byte" : "word", high_low_combine_signed(inst->data_l, inst->data_h));
+        fprintf(out, "%s %s, %s %hd\n", instruction_string(inst->inst),
+                register_address_string(inst->operand_1), inst->data_h == 0 ? "byte" : "word", high_low_combine_signed(inst->data_l, inst->data_h));
         break;
     case NO_DISPLACEMENT:
         if (inst->operand_2_rm == RM_NO_DISP_EXCEPTION)
         {
-            printf("%s [%hd], %s %hd\n", instruction_string(inst->inst),
-                   high_low_combine_signed(inst->disp_l, inst->disp_h), inst->data_h == 0 ? "byte" : "word", high_low_combine_signed(inst->data_l, inst->data_h));
+            fprintf(out, "%s [%hd], %s %hd\n", instruction_string(inst->inst),
+                    high_low_combine_signed(inst->disp_l, inst->disp_h), inst->data_h == 0 ? "byte" : "word", high_low_combine_signed(inst->data_l, inst->data_h));
         }
         else
         {
-            printf("%s [%s], %s %hd\n", instruction_string(inst->inst),
-                   effective_address_calculation(inst->operand_2_rm),inst->data_h == 0 ? "byte" : "word", high_low_combine_signed(inst->data_l, inst->data_h));
+            fprintf(out, "%s [%s], %s %hd\n", instruction_string(inst->inst),
+                    effective_address_calculation(inst->operand_2_rm),inst->data_h == 0 ? "byte" : "word", high_low_combine_signed(inst->data_l, inst->data_h));
         }
         break;
     case _8_BIT_DISPLACEMENT:
     case _16_BIT_DISPLACEMENT:
-        printf("%s [%s + %hd], %s %hd\n", instruction_string(inst->inst),
-               effective_address_calculation(inst->operand_2_rm), high_low_combine_signed(inst->disp_l, inst->disp_h), inst->data_h == 0 ? "byte" : "word", high_low_combine_signed(inst->data_l, inst->data_h));
+        fprintf(out, "%s [%s + %hd], %s %hd\n", instruction_string(inst->inst),
+                effective_address_calculation(inst->operand_2_rm), high_low_combine_signed(inst->disp_l, inst->disp_h), inst->data_h == 0 ? "byte" : "word", high_low_combine_signed(inst->data_l, inst->data_h));
         break;
     }
 }
@@ -921,7 +930,7 @@ void print_mov_imm_reg_mem(Assembly_Inst* inst)
    MOV - Register/memory to/from registar
    =================================================*/
 
-void mov_reg_mem_parse(const uint8_t read_byte, Assembly_Inst* inst)
+static void mov_reg_mem_parse(const uint8_t read_byte, Assembly_Inst* inst)
 {
     switch(inst->byte_count)
     {
@@ -967,39 +976,40 @@ void mov_reg_mem_parse(const uint8_t read_byte, Assembly_Inst* inst)
         inst->inst_flags |= INSTRUCTION_READY;
         break;
     }
-    // printf("op1: ");
-    // print_binary_8(inst.operand_1);
-    // printf("op2: ");
-    // print_binary_8(inst.operand_2_rm);
 }
 
 
-void print_mov_reg_mem(Assembly_Inst* inst)
+static void print_mov_reg_mem(FILE* out, Assembly_Inst* inst)
 {
     switch (inst->mod)
     {
     case REGISTER_MODE:
-        printf("%s %s, %s\n", instruction_string(inst->inst),
-               register_address_string((inst->inst_flags & DIRECTION_BIT_ON) ? inst->operand_1 : inst->operand_2_rm),
-               register_address_string((inst->inst_flags & DIRECTION_BIT_ON) ? inst->operand_2_rm : inst->operand_1));
+        fprintf(out, "%s %s, %s\n", instruction_string(inst->inst),
+                register_address_string((inst->inst_flags & DIRECTION_BIT_ON) ? inst->operand_1 : inst->operand_2_rm),
+                register_address_string((inst->inst_flags & DIRECTION_BIT_ON) ? inst->operand_2_rm : inst->operand_1));
         break;
     case NO_DISPLACEMENT:
         if (inst->operand_2_rm == RM_NO_DISP_EXCEPTION || inst->operand_2_rm == (RM_NO_DISP_EXCEPTION | WORD_VAULE_ON))
         {
-            printf("%s %s, [%hu]\n", instruction_string(inst->inst),
-                   register_address_string((inst->inst_flags & DIRECTION_BIT_ON) ? inst->operand_1 : inst->operand_2_rm), high_low_combine_unsigned(inst->disp_l, inst->disp_h));
+            // direct address, the reg field is the only register either way round
+            if (inst->inst_flags & DIRECTION_BIT_ON)
+                fprintf(out, "%s %s, [%hu]\n", instruction_string(inst->inst),
+                        register_address_string(inst->operand_1), high_low_combine_unsigned(inst->disp_l, inst->disp_h));
+            else
+                fprintf(out, "%s [%hu], %s\n", instruction_string(inst->inst),
+                        high_low_combine_unsigned(inst->disp_l, inst->disp_h), register_address_string(inst->operand_1));
         }
         else
         {
             if (inst->inst_flags & DIRECTION_BIT_ON)
             {
-                printf("%s %s, [%s]\n", instruction_string(inst->inst), register_address_string(inst->operand_1),
-                       effective_address_calculation(inst->operand_2_rm));
+                fprintf(out, "%s %s, [%s]\n", instruction_string(inst->inst), register_address_string(inst->operand_1),
+                        effective_address_calculation(inst->operand_2_rm));
             }
             else
             {
-                printf("%s [%s], %s\n", instruction_string(inst->inst),
-                       effective_address_calculation(inst->operand_2_rm), register_address_string(inst->operand_1));
+                fprintf(out, "%s [%s], %s\n", instruction_string(inst->inst),
+                        effective_address_calculation(inst->operand_2_rm), register_address_string(inst->operand_1));
             }
         }
         break;
@@ -1007,13 +1017,13 @@ void print_mov_reg_mem(Assembly_Inst* inst)
     case _16_BIT_DISPLACEMENT:
         if (inst->inst_flags & DIRECTION_BIT_ON)
         {
-            printf("%s %s, [%s + %hd]\n", instruction_string(inst->inst),
-                   register_address_string((inst->inst_flags & DIRECTION_BIT_ON) ? inst->operand_1 : inst->operand_2_rm), effective_address_calculation((inst->inst_flags & DIRECTION_BIT_ON) ? inst->operand_2_rm : inst->operand_1), high_low_combine_signed(inst->disp_l, inst->disp_h));
+            fprintf(out, "%s %s, [%s + %hd]\n", instruction_string(inst->inst),
+                    register_address_string((inst->inst_flags & DIRECTION_BIT_ON) ? inst->operand_1 : inst->operand_2_rm), effective_address_calculation((inst->inst_flags & DIRECTION_BIT_ON) ? inst->operand_2_rm : inst->operand_1), high_low_combine_signed(inst->disp_l, inst->disp_h));
         }
         else
         {
-            printf("%s [%s + %hd], %s\n", instruction_string(inst->inst),
-                   effective_address_calculation(inst->operand_2_rm), high_low_combine_signed(inst->disp_l, inst->disp_h), register_address_string(inst->operand_1));
+            fprintf(out, "%s [%s + %hd], %s\n", instruction_string(inst->inst),
+                    effective_address_calculation(inst->operand_2_rm), high_low_combine_signed(inst->disp_l, inst->disp_h), register_address_string(inst->operand_1));
         }
         break;
     }
@@ -1025,7 +1035,7 @@ void print_mov_reg_mem(Assembly_Inst* inst)
    MOV - Immediate to registar instruction
    =================================================*/
 #define IMM_REG_BITMASK 0b00000111
-void mov_imm_reg_parse(const uint8_t read_byte, Assembly_Inst* inst)
+static void mov_imm_reg_parse(const uint8_t read_byte, Assembly_Inst* inst)
 {
     switch (inst->byte_count)
     {
@@ -1052,7 +1062,7 @@ void mov_imm_reg_parse(const uint8_t read_byte, Assembly_Inst* inst)
 /* ===================================================
    Conditional Return from CALL
    =================================================*/
-void conditional_ret_inst_parse(const uint8_t read_byte, Assembly_Inst* inst)
+static void conditional_ret_inst_parse(const uint8_t read_byte, Assembly_Inst* inst)
 {
     switch(inst->byte_count)
     {
@@ -1066,25 +1076,23 @@ void conditional_ret_inst_parse(const uint8_t read_byte, Assembly_Inst* inst)
     }
 }
 
-int main(int argc, char* argv[])
+/* ===================================================
+   Stream decode, the byte at a time state machine
+   behind the same interface as the table decoder
+   =================================================*/
+uint32_t old_decode_stream(const uint8_t* bytes, const uint32_t size, FILE* out, uint32_t* boundaries)
 {
-    if (argc < 2)
-    {
-        printf("Args = file path\n");
-        return 0;
-    }
-
-    FILE* file_ptr = fopen(argv[1], "rb");
-
-    uint8_t read_byte;
     Assembly_Inst inst = {0};
+    uint32_t count     = 0;
 
-    printf("; output from encoding %s to assembly\n\nbits 16\n\n", argv[1]);
-    while(fread(&read_byte, 1, 1, file_ptr) > 0)
+    for (uint32_t i = 0; i < size; ++i)
     {
+        const uint8_t read_byte = bytes[i];
         //print_binary_8(read_byte);
         if(inst.byte_count == NEW_INSTRUCTION)
         {
+            if (boundaries != NULL)
+                boundaries[count] = i;
             inst.inst = instruction_from_byte(read_byte);
             switch (inst.inst)
             {
@@ -1158,45 +1166,76 @@ int main(int argc, char* argv[])
             switch (inst.inst)
             {
             case MOV_REG_MEM:
-                print_mov_reg_mem(&inst);
+                print_mov_reg_mem(out, &inst);
                 break;
             case MOV_IMM_REG_MEM:
-                print_mov_imm_reg_mem(&inst);
+                print_mov_imm_reg_mem(out, &inst);
                 break;
             case MOV_IMM_REG:
-                printf("%s %s, %hu\n", instruction_string(inst.inst),
-                       register_address_string(inst.operand_1),
-                       high_low_combine_unsigned(inst.data_l, inst.data_h));
+                fprintf(out, "%s %s, %hu\n", instruction_string(inst.inst),
+                        register_address_string(inst.operand_1),
+                        high_low_combine_unsigned(inst.data_l, inst.data_h));
                 break;
             case MOV_ACC_MEM:
-                printf("%s [%hu], ax\n", instruction_string(inst.inst),
-                       high_low_combine_unsigned(inst.disp_l, inst.disp_h));
+                fprintf(out, "%s [%hu], ax\n", instruction_string(inst.inst),
+                        high_low_combine_unsigned(inst.disp_l, inst.disp_h));
                 break;
             case MOV_MEM_ACC:
-                printf("%s ax, [%hu]\n", instruction_string(inst.inst),
-                       high_low_combine_unsigned(inst.disp_l, inst.disp_h));
+                fprintf(out, "%s ax, [%hu]\n", instruction_string(inst.inst),
+                        high_low_combine_unsigned(inst.disp_l, inst.disp_h));
                 break;
             case MATH_OP_IMM_ACC:
-                printf("%s ax, %u\n", math_op_type_string(&inst),
-                       high_low_combine_unsigned(inst.data_l, inst.data_h));
+                fprintf(out, "%s ax, %u\n", math_op_type_string(&inst),
+                        high_low_combine_unsigned(inst.data_l, inst.data_h));
                 break;
             case MATH_OP_REG_MEM_EITHER:
-                print_math_op_reg_mem_either(&inst);
+                print_math_op_reg_mem_either(out, &inst);
                 break;
             case MATH_OP_IMM_REG_MEM:
-                print_math_op_imm_reg_mem(&inst);
+                print_math_op_imm_reg_mem(out, &inst);
                 break;
             case CONDITIONAL_RET_INST:
-                printf("%s %hd\n", conditional_ret_string(inst.disp_l), inst.disp_h > 127 ? (short)inst.disp_h - 256 : inst.disp_h);
+                fprintf(out, "%s %hd\n", conditional_ret_string(inst.disp_l), inst.disp_h > 127 ? (short)inst.disp_h - 256 : inst.disp_h);
                 break;
             default:
                 assert(0 && "ERROR whilst parsing byte\n");
             }
             memset(&inst, 0, sizeof(Assembly_Inst));
+            ++count;
         }
     }
 
+    return count;
+}
+
+#ifndef OLD_DECODER_LIBRARY
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        printf("Args = file path\n");
+        return 0;
+    }
+
+    FILE* file_ptr = fopen(argv[1], "rb");
+    if (file_ptr == NULL)
+    {
+        printf("ERROR - could not open %s\n", argv[1]);
+        return 1;
+    }
+    fseek(file_ptr, 0, SEEK_END);
+    uint32_t size = (uint32_t)ftell(file_ptr);
+    fseek(file_ptr, 0, SEEK_SET);
+
+    uint8_t* bytes = (uint8_t*)malloc(size);
+    size           = (uint32_t)fread(bytes, 1, size, file_ptr);
     fclose(file_ptr);
+
+    printf("; output from encoding %s to assembly\n\nbits 16\n\n", argv[1]);
+    old_decode_stream(bytes, size, stdout, NULL);
+
+    free(bytes);
     return 0;
 }
+#endif
 
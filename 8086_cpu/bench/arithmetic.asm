@@ -0,0 +1,22 @@
+bits 16
+
+; add / sub / cmp kernel with a data dependent branch, about 6.5 million instructions
+mov dx, 200
+outer_loop_start:
+
+	mov cx, 5000
+	mov ax, 0
+	mov bx, 1
+	kernel_start:
+		add ax, bx
+		add bx, ax
+		sub ax, 7
+		cmp ax, bx
+		jb skip
+		sub ax, bx
+	skip:
+		loop kernel_start
+
+	sub dx, 1
+	jnz outer_loop_start
+
@@ -0,0 +1,40 @@
+bits 16
+org 0x100
+
+; Fletcher style word checksum of a 32KB buffer, 64 passes, about 4 million instructions.
+; The exit code is the low byte of the second sum (128)
+	mov di, buffer
+	mov cx, 16384
+	mov ax, 0x1234
+fill_start:
+	mov [di], ax
+	add ax, ax
+	add ax, 0x3C6F
+	add di, 2
+	loop fill_start
+
+	mov dx, 64
+	mov bx, 0
+	mov bp, 0
+pass_start:
+	mov si, buffer
+	mov cx, 16384
+	sum_start:
+		add bx, [si]
+		add bp, bx
+		add si, 2
+		loop sum_start
+
+	sub dx, 1
+	jne pass_start
+
+	mov dx, done
+	mov ah, 0x09
+	int 0x21
+	mov ax, bp
+	mov ah, 0x4C
+	int 0x21
+
+done:
+	db "checksum done", 13, 10, "$"
+buffer:
@@ -0,0 +1,57 @@
+bits 16
+org 0x100
+
+; 16KB copies, 100 passes each through a word loop and rep movsw, about 4 million instructions.
+; The exit code is the low byte of the source sum minus the destination sum (0)
+	mov di, source
+	mov cx, 8192
+	mov ax, 0x5A5A
+fill_start:
+	mov [di], ax
+	add ax, 0x0F3D
+	add di, 2
+	loop fill_start
+
+	mov dx, 100
+pass_start:
+	mov si, source
+	mov di, source + 0x4000
+	mov cx, 8192
+	copy_start:
+		mov ax, [si]
+		mov [di], ax
+		add si, 2
+		add di, 2
+		loop copy_start
+
+	mov si, source + 0x4000
+	mov di, source + 0x8000
+	mov cx, 8192
+	rep movsw
+
+	sub dx, 1
+	jne pass_start
+
+	mov bp, 0
+	mov bx, 0
+	mov si, source
+	mov di, source + 0x8000
+	mov cx, 8192
+	check_start:
+		add bp, [si]
+		add bx, [di]
+		add si, 2
+		add di, 2
+		loop check_start
+	sub bp, bx
+
+	mov dx, done
+	mov ah, 0x09
+	int 0x21
+	mov ax, bp
+	mov ah, 0x4C
+	int 0x21
+
+done:
+	db "memcpy done", 13, 10, "$"
+source:
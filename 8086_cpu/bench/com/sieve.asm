@@ -0,0 +1,48 @@
+bits 16
+org 0x100
+
+; sieve of Eratosthenes over 8192 word flags, 40 passes, about 5 million instructions.
+; There are 1028 primes below 8192, the exit code is the low byte of the count (4)
+	mov dx, 40
+pass_start:
+	mov di, flags
+	mov cx, 8192
+	mov ax, 0
+	rep stosw
+
+	mov bp, 0
+	mov si, 4                       ; byte offset of 2
+	next_start:
+		mov ax, [si + flags]
+		cmp ax, 0
+		jne composite
+		add bp, 1
+
+		mov bx, si
+		add bx, si
+		cmp bx, 16384
+		jb mark_start
+		jmp composite
+		mark_start:
+			mov word [bx + flags], 1
+			add bx, si
+			cmp bx, 16384
+			jb mark_start
+	composite:
+		add si, 2
+		cmp si, 16384
+		jb next_start
+
+	sub dx, 1
+	jne pass_start
+
+	mov dx, done
+	mov ah, 0x09
+	int 0x21
+	mov ax, bp
+	mov ah, 0x4C
+	int 0x21
+
+done:
+	db "sieve done", 13, 10, "$"
+flags:
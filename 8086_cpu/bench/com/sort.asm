@@ -0,0 +1,67 @@
+bits 16
+org 0x100
+
+; bubble sort of 512 words, refilled and sorted 3 times, about 5.5 million instructions.
+; The values stay below 0x7000, the exit code is the number of pairs still out of order (0)
+	mov dx, 3
+pass_start:
+	mov di, array
+	mov cx, 512
+	mov ax, 0x1234
+	fill_start:
+		mov [di], ax
+		add ax, 0x2B5F
+		cmp ax, 0x7000
+		jb fill_next
+		sub ax, 0x7000
+	fill_next:
+		add di, 2
+		loop fill_start
+
+	mov bp, 511
+	sweep_start:
+		mov si, array
+		mov cx, 511
+		compare_start:
+			mov ax, [si]
+			mov bx, [si + 2]
+			cmp ax, bx
+			jb in_order
+			je in_order
+			mov [si], bx
+			mov [si + 2], ax
+		in_order:
+			add si, 2
+			loop compare_start
+
+		sub bp, 1
+		jne sweep_start
+
+	sub dx, 1
+	jne pass_start
+
+	mov bp, 0
+	mov si, array
+	mov cx, 511
+	check_start:
+		mov ax, [si]
+		mov bx, [si + 2]
+		cmp bx, ax
+		jb out_of_order
+		jmp check_next
+	out_of_order:
+		add bp, 1
+	check_next:
+		add si, 2
+		loop check_start
+
+	mov dx, done
+	mov ah, 0x09
+	int 0x21
+	mov ax, bp
+	mov ah, 0x4C
+	int 0x21
+
+done:
+	db "sort done", 13, 10, "$"
+array:
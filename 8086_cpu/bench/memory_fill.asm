@@ -0,0 +1,20 @@
+bits 16
+
+; 256 passes over a 16KB buffer after the code, about 5 million instructions
+mov dx, 256
+pass_start:
+
+	mov bp, 0x1000
+	mov cx, 4096
+	fill_start:
+		mov word [bp + 0], ax
+		mov byte [bp + 2], dl
+		mov byte [bp + 3], 0x55
+		add bp, 4
+
+		loop fill_start
+
+	add ax, 1
+	sub dx, 1
+	jnz pass_start
+
@@ -0,0 +1,16 @@
+bits 16
+
+; 1000 x 1000 register only iterations, about 3 million instructions
+mov dx, 1000
+outer_loop_start:
+
+	mov cx, 1000
+	inner_loop_start:
+		add ax, 3
+		sub bx, 1
+
+		loop inner_loop_start
+
+	sub dx, 1
+	jnz outer_loop_start
+
@@ -0,0 +1,19 @@
+bits 16
+
+; 8KB block copy and fill with rep, 2000 passes moving about 16 million words
+mov dx, 2000
+copy_start:
+
+	mov si, 0x2000
+	mov di, 0x6000
+	mov cx, 4096
+	rep movsw
+
+	mov di, 0x2000
+	mov cx, 4096
+	mov ax, dx
+	rep stosw
+
+	sub dx, 1
+	jnz copy_start
+
@@ -0,0 +1,87 @@
+#!/bin/bash
+
+# assembles each workload in bench/ (or the one given), checks the backends in lockstep and times them.
+# The DOS programs in bench/com/ run through -com on the interpreter and report their MIPS
+
+FAIL=0
+
+run_bench() {
+    local ASM_FILE=$1
+
+    if [ ! -f "$ASM_FILE" ]; then
+        echo "Error: '$ASM_FILE' not found"
+        exit 1
+    fi
+
+    BASE=$(basename "$ASM_FILE" .asm)
+    DIR=$(dirname "$ASM_FILE")
+    BINARY="$DIR/${BASE}.bin"
+
+    echo "Benchmark: $ASM_FILE"
+
+    nasm -f bin "$ASM_FILE" -o "$BINARY"
+
+    # the backends have to agree before their timings mean anything
+    if ./8086_sim -lockstep -fuse "$BINARY" | grep -q "^Divergence"; then
+        echo "  FAIL - backends diverge on $ASM_FILE, -lockstep prints the first differing instruction"
+        FAIL=$((FAIL + 1))
+        rm -f "$BINARY"
+        return
+    fi
+
+    # only the backend table, the final state is the same for every workload run
+    ./8086_sim -bench "$BINARY" | sed -n '/^backend/,/^$/p'
+
+    rm -f "$BINARY"
+}
+
+run_com() {
+    local ASM_FILE=$1
+
+    BASE=$(basename "$ASM_FILE" .asm)
+    DIR=$(dirname "$ASM_FILE")
+    BINARY="$DIR/${BASE}.com"
+
+    echo "DOS benchmark: $ASM_FILE"
+
+    nasm -f bin "$ASM_FILE" -o "$BINARY"
+
+    START=$(date +%s%N)
+    OUTPUT=$(./8086_sim -com "$BINARY")
+    END=$(date +%s%N)
+
+    # a program stopped on an instruction the simulator doesn't execute has no timing worth reporting
+    if ! echo "$OUTPUT" | grep -q "^Program exited"; then
+        echo "$OUTPUT" | grep -E "^ERROR|^Program"
+        FAIL=$((FAIL + 1))
+        rm -f "$BINARY"
+        return
+    fi
+
+    INSTRUCTIONS=$(echo "$OUTPUT" | sed -n 's/^Instructions executed: \([0-9]*\).*/\1/p')
+    echo "$OUTPUT" | grep "^Program exited"
+    awk -v n="$INSTRUCTIONS" -v ns="$((END - START))" \
+        'BEGIN { printf "  %d instructions in %.3f sec, %.2f MIPS\n", n, ns / 1e9, n / (ns / 1e3) }'
+
+    rm -f "$BINARY"
+}
+
+if [ $# -eq 0 ]; then
+    if [ ! -d "bench" ]; then
+        echo "Error: no argument given and 'bench' folder not found"
+        exit 1
+    fi
+
+    for ASM_FILE in bench/*.asm; do
+        run_bench "$ASM_FILE"
+    done
+    for ASM_FILE in bench/com/*.asm; do
+        run_com "$ASM_FILE"
+    done
+elif [[ "$1" == *com/* ]]; then
+    run_com "$1"
+else
+    run_bench "$1"
+fi
+
+exit $FAIL
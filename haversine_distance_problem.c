@@ -3,6 +3,13 @@
 #define PAP_HELPER_IMPLEMENTATION
 #include "pap_helper.h"
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <immintrin.h>
+#include <pthread.h>
 
 #define EARTH_RADIUS_KM 6371.0
 
@@ -47,19 +54,71 @@ static double rand_double(double min, double max)
 }
 
 
-void create_points_json(uint32_t count)
+// the JSON goes to stdout, the same points are also written to binary_name in the binary
+// layout and the reference distances to answer_name when they aren't NULL (see the binary
+// point file and answer file sections)
+static uint8_t write_points_binary_arrays(const char* binary_name, double* const arrays[4], uint64_t count, uint32_t layout);
+static uint8_t write_answers(const char* answer_name, const double* distances, uint64_t count);
+
+// the JSON goes to stdout, non zero when it or one of the files could not be written in full
+int create_points_json(uint32_t count, const char* binary_name, uint32_t layout, const char* answer_name)
 {
     srand(time(NULL));
+    double* arrays[4] = {0};
+    if (binary_name)
+        for (uint8_t a = 0; a < 4; ++a)
+            arrays[a] = (double*)malloc(sizeof(double) * (count ? count : 1));
+    double* distances = answer_name ? (double*)malloc(sizeof(double) * (count ? count : 1)) : NULL;
 
     printf("{\n\"points_on_earth\":[");
 
     for(uint32_t i = 0; i < count; ++i)
     {
-        printf("\n{\"x1\":%0.12lf, \"y1\":%0.12lf, \"x2\":%0.12lf, \"y2\":%0.12lf},",
-               rand_double(MIN_LAT, MAX_LAT), rand_double(MIN_LON, MAX_LON),
-               rand_double(MIN_LAT, MAX_LAT), rand_double(MIN_LON, MAX_LON));
+        double pair[4] = {rand_double(MIN_LAT, MAX_LAT), rand_double(MIN_LON, MAX_LON),
+                          rand_double(MIN_LAT, MAX_LAT), rand_double(MIN_LON, MAX_LON)};
+        // the binary file and the answers use the values as they read back from the text
+        char text[4][32];
+        for (uint8_t a = 0; a < 4; ++a)
+        {
+            snprintf(text[a], sizeof(text[a]), "%0.12lf", pair[a]);
+            pair[a] = strtod(text[a], NULL);
+        }
+        printf("\n{\"x1\":%s, \"y1\":%s, \"x2\":%s, \"y2\":%s},", text[0], text[1], text[2], text[3]);
+        if (binary_name)
+            for (uint8_t a = 0; a < 4; ++a)
+                arrays[a][i] = pair[a];
+        if (distances)
+            distances[i] = haversine_distance(pair[0], pair[1], pair[2], pair[3]);
     }
     printf("\n]\n}\n");
+
+    uint8_t ok = 1;
+    if (binary_name)
+    {
+        ok = write_points_binary_arrays(binary_name, arrays, count, layout);
+        for (uint8_t a = 0; a < 4; ++a)
+            free(arrays[a]);
+    }
+    if (distances)
+    {
+        ok = ok && write_answers(answer_name, distances, count);
+        free(distances);
+    }
+    // stderr, stdout is the JSON. The files only make sense together, none is left behind
+    if (fflush(stdout) != 0 || ferror(stdout))
+    {
+        fprintf(stderr, "ERROR - could not write the JSON to stdout\n");
+        ok = 0;
+    }
+    if (!ok)
+    {
+        if (binary_name)
+            unlink(binary_name);
+        if (answer_name)
+            unlink(answer_name);
+        return 1;
+    }
+    return 0;
 }
 
 /* ===================================================================
@@ -99,19 +158,2103 @@ void calculate_avg_prologue(const char* input_stream, uint32_t pts_count)
            timer_sec(&t1), timer_sec(&t2),(double)timer_nano(&t2)  / pts_count, timer_sec(&t1) + timer_sec(&t2));
 }
 
+/* ===================================================================
+    Decimal to double, correctly rounded and bit-exact with strtod.
+    Small mantissas with small exponents are exact in one multiply or
+    divide (Clinger), the rest go through Eisel-Lemire on a 128 bit
+    power of ten, the few it can't decide fall back to strtod
+    =================================================================*/
+static const double exact_pow10[] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define POW10_TABLE_MIN_EXP -348
+#define POW10_TABLE_MAX_EXP 347
+static const uint64_t pow10_table[][2] =
+{
+#include "haversine_pow10_table.inc"
+};
+
+// 0 when the rounding can't be decided from the 128 bit product
+static uint8_t eisel_lemire(uint64_t mantissa, int32_t exponent10, uint8_t negative, double* out)
+{
+    if (mantissa == 0)
+    {
+        *out = negative ? -0.0 : 0.0;
+        return 1;
+    }
+    if (exponent10 < POW10_TABLE_MIN_EXP || exponent10 > POW10_TABLE_MAX_EXP)
+        return 0;
+
+    // normalise so the top bit is set, 217706 / 2^16 is log2(10)
+    uint32_t clz = __builtin_clzll(mantissa);
+    mantissa <<= clz;
+    uint64_t exponent2 = (uint64_t)(((217706 * exponent10) >> 16) + 64 + 1023) - clz;
+
+    const uint64_t* power = pow10_table[exponent10 - POW10_TABLE_MIN_EXP];
+    unsigned __int128 product = (unsigned __int128)mantissa * power[1];
+    uint64_t hi = (uint64_t)(product >> 64);
+    uint64_t lo = (uint64_t)product;
+
+    // the truncated power may have cost a carry into the bits we keep, widen with the low half
+    if ((hi & 0x1FF) == 0x1FF && lo + mantissa < mantissa)
+    {
+        unsigned __int128 wider = (unsigned __int128)mantissa * power[0];
+        uint64_t wider_hi = (uint64_t)(wider >> 64);
+        uint64_t wider_lo = (uint64_t)wider;
+        uint64_t merged_hi = hi;
+        uint64_t merged_lo = lo + wider_hi;
+        if (merged_lo < lo)
+            merged_hi++;
+        if ((merged_hi & 0x1FF) == 0x1FF && merged_lo + 1 == 0 && wider_lo + mantissa < mantissa)
+            return 0;
+        hi = merged_hi;
+        lo = merged_lo;
+    }
+
+    // down to 54 bits, then round to 53
+    uint64_t msb = hi >> 63;
+    uint64_t result = hi >> (msb + 9);
+    exponent2 -= 1 ^ msb;
+
+    // exactly half way, ties to even needs the digits we don't have
+    if (lo == 0 && (hi & 0x1FF) == 0 && (result & 3) == 1)
+        return 0;
+
+    result += result & 1;
+    result >>= 1;
+    if (result >> 53)
+    {
+        result >>= 1;
+        exponent2++;
+    }
+    // subnormal, infinity and overflow are left to strtod
+    if (exponent2 - 1 >= 0x7FF - 1)
+        return 0;
+
+    uint64_t bits = exponent2 << 52 | (result & 0x000FFFFFFFFFFFFF);
+    if (negative)
+        bits |= 0x8000000000000000;
+    memcpy(out, &bits, sizeof(bits));
+    return 1;
+}
+
+static double strtod_fallback(const char* start, const char* end)
+{
+    char buffer[512];
+    size_t length = end - start;
+    if (length < sizeof(buffer))
+    {
+        memcpy(buffer, start, length);
+        buffer[length] = 0;
+        return strtod(buffer, NULL);
+    }
+    char* copy = (char*)malloc(length + 1);
+    memcpy(copy, start, length);
+    copy[length] = 0;
+    double value = strtod(copy, NULL);
+    free(copy);
+    return value;
+}
+
+// JSON number at text to the nearest double.
+// Returns the position after the number
+static const char* parse_json_number(const char* text, const char* end, double* out)
+{
+    const char* start = text;
+    uint8_t negative = 0;
+    if (text < end && *text == '-')
+    {
+        negative = 1;
+        text++;
+    }
+
+    // up to 19 significant digits fit, the rest only move the exponent
+    uint64_t mantissa = 0;
+    int32_t exponent = 0;
+    uint32_t digits = 0;
+    uint8_t truncated = 0;
+    for (; text < end && *text >= '0' && *text <= '9'; ++text)
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (uint64_t)(*text - '0');
+            if (mantissa) digits++;
+        }
+        else
+        {
+            exponent++;
+            truncated |= *text != '0';
+        }
+    }
+    if (text < end && *text == '.')
+    {
+        for (++text; text < end && *text >= '0' && *text <= '9'; ++text)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (uint64_t)(*text - '0');
+                if (mantissa) digits++;
+                exponent--;
+            }
+            else truncated |= *text != '0';
+        }
+    }
+    if (text < end && (*text == 'e' || *text == 'E'))
+    {
+        text++;
+        uint8_t exp_negative = 0;
+        if (text < end && (*text == '-' || *text == '+'))
+            exp_negative = *text++ == '-';
+        int32_t exp_value = 0;
+        for (; text < end && *text >= '0' && *text <= '9'; ++text)
+            if (exp_value < 100000) exp_value = exp_value * 10 + (*text - '0');
+        exponent += exp_negative ? -exp_value : exp_value;
+    }
+
+    if (!truncated && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22)
+    {
+        double value = (double)mantissa;
+        value = exponent < 0 ? value / exact_pow10[-exponent] : value * exact_pow10[exponent];
+        *out = negative ? -value : value;
+        return text;
+    }
+
+    // with dropped digits the value is between mantissa and mantissa +1, fine if both round the same
+    double value, upper;
+    if (eisel_lemire(mantissa, exponent, negative, &value)
+            && (!truncated || (eisel_lemire(mantissa + 1, exponent, negative, &upper) && value == upper)))
+    {
+        *out = value;
+        return text;
+    }
+    *out = strtod_fallback(start, text);
+    return text;
+}
+
+/* Number parse microbenchmark */
+#define NUMBER_BENCH_RUNS 5
+static volatile double number_sink; // keeps the parsed sums alive
+
+static uint64_t random_bits(void)
+{
+    return ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ (uint64_t)rand();
+}
+
+// hard cases for the rounding, checked every run along with the random ones
+static const char* number_edge_cases[] =
+{
+    "0", "-0", "0.1", "1e23", "9007199254740993", "9007199254740992.5", "4.9e-324", "2.4703282292062327e-324",
+    "2.2250738585072011e-308", "2.2250738585072014e-308", "1.7976931348623157e308", "1.7976931348623159e308",
+    "7.3177701707893310e+15", "8.98846567431158e307", "1e-400", "1e400", "123456789012345678901234567890",
+    "0.30000000000000000555111512312578270211815834045410156250001", "-179.999999999999", "89.000000000001",
+    "2.00000000000000011102230246251565404236316680908203125", "1.00000000000000011102230246251565404236316680908203124",
+};
+
+// count numbers one after the other, each ends in a 0 so sscanf's strlen doesn't scan the whole text
+static char* build_number_text(uint32_t count, uint8_t general, size_t* length)
+{
+    char* text = (char*)malloc((size_t)count * 40 + 1);
+    char* at = text;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (!general)
+            at += sprintf(at, "%0.12lf", (i & 1) ? rand_double(MIN_LON, MAX_LON) : rand_double(MIN_LAT, MAX_LAT));
+        else
+        {
+            double value;
+            do
+            {
+                uint64_t bits = random_bits();
+                memcpy(&value, &bits, sizeof(value));
+            } while (!isfinite(value));
+            at += sprintf(at, "%.*g", 1 + rand() % 17, value);
+        }
+        *at++ = 0;
+        *at++ = ' ';
+    }
+    *length = at - text;
+    return text;
+}
+
+static uint32_t check_numbers(const char* text, const size_t length, uint8_t print)
+{
+    uint32_t mismatches = 0;
+    const char* end = text + length;
+    for (const char* at = text; at < end;)
+    {
+        double mine, reference;
+        const char* next = parse_json_number(at, end, &mine);
+        reference = strtod(at, NULL);
+        if (memcmp(&mine, &reference, sizeof(double)) != 0)
+        {
+            if (print && mismatches < 10)
+                printf("\tmismatch %.*s: %.17g against strtod %.17g\n", (int)(next - at), at, mine, reference);
+            mismatches++;
+        }
+        at = next;
+        while (at < end && (*at == 0 || *at == ' '))
+            at++;
+    }
+    return mismatches;
+}
+
+void number_bench(uint32_t count)
+{
+    srand(time(NULL));
+    uint32_t edge_mismatches = 0;
+    for (uint32_t i = 0; i < sizeof(number_edge_cases) / sizeof(number_edge_cases[0]); ++i)
+        edge_mismatches += check_numbers(number_edge_cases[i], strlen(number_edge_cases[i]), 1);
+    printf("Edge cases: %u mismatches against strtod\n", edge_mismatches);
+
+    const char* set_names[2] = {"generator %0.12lf", "random bits %.*g"};
+    for (uint8_t set = 0; set < 2; ++set)
+    {
+        size_t length = 0;
+        char* text = build_number_text(count, set, &length);
+        const char* end = text + length;
+        double best[3] = {1e30, 1e30, 1e30};
+        for (uint32_t run = 0; run < NUMBER_BENCH_RUNS; ++run)
+        {
+            for (uint8_t method = 0; method < 3; ++method)
+            {
+                Timer t;
+                double sum = 0;
+                start_timer(&t);
+                const char* at = text;
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    double value = 0;
+                    if (method == 0)
+                        at = parse_json_number(at, end, &value);
+                    else if (method == 1)
+                    {
+                        char* next;
+                        value = strtod(at, &next);
+                        at = next;
+                    }
+                    else
+                    {
+                        int used = 0;
+                        sscanf(at, "%lf%n", &value, &used);
+                        at += used;
+                    }
+                    sum += value;
+                    at += 2;
+                }
+                end_timer(&t);
+                number_sink = sum;
+                if (timer_sec(&t) < best[method]) best[method] = timer_sec(&t);
+            }
+        }
+        uint32_t mismatches = check_numbers(text, length, 1);
+        printf("%u numbers, %s, fastest of %d runs\n", count, set_names[set], NUMBER_BENCH_RUNS);
+        printf("\tparse_json_number: %0.2f ns per number\n", best[0] * 1e9 / count);
+        printf("\tstrtod:            %0.2f ns per number (%0.2fx)\n", best[1] * 1e9 / count, best[1] / best[0]);
+        printf("\tsscanf:            %0.2f ns per number (%0.2fx)\n", best[2] * 1e9 / count, best[2] / best[0]);
+        printf("\t%u mismatches against strtod\n", mismatches);
+        free(text);
+    }
+}
+
+/* ===================================================================
+    Memory mapped parser, the file is mapped (stdin is read in large
+    chunks) and the bytes are scanned for the "x1" "y1" "x2" "y2" keys
+    with a hand-written number parser, no line layout needed
+    =================================================================*/
+#define STDIN_CHUNK_SIZE (16 * 1024 * 1024)
+
+typedef struct
+{
+    double* values;         // x1 y1 x2 y2 per pair
+    uint64_t pair_count;
+    uint64_t capacity;      // in pairs
+} Point_Pairs;
+
+static void point_pairs_push(Point_Pairs* pairs, const double* pair)
+{
+    if (pairs->pair_count == pairs->capacity)
+    {
+        pairs->capacity = pairs->capacity ? pairs->capacity * 2 : 4096;
+        pairs->values = (double*)realloc(pairs->values, sizeof(double) * 4 * pairs->capacity);
+        if (!pairs->values)
+        {
+            printf("ERROR - could not grow the points array to %lu pairs\n", pairs->capacity);
+            exit(1);
+        }
+    }
+    memcpy(&pairs->values[pairs->pair_count * 4], pair, sizeof(double) * 4);
+    pairs->pair_count++;
+}
+
+// scans for the four keys in any order and layout, a pair is added once all four have been seen.
+// Returns the bytes consumed, up to just after the last complete pair
+static size_t parse_points_json(const char* text, const size_t size, Point_Pairs* pairs)
+{
+    PROFILE_ZONE_BYTES("parse", size);
+    const char* at = text;
+    const char* end = text + size;
+    const char* consumed = text;
+    double pair[4];
+    uint8_t seen = 0;
+
+    while (at + 4 <= end)
+    {
+        const char* quote = (const char*)memchr(at, '"', end - at);
+        if (!quote || quote + 4 > end)
+            break;
+        at = quote + 1;
+        if ((quote[1] != 'x' && quote[1] != 'y') || (quote[2] != '1' && quote[2] != '2') || quote[3] != '"')
+            continue;
+
+        uint8_t slot = (quote[1] == 'y') + (quote[2] == '2') * 2;
+        at = quote + 4;
+        while (at < end && (*at == ':' || *at == ' ' || *at == '\t' || *at == '\n' || *at == '\r'))
+            at++;
+        at = parse_json_number(at, end, &pair[slot]);
+        seen |= 1 << slot;
+
+        if (seen == 0xF)
+        {
+            point_pairs_push(pairs, pair);
+            seen = 0;
+            consumed = at;
+        }
+    }
+    return consumed - text;
+}
+
+// stdin can't be mapped, it is read in large chunks and only whole records are
+// handed to the parser, the rest is moved to the front for the next read
+static uint64_t parse_points_stream(FILE* input, Point_Pairs* pairs)
+{
+    char* buffer = (char*)malloc(STDIN_CHUNK_SIZE);
+    size_t held = 0;
+    uint64_t total = 0;
+    size_t read = 0;
+    while ((read = fread(buffer + held, 1, STDIN_CHUNK_SIZE - held, input)) > 0)
+    {
+        held += read;
+        total += read;
+        size_t usable = held;
+        while (usable && buffer[usable -1] != '}')
+            usable--;
+        if (usable == 0 && held == STDIN_CHUNK_SIZE)
+        {
+            printf("ERROR - no record end within %d bytes of stdin\n", STDIN_CHUNK_SIZE);
+            break;
+        }
+        size_t consumed = parse_points_json(buffer, usable, pairs);
+        memmove(buffer, buffer + consumed, held - consumed);
+        held -= consumed;
+    }
+    if (held)
+        parse_points_json(buffer, held, pairs);
+    free(buffer);
+    return total;
+}
+
+// read only private mapping of the whole file, NULL when it can't be opened or is empty
+static const char* map_input(const char* file_name, uint64_t* size)
+{
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0)
+    {
+        printf("ERROR - could not open %s\n", file_name);
+        return NULL;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    *size = st.st_size;
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    const char* mapped = (const char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        printf("ERROR - could not map %s\n", file_name);
+        return NULL;
+    }
+    madvise((void*)mapped, st.st_size, MADV_SEQUENTIAL);
+    return mapped;
+}
+
+static uint64_t parse_points_mmap(const char* file_name, Point_Pairs* pairs)
+{
+    uint64_t size = 0;
+    const char* mapped = map_input(file_name, &size);
+    if (!mapped)
+        return 0;
+    parse_points_json(mapped, size, pairs);
+    munmap((void*)mapped, size);
+    return size;
+}
+
+static uint64_t parse_points_fast(const char* input_stream, Point_Pairs* pairs)
+{
+    if (strcmp(input_stream, "stdin") == 0)
+        return parse_points_stream(stdin, pairs);
+    return parse_points_mmap(input_stream, pairs);
+}
+
+// the prologue's line by line sscanf, kept to compare against
+static uint64_t parse_points_sscanf(const char* file_name, Point_Pairs* pairs)
+{
+    FILE* input = fopen(file_name, "r");
+    if (!input)
+    {
+        printf("ERROR - could not open %s\n", file_name);
+        return 0;
+    }
+    char buffer[128] = {0};
+    double pair[4];
+    uint64_t total = 0;
+    while (fgets(buffer, sizeof(buffer), input))
+    {
+        total += strlen(buffer);
+        if (sscanf(buffer, "{\"x1\":%lf, \"y1\":%lf, \"x2\":%lf, \"y2\":%lf},",
+                   &pair[0], &pair[1], &pair[2], &pair[3]) == 4)
+            point_pairs_push(pairs, pair);
+    }
+    fclose(input);
+    return total;
+}
+
+static double sum_haversine(const Point_Pairs* pairs)
+{
+    PROFILE_ZONE_BYTES("sum", pairs->pair_count * sizeof(double) * 4);
+    double distance = 0;
+    for (uint64_t i = 0; i < pairs->pair_count; ++i)
+    {
+        const double* p = &pairs->values[i * 4];
+        distance += haversine_distance(p[0], p[1], p[2], p[3]);
+    }
+    return distance;
+}
+
+#define GB_PER_SEC(bytes, sec) ((double)(bytes) / (sec) / 1e9)
+
+// running comparison against an answer file, the distances can come in blocks in pair order
+typedef struct
+{
+    const char* name;
+    const char* mapped;
+    uint64_t size;
+    const double* expected;
+    uint64_t expected_count;
+    double expected_average;
+    uint64_t compared;          // pairs passed to answers_compare so far
+    uint64_t worst_index;
+    uint64_t first_mismatch;
+    uint64_t mismatches;
+    double max_error;
+    double first_mismatch_value;
+} Answer_Check;
+
+static uint8_t answers_open(const char* answer_name, Answer_Check* check);
+static void answers_compare(Answer_Check* check, const double* distances, uint64_t count);
+static int answers_finish(Answer_Check* check, uint64_t count, double average);
+static int verify_answers(const char* answer_name, const double* distances, uint64_t count, double average);
+
+// with answer_name the per pair distances are kept and checked against the reference answers
+int calculate_avg_mmap(const char* input_stream, const char* answer_name)
+{
+    Timer t1, t2;
+    Point_Pairs pairs = {0};
+    start_timer(&t1);
+    uint64_t bytes = parse_points_fast(input_stream, &pairs);
+    end_timer(&t1);
+    if (pairs.pair_count == 0)
+    {
+        printf("ERROR - no points found in %s\n", input_stream);
+        free(pairs.values);
+        return 1;
+    }
+
+    start_timer(&t2);
+    double distance = sum_haversine(&pairs);
+    end_timer(&t2);
+    printf("Avg: %0.2fkm over %lu pairs\n", distance / pairs.pair_count, pairs.pair_count);
+    printf("Time taking:\n\tParse info: %f sec (%0.3f GB/s over %lu bytes)\n\tHarversine Calc: %f sec\n*ns per Haversine Calc %0.3f\n\tTotal: %f sec\n",
+           timer_sec(&t1), GB_PER_SEC(bytes, timer_sec(&t1)), bytes, timer_sec(&t2),
+           (double)timer_nano(&t2) / pairs.pair_count, timer_sec(&t1) + timer_sec(&t2));
+
+    int failed = 0;
+    if (answer_name)
+    {
+        double* distances = (double*)malloc(sizeof(double) * pairs.pair_count);
+        for (uint64_t i = 0; i < pairs.pair_count; ++i)
+        {
+            const double* p = &pairs.values[i * 4];
+            distances[i] = haversine_distance(p[0], p[1], p[2], p[3]);
+        }
+        failed = verify_answers(answer_name, distances, pairs.pair_count, distance / pairs.pair_count);
+        free(distances);
+    }
+    free(pairs.values);
+    return failed;
+}
+
+// parses the same file with the sscanf path and the mapped parser, best of runs each
+#define PARSE_COMPARE_RUNS 5
+void parse_compare(const char* file_name)
+{
+    double best_sscanf = 1e30, best_mmap = 1e30;
+    uint64_t bytes = 0;
+    Point_Pairs by_sscanf = {0}, by_mmap = {0};
+    for (uint32_t run = 0; run < PARSE_COMPARE_RUNS; ++run)
+    {
+        Timer t;
+        by_sscanf.pair_count = 0;
+        start_timer(&t);
+        bytes = parse_points_sscanf(file_name, &by_sscanf);
+        end_timer(&t);
+        if (timer_sec(&t) < best_sscanf) best_sscanf = timer_sec(&t);
+
+        by_mmap.pair_count = 0;
+        start_timer(&t);
+        parse_points_mmap(file_name, &by_mmap);
+        end_timer(&t);
+        if (timer_sec(&t) < best_mmap) best_mmap = timer_sec(&t);
+    }
+
+    printf("Parsed %s, %lu bytes, fastest of %d runs\n", file_name, bytes, PARSE_COMPARE_RUNS);
+    printf("\tsscanf: %lu pairs %f sec %0.3f GB/s\n", by_sscanf.pair_count, best_sscanf, GB_PER_SEC(bytes, best_sscanf));
+    printf("\tmmap:   %lu pairs %f sec %0.3f GB/s (%0.2fx)\n", by_mmap.pair_count, best_mmap, GB_PER_SEC(bytes, best_mmap), best_sscanf / best_mmap);
+
+    if (by_sscanf.pair_count != by_mmap.pair_count)
+        printf("ERROR - pair counts differ\n");
+    else
+    {
+        double max_diff = 0;
+        for (uint64_t i = 0; i < by_mmap.pair_count * 4; ++i)
+        {
+            double diff = fabs(by_sscanf.values[i] - by_mmap.values[i]);
+            if (diff > max_diff) max_diff = diff;
+        }
+        printf("\tmax difference between the parsed values: %g\n", max_diff);
+    }
+    free(by_sscanf.values);
+    free(by_mmap.values);
+}
+
+/* ===================================================================
+    Batched haversine over structure of arrays. sin, cos and asin are
+    minimax polynomials with explicit range reduction, 4 (AVX2) or 8
+    (AVX-512) pairs per iteration picked at runtime, scalar otherwise.
+    The kernel is written once in haversine_kernel.inc
+    =================================================================*/
+typedef struct
+{
+    double* x1;
+    double* y1;
+    double* x2;
+    double* y2;
+    uint64_t count;
+} Points_SoA;
+
+#define KERNEL_SIN 0
+#define KERNEL_COS 1
+#define KERNEL_ASIN 2
+
+#define KERNEL_TWO_OVER_PI 0.63661977236758134308
+#define KERNEL_ROUND_MAGIC 6755399441055744.0   // 1.5 * 2^52
+// pi/2 in three parts of 33 bits, q * part is exact while q fits 20 bits
+#define KERNEL_PIO2_1 1.57079632673412561417e+00
+#define KERNEL_PIO2_2 6.07710050630396597660e-11
+#define KERNEL_PIO2_3 2.02226624871116645580e-21
+#define KERNEL_PIO2_HI 1.5707963267948966
+#define KERNEL_PIO2_LO 6.123233995736766e-17
+
+// sin(r) = r + r^3 P(r^2), cos(r) = 1 - r^2 / 2 + r^4 P(r^2) on [-pi/4, pi/4]
+#define KERNEL_SIN_0 1.5918129294866608e-10
+#define KERNEL_SIN_1 -2.5051131845003624e-08
+#define KERNEL_SIN_2 2.755731610255244e-06
+#define KERNEL_SIN_3 -0.00019841269836758574
+#define KERNEL_SIN_4 0.008333333333330948
+#define KERNEL_SIN_5 -0.16666666666666666
+#define KERNEL_COS_0 -1.1382632425521717e-11
+#define KERNEL_COS_1 2.08761462684032e-09
+#define KERNEL_COS_2 -2.7557317271729793e-07
+#define KERNEL_COS_3 2.480158729876569e-05
+#define KERNEL_COS_4 -0.0013888888888887398
+#define KERNEL_COS_5 0.041666666666666664
+// asin(x) = x + x^3 P(x^2) on [0, 0.5]
+#define KERNEL_ASIN_0 0.028757851367421566
+#define KERNEL_ASIN_1 -0.014851887071247204
+#define KERNEL_ASIN_2 0.01740087944269402
+#define KERNEL_ASIN_3 0.005457506718640358
+#define KERNEL_ASIN_4 0.01032281435018578
+#define KERNEL_ASIN_5 0.011479177415184906
+#define KERNEL_ASIN_6 0.013971212973552933
+#define KERNEL_ASIN_7 0.017352392720869973
+#define KERNEL_ASIN_8 0.02237217294214989
+#define KERNEL_ASIN_9 0.030381944138531247
+#define KERNEL_ASIN_10 0.04464285714635543
+#define KERNEL_ASIN_11 0.07499999999998433
+#define KERNEL_ASIN_12 0.16666666666666669
+
+static inline uint64_t double_bits(double v)
+{
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+static inline double double_from_bits(uint64_t bits)
+{
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+/* scalar, one pair at a time */
+#define VEC double
+#define VINT uint64_t
+#define VMASK uint8_t
+#define VEC_WIDTH 1
+#define VNAME(name) scalar_##name
+#define KERNEL_TARGET
+#define VSET1(x) ((double)(x))
+#define VLOAD(p) (*(p))
+#define VSTORE(p, v) (*(p) = (v))
+#define VADD(a, b) ((a) + (b))
+#define VSUB(a, b) ((a) - (b))
+#define VMUL(a, b) ((a) * (b))
+#define VDIV(a, b) ((a) / (b))
+#define VFMA(a, b, c) ((a) * (b) + (c))
+#define VSQRT(a) sqrt(a)
+#define VMIN(a, b) fmin(a, b)
+#define VCMP_GT(a, b) ((a) > (b))
+#define VSELECT(mask, a, b) ((mask) ? (a) : (b))
+#define VBITS(v) double_bits(v)
+#define VFROM_BITS(i) double_from_bits(i)
+#define VINT_SET1(x) ((uint64_t)(x))
+#define VINT_AND(a, b) ((a) & (b))
+#define VINT_XOR(a, b) ((a) ^ (b))
+#define VINT_ADD(a, b) ((a) + (b))
+#define VINT_SHL(a, n) ((a) << (n))
+#define VINT_TEST(a, bit) (((a) & (bit)) != 0)
+#include "haversine_kernel.inc"
+
+/* AVX2, 4 pairs */
+#define VEC __m256d
+#define VINT __m256i
+#define VMASK __m256d
+#define VEC_WIDTH 4
+#define VNAME(name) avx2_##name
+#define KERNEL_TARGET __attribute__((target("avx2,fma")))
+#define VSET1(x) _mm256_set1_pd(x)
+#define VLOAD(p) _mm256_loadu_pd(p)
+#define VSTORE(p, v) _mm256_storeu_pd(p, v)
+#define VADD(a, b) _mm256_add_pd(a, b)
+#define VSUB(a, b) _mm256_sub_pd(a, b)
+#define VMUL(a, b) _mm256_mul_pd(a, b)
+#define VDIV(a, b) _mm256_div_pd(a, b)
+#define VFMA(a, b, c) _mm256_fmadd_pd(a, b, c)
+#define VSQRT(a) _mm256_sqrt_pd(a)
+#define VMIN(a, b) _mm256_min_pd(a, b)
+#define VCMP_GT(a, b) _mm256_cmp_pd(a, b, _CMP_GT_OQ)
+#define VSELECT(mask, a, b) _mm256_blendv_pd(b, a, mask)
+#define VBITS(v) _mm256_castpd_si256(v)
+#define VFROM_BITS(i) _mm256_castsi256_pd(i)
+#define VINT_SET1(x) _mm256_set1_epi64x((int64_t)(x))
+#define VINT_AND(a, b) _mm256_and_si256(a, b)
+#define VINT_XOR(a, b) _mm256_xor_si256(a, b)
+#define VINT_ADD(a, b) _mm256_add_epi64(a, b)
+#define VINT_SHL(a, n) _mm256_slli_epi64(a, n)
+#define VINT_TEST(a, bit) _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(a, VINT_SET1(bit)), VINT_SET1(bit)))
+#include "haversine_kernel.inc"
+
+/* AVX-512, 8 pairs */
+#define VEC __m512d
+#define VINT __m512i
+#define VMASK __mmask8
+#define VEC_WIDTH 8
+#define VNAME(name) avx512_##name
+#define KERNEL_TARGET __attribute__((target("avx512f,fma")))
+#define VSET1(x) _mm512_set1_pd(x)
+#define VLOAD(p) _mm512_loadu_pd(p)
+#define VSTORE(p, v) _mm512_storeu_pd(p, v)
+#define VADD(a, b) _mm512_add_pd(a, b)
+#define VSUB(a, b) _mm512_sub_pd(a, b)
+#define VMUL(a, b) _mm512_mul_pd(a, b)
+#define VDIV(a, b) _mm512_div_pd(a, b)
+#define VFMA(a, b, c) _mm512_fmadd_pd(a, b, c)
+#define VSQRT(a) _mm512_sqrt_pd(a)
+#define VMIN(a, b) _mm512_min_pd(a, b)
+#define VCMP_GT(a, b) _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ)
+#define VSELECT(mask, a, b) _mm512_mask_blend_pd(mask, b, a)
+#define VBITS(v) _mm512_castpd_si512(v)
+#define VFROM_BITS(i) _mm512_castsi512_pd(i)
+#define VINT_SET1(x) _mm512_set1_epi64((int64_t)(x))
+#define VINT_AND(a, b) _mm512_and_si512(a, b)
+#define VINT_XOR(a, b) _mm512_xor_si512(a, b)
+#define VINT_ADD(a, b) _mm512_add_epi64(a, b)
+#define VINT_SHL(a, n) _mm512_slli_epi64(a, n)
+#define VINT_TEST(a, bit) _mm512_test_epi64_mask(a, VINT_SET1(bit))
+#include "haversine_kernel.inc"
+
+typedef double (*Haversine_Kernel_Fn)(const double* x1, const double* y1, const double* x2, const double* y2,
+                                      const uint64_t count, double* out);
+typedef void (*Kernel_Apply_Fn)(const uint8_t function, const double* in, double* out, const uint64_t count);
+
+typedef struct
+{
+    const char* name;
+    Haversine_Kernel_Fn haversine;
+    Kernel_Apply_Fn apply;
+    uint8_t supported;
+} Haversine_Kernel;
+
+#define HAVERSINE_KERNEL_COUNT 3
+static Haversine_Kernel haversine_kernels[HAVERSINE_KERNEL_COUNT] =
+{
+    {"scalar", scalar_haversine, scalar_apply, 1},
+    {"avx2", avx2_haversine, avx2_apply, 0},
+    {"avx512", avx512_haversine, avx512_apply, 0},
+};
+
+// widest kernel this cpu runs
+static const Haversine_Kernel* haversine_kernel_select(void)
+{
+    __builtin_cpu_init();
+    haversine_kernels[1].supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    haversine_kernels[2].supported = __builtin_cpu_supports("avx512f") != 0;
+    for (int32_t i = HAVERSINE_KERNEL_COUNT -1; i >= 0; --i)
+        if (haversine_kernels[i].supported)
+            return &haversine_kernels[i];
+    return &haversine_kernels[0];
+}
+
+static void* alloc_aligned_doubles(uint64_t count)
+{
+    size_t size = (sizeof(double) * count + 63) & ~(size_t)63;
+    void* memory = aligned_alloc(64, size ? size : 64);
+    if (!memory)
+    {
+        printf("ERROR - could not allocate %lu doubles\n", count);
+        exit(1);
+    }
+    return memory;
+}
+
+static Points_SoA points_soa_from_pairs(const Point_Pairs* pairs)
+{
+    PROFILE_ZONE_BYTES("convert", pairs->pair_count * sizeof(double) * 4);
+    Points_SoA points = {0};
+    points.count = pairs->pair_count;
+    points.x1 = (double*)alloc_aligned_doubles(points.count);
+    points.y1 = (double*)alloc_aligned_doubles(points.count);
+    points.x2 = (double*)alloc_aligned_doubles(points.count);
+    points.y2 = (double*)alloc_aligned_doubles(points.count);
+    for (uint64_t i = 0; i < points.count; ++i)
+    {
+        points.x1[i] = pairs->values[i * 4];
+        points.y1[i] = pairs->values[i * 4 + 1];
+        points.x2[i] = pairs->values[i * 4 + 2];
+        points.y2[i] = pairs->values[i * 4 + 3];
+    }
+    return points;
+}
+
+static void points_soa_free(Points_SoA* points)
+{
+    free(points->x1);
+    free(points->y1);
+    free(points->x2);
+    free(points->y2);
+}
+
+// doubles ordered as integers so neighbours are one apart, across zero as well
+static uint64_t ulp_distance(double a, double b)
+{
+    int64_t ia = (int64_t)double_bits(a);
+    int64_t ib = (int64_t)double_bits(b);
+    if (ia < 0) ia = INT64_MIN - ia;
+    if (ib < 0) ib = INT64_MIN - ib;
+    return ia > ib ? (uint64_t)ia - (uint64_t)ib : (uint64_t)ib - (uint64_t)ia;
+}
+
+// relative condition number of 2 asin(sqrt(a)) in a, near antipodal points a is close to 1 and
+// the last bits of a (in any implementation, libm's as well) turn into hundreds of ulp of distance
+static double haversine_condition(double lat1d, double lon1d, double lat2d, double lon2d)
+{
+    double s_lat = sin((deg2rad(lat2d) - deg2rad(lat1d)) / 2);
+    double s_lon = sin((deg2rad(lon2d) - deg2rad(lon1d)) / 2);
+    double a = s_lat * s_lat + cos(deg2rad(lat1d)) * cos(deg2rad(lat2d)) * s_lon * s_lon;
+    if (a <= 0)
+        return 1;
+    if (a >= 1)
+        return 1e30;
+    double condition = sqrt(a) / (2 * sqrt(1 - a) * asin(sqrt(a)));
+    return condition > 1 ? condition : 1;
+}
+
+#define KERNEL_ERROR_SAMPLES (1 << 20)
+#define KERNEL_BENCH_RUNS 5
+#define DEFAULT_MAX_ULP 4
+#define DEFAULT_MAX_DISTANCE_ULP 16     // the distance chains about six rounded operations
+
+// error of every kernel against libm and the reference haversine_distance, then the timing of each.
+// The distance bound is max_distance_ulp times the condition number of the pair.
+// Returns non zero when a kernel is over either bound
+int vector_kernel_report(const char* input_stream, uint32_t max_ulp, uint32_t max_distance_ulp)
+{
+    const Haversine_Kernel* selected = haversine_kernel_select();
+    Point_Pairs pairs = {0};
+    parse_points_fast(input_stream, &pairs);
+    if (pairs.pair_count == 0)
+    {
+        printf("ERROR - no points found in %s\n", input_stream);
+        free(pairs.values);
+        return 1;
+    }
+    Points_SoA points = points_soa_from_pairs(&pairs);
+    free(pairs.values);
+
+    // sin and cos over two turns either way, asin over [-1, 1]
+    double* in = (double*)alloc_aligned_doubles(KERNEL_ERROR_SAMPLES);
+    double* out = (double*)alloc_aligned_doubles(points.count > KERNEL_ERROR_SAMPLES ? points.count : KERNEL_ERROR_SAMPLES);
+    double* reference = (double*)alloc_aligned_doubles(points.count);
+    double* condition = (double*)alloc_aligned_doubles(points.count);
+    for (uint64_t i = 0; i < points.count; ++i)
+    {
+        reference[i] = haversine_distance(points.x1[i], points.y1[i], points.x2[i], points.y2[i]);
+        condition[i] = haversine_condition(points.x1[i], points.y1[i], points.x2[i], points.y2[i]);
+    }
+    const char* function_names[3] = {"sin", "cos", "asin"};
+    const double ranges[3] = {4 * M_PI, 4 * M_PI, 1.0};
+    int failed = 0;
+
+    printf("Max error in ulp against libm, bound %u per function and %u per distance (%d samples per function, %lu pairs)\n",
+           max_ulp, max_distance_ulp, KERNEL_ERROR_SAMPLES, points.count);
+    for (uint32_t k = 0; k < HAVERSINE_KERNEL_COUNT; ++k)
+    {
+        const Haversine_Kernel* kernel = &haversine_kernels[k];
+        if (!kernel->supported)
+        {
+            printf("\t%-7s not supported on this cpu\n", kernel->name);
+            continue;
+        }
+        printf("\t%-7s", kernel->name);
+        for (uint8_t function = KERNEL_SIN; function <= KERNEL_ASIN; ++function)
+        {
+            for (uint32_t i = 0; i < KERNEL_ERROR_SAMPLES; ++i)
+                in[i] = -ranges[function] + 2 * ranges[function] * ((double)i + 0.5) / KERNEL_ERROR_SAMPLES;
+            kernel->apply(function, in, out, KERNEL_ERROR_SAMPLES);
+            uint64_t worst = 0;
+            for (uint32_t i = 0; i < KERNEL_ERROR_SAMPLES; ++i)
+            {
+                double expected = function == KERNEL_SIN ? sin(in[i]) : function == KERNEL_COS ? cos(in[i]) : asin(in[i]);
+                uint64_t ulp = ulp_distance(out[i], expected);
+                if (ulp > worst) worst = ulp;
+            }
+            failed |= worst > max_ulp;
+            printf(" %s %lu%s", function_names[function], worst, worst > max_ulp ? " FAIL" : "");
+        }
+
+        kernel->haversine(points.x1, points.y1, points.x2, points.y2, points.count, out);
+        uint64_t worst = 0, worst_index = 0;
+        double worst_ratio = 0, max_abs = 0;
+        for (uint64_t i = 0; i < points.count; ++i)
+        {
+            uint64_t ulp = ulp_distance(out[i], reference[i]);
+            double ratio = ulp / (max_distance_ulp * condition[i]);
+            if (ratio > worst_ratio)
+            {
+                worst_ratio = ratio;
+                worst = ulp;
+                worst_index = i;
+            }
+            if (fabs(out[i] - reference[i]) > max_abs) max_abs = fabs(out[i] - reference[i]);
+        }
+        failed |= worst_ratio > 1;
+        printf(" distance %lu at condition %0.1f%s (pair %lu, max %gkm)\n", worst, condition[worst_index],
+               worst_ratio > 1 ? " FAIL" : "", worst_index, max_abs);
+    }
+
+    // timings, the libm reference first
+    double best_reference = 1e30;
+    double reference_sum = 0;
+    for (uint32_t run = 0; run < KERNEL_BENCH_RUNS; ++run)
+    {
+        Timer t;
+        start_timer(&t);
+        reference_sum = 0;
+        for (uint64_t i = 0; i < points.count; ++i)
+            reference_sum += haversine_distance(points.x1[i], points.y1[i], points.x2[i], points.y2[i]);
+        end_timer(&t);
+        if (timer_sec(&t) < best_reference) best_reference = timer_sec(&t);
+    }
+    printf("Fastest of %d runs (%s picked at runtime)\n", KERNEL_BENCH_RUNS, selected->name);
+    printf("\t%-7s %0.3f ns per pair, avg %0.6fkm\n", "libm", best_reference * 1e9 / points.count, reference_sum / points.count);
+    for (uint32_t k = 0; k < HAVERSINE_KERNEL_COUNT; ++k)
+    {
+        const Haversine_Kernel* kernel = &haversine_kernels[k];
+        if (!kernel->supported)
+            continue;
+        double best = 1e30;
+        double sum = 0;
+        for (uint32_t run = 0; run < KERNEL_BENCH_RUNS; ++run)
+        {
+            Timer t;
+            start_timer(&t);
+            sum = kernel->haversine(points.x1, points.y1, points.x2, points.y2, points.count, NULL);
+            end_timer(&t);
+            if (timer_sec(&t) < best) best = timer_sec(&t);
+        }
+        printf("\t%-7s %0.3f ns per pair, avg %0.6fkm (%0.2fx)\n", kernel->name, best * 1e9 / points.count,
+               sum / points.count, best_reference / best);
+    }
+
+    free(in);
+    free(out);
+    free(reference);
+    free(condition);
+    points_soa_free(&points);
+    return failed;
+}
+
+/* ===================================================================
+    Multithreaded parse and compute, the mapped file is split into byte
+    ranges that end just after a record's '}', every thread parses its
+    range and runs the kernel over it. Each distance is added as a 2^-40
+    km fixed point integer so the total is exact and the same for any
+    thread count
+    =================================================================*/
+#define FIXED_POINT_SCALE 1099511627776.0   // 2^40, the longest distance still fits 56 bits
+#define THREAD_BLOCK_PAIRS 4096
+#define MAX_THREADS 256
+#define SCALING_RUNS 3
+
+typedef struct
+{
+    const char* text;
+    uint64_t size;
+    const Haversine_Kernel* kernel;
+    uint64_t pair_count;
+    __int128 fixed_sum;
+    uint8_t keep_distances;     // for the answer check
+    double* distances;          // every distance of the range with keep_distances
+} Range_Task;
+
+// the pairs through the kernel a block at a time into the fixed point sum,
+// block is THREAD_BLOCK_PAIRS * 5 aligned doubles of scratch, the distances
+// are also copied out to kept when it isn't NULL
+static __int128 pairs_fixed_sum(const Point_Pairs* pairs, const Haversine_Kernel* kernel, double* block, double* kept)
+{
+    double* x1 = block;
+    double* y1 = block + THREAD_BLOCK_PAIRS;
+    double* x2 = block + THREAD_BLOCK_PAIRS * 2;
+    double* y2 = block + THREAD_BLOCK_PAIRS * 3;
+    double* distances = block + THREAD_BLOCK_PAIRS * 4;
+    __int128 fixed_sum = 0;
+    for (uint64_t first = 0; first < pairs->pair_count; first += THREAD_BLOCK_PAIRS)
+    {
+        uint64_t count = pairs->pair_count - first < THREAD_BLOCK_PAIRS ? pairs->pair_count - first : THREAD_BLOCK_PAIRS;
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            const double* p = &pairs->values[(first + i) * 4];
+            x1[i] = p[0];
+            y1[i] = p[1];
+            x2[i] = p[2];
+            y2[i] = p[3];
+        }
+        kernel->haversine(x1, y1, x2, y2, count, distances);
+        for (uint64_t i = 0; i < count; ++i)
+            fixed_sum += llrint(distances[i] * FIXED_POINT_SCALE);
+        if (kept)
+            memcpy(kept + first, distances, count * sizeof(double));
+    }
+    return fixed_sum;
+}
+
+static void* range_task_run(void* data)
+{
+    Range_Task* task = (Range_Task*)data;
+    Point_Pairs pairs = {0};
+    parse_points_json(task->text, task->size, &pairs);
+
+    double* block = (double*)alloc_aligned_doubles(THREAD_BLOCK_PAIRS * 5);
+    if (task->keep_distances)
+        task->distances = (double*)malloc((pairs.pair_count ? pairs.pair_count : 1) * sizeof(double));
+    task->pair_count = pairs.pair_count;
+    task->fixed_sum = pairs_fixed_sum(&pairs, task->kernel, block, task->distances);
+    free(block);
+    free(pairs.values);
+    return NULL;
+}
+
+// start of range i, just after the first '}' at or past its share of the bytes
+static uint64_t range_start(const char* text, const uint64_t size, const uint32_t range, const uint32_t range_count)
+{
+    if (range == 0)
+        return 0;
+    uint64_t at = size / range_count * range;
+    const char* close = (const char*)memchr(text + at, '}', size - at);
+    return close ? (uint64_t)(close - text) + 1 : size;
+}
+
+// average over the file on thread_count threads, returns the pair count (0 when nothing parsed).
+// With check every range keeps its distances and they are compared in range order after the join
+static uint64_t threaded_average(const char* text, const uint64_t size, const uint32_t thread_count,
+                                 const Haversine_Kernel* kernel, double* average, Answer_Check* check)
+{
+    pthread_t threads[MAX_THREADS];
+    Range_Task tasks[MAX_THREADS];
+    for (uint32_t i = 0; i < thread_count; ++i)
+    {
+        uint64_t start = range_start(text, size, i, thread_count);
+        uint64_t end = i + 1 == thread_count ? size : range_start(text, size, i + 1, thread_count);
+        tasks[i] = (Range_Task){text + start, end - start, kernel, 0, 0, check != NULL, NULL};
+    }
+    for (uint32_t i = 1; i < thread_count; ++i)
+        pthread_create(&threads[i], NULL, range_task_run, &tasks[i]);
+    range_task_run(&tasks[0]);
+
+    uint64_t pair_count = tasks[0].pair_count;
+    __int128 fixed_sum = tasks[0].fixed_sum;
+    for (uint32_t i = 1; i < thread_count; ++i)
+    {
+        pthread_join(threads[i], NULL);
+        pair_count += tasks[i].pair_count;
+        fixed_sum += tasks[i].fixed_sum;
+    }
+    *average = pair_count ? (double)fixed_sum / FIXED_POINT_SCALE / pair_count : 0;
+    for (uint32_t i = 0; check && i < thread_count; ++i)
+    {
+        answers_compare(check, tasks[i].distances, tasks[i].pair_count);
+        free(tasks[i].distances);
+    }
+    return pair_count;
+}
+
+// the average on thread_count threads (all cores when 0), then the scaling curve from 1 thread up to it.
+// With answer_name the distances of the first run are checked against the reference answers
+int calculate_avg_threaded(const char* file_name, uint32_t thread_count, const char* answer_name)
+{
+    uint32_t cores = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+    if (thread_count == 0)
+        thread_count = cores;
+    if (thread_count > MAX_THREADS)
+        thread_count = MAX_THREADS;
+    const Haversine_Kernel* kernel = haversine_kernel_select();
+
+    uint64_t size = 0;
+    const char* text = map_input(file_name, &size);
+    if (!text)
+        return 1;
+    Answer_Check check;
+    if (answer_name && !answers_open(answer_name, &check))
+    {
+        munmap((void*)text, size);
+        return 1;
+    }
+
+    Timer t;
+    double average = 0;
+    start_timer(&t);
+    uint64_t pair_count = threaded_average(text, size, thread_count, kernel, &average, answer_name ? &check : NULL);
+    end_timer(&t);
+    if (pair_count == 0)
+    {
+        printf("ERROR - no points found in %s\n", file_name);
+        if (answer_name)
+            munmap((void*)check.mapped, check.size);
+        munmap((void*)text, size);
+        return 1;
+    }
+    printf("Avg: %0.2fkm over %lu pairs, %u threads (%s kernel, %u cores)\n", average, pair_count, thread_count, kernel->name, cores);
+    printf("Time taking: %f sec (%0.3f GB/s)\n", timer_sec(&t), GB_PER_SEC(size, timer_sec(&t)));
+    int failed = answer_name ? answers_finish(&check, pair_count, average) : 0;
+
+    printf("Scaling, fastest of %d runs:\n", SCALING_RUNS);
+    double single = 0;
+    int differs = 0;
+    for (uint32_t threads = 1; threads <= thread_count; ++threads)
+    {
+        double best = 1e30, run_average = 0;
+        for (uint32_t run = 0; run < SCALING_RUNS; ++run)
+        {
+            start_timer(&t);
+            threaded_average(text, size, threads, kernel, &run_average, NULL);
+            end_timer(&t);
+            if (timer_sec(&t) < best) best = timer_sec(&t);
+        }
+        if (threads == 1)
+            single = best;
+        uint8_t same = memcmp(&run_average, &average, sizeof(double)) == 0;
+        differs |= !same;
+        printf("\t%3u threads %f sec %0.3f GB/s %0.2fx %s\n", threads, best, GB_PER_SEC(size, best), single / best,
+               same ? "same result" : "RESULT DIFFERS");
+    }
+    munmap((void*)text, size);
+    return differs | failed;
+}
+
+/* ===================================================================
+    Streaming parse and compute, the input is read through one fixed
+    buffer and every chunk's records go through the kernel into the
+    running fixed point sum straight after they are parsed. Memory
+    stays the same whatever the file size, no point count is needed
+    and the result is the same bits as the threaded version
+    =================================================================*/
+#define STREAM_CHUNK_SIZE (1024 * 1024)     // a chunk's pairs are still in cache for the kernel
+
+// with answer_name every chunk's distances are checked against the reference answers as they come
+int calculate_avg_streaming(const char* input_stream, const char* answer_name)
+{
+    const Haversine_Kernel* kernel = haversine_kernel_select();
+    Answer_Check check;
+    if (answer_name && !answers_open(answer_name, &check))
+        return 1;
+    int fd = strcmp(input_stream, "stdin") == 0 ? 0 : open(input_stream, O_RDONLY);
+    if (fd < 0)
+    {
+        printf("ERROR - could not open %s\n", input_stream);
+        if (answer_name)
+            munmap((void*)check.mapped, check.size);
+        return 1;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    Timer t;
+    start_timer(&t);
+    char* buffer = (char*)malloc(STREAM_CHUNK_SIZE);
+    double* block = (double*)alloc_aligned_doubles(THREAD_BLOCK_PAIRS * 5);
+    Point_Pairs pairs = {0};
+    double* kept = NULL;        // a chunk's distances for the answer check
+    uint64_t kept_capacity = 0;
+    __int128 fixed_sum = 0;
+    uint64_t pair_count = 0, bytes = 0;
+    size_t held = 0;
+    uint8_t failed = 0;
+    for (;;)
+    {
+        ssize_t got = read(fd, buffer + held, STREAM_CHUNK_SIZE - held);
+        if (got < 0)
+        {
+            printf("ERROR - read of %s failed\n", input_stream);
+            failed = 1;
+            break;
+        }
+        if (got == 0 && held == 0)
+            break;
+        held += got;
+        bytes += got;
+        // whole records only, the bytes after the last '}' move to the front for the next read.
+        // At the end of the input everything left goes
+        size_t usable = held;
+        if (got > 0)
+            while (usable && buffer[usable -1] != '}')
+                usable--;
+        if (usable == 0 && held == STREAM_CHUNK_SIZE)
+        {
+            printf("ERROR - no record end within %d bytes\n", STREAM_CHUNK_SIZE);
+            failed = 1;
+            break;
+        }
+
+        pairs.pair_count = 0;
+        parse_points_json(buffer, usable, &pairs);
+        if (answer_name && pairs.pair_count > kept_capacity)
+        {
+            kept_capacity = pairs.pair_count;
+            kept = (double*)realloc(kept, kept_capacity * sizeof(double));
+        }
+        fixed_sum += pairs_fixed_sum(&pairs, kernel, block, kept);
+        if (answer_name)
+            answers_compare(&check, kept, pairs.pair_count);
+        pair_count += pairs.pair_count;
+        if (got == 0)
+            break;
+        memmove(buffer, buffer + usable, held - usable);
+        held -= usable;
+    }
+    end_timer(&t);
+    if (fd != 0)
+        close(fd);
+    free(buffer);
+    free(block);
+    free(pairs.values);
+    free(kept);
+    if (failed || pair_count == 0)
+    {
+        if (!failed)
+            printf("ERROR - no points found in %s\n", input_stream);
+        if (answer_name)
+            munmap((void*)check.mapped, check.size);
+        return 1;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("Avg: %0.2fkm over %lu pairs (%s kernel)\n", (double)fixed_sum / FIXED_POINT_SCALE / pair_count, pair_count, kernel->name);
+    printf("Time taking: %f sec (%0.3f GB/s over %lu bytes)\n*ns per pair %0.3f\n", timer_sec(&t),
+           GB_PER_SEC(bytes, timer_sec(&t)), bytes, (double)timer_nano(&t) / pair_count);
+    printf("Max resident: %ld KB (%d KB read buffer)\n", usage.ru_maxrss, STREAM_CHUNK_SIZE / 1024);
+    return answer_name ? answers_finish(&check, pair_count, (double)fixed_sum / FIXED_POINT_SCALE / pair_count) : 0;
+}
+
+/* ===================================================================
+    Repetition tests of the phases, each runs until its fastest time
+    hasn't improved for the given seconds. Warm runs reuse buffers that
+    are already faulted in, cold runs write into buffers mapped fresh
+    for the run and unmapped after it so every run takes its own page
+    faults (malloc would hand back pages an earlier run faulted in)
+    =================================================================*/
+#define DEFAULT_REPETITION_SEC 10.0
+
+static uint8_t read_whole_file(const char* file_name, char* buffer, uint64_t size)
+{
+    PROFILE_ZONE_BYTES("read", size);
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    uint64_t done = 0;
+    while (done < size)
+    {
+        ssize_t got = read(fd, buffer + done, size - done);
+        if (got <= 0)
+            break;
+        done += got;
+    }
+    close(fd);
+    return done == size;
+}
+
+// untouched anonymous pages, unmap_fresh gives them back to the system
+static void* map_fresh(uint64_t size)
+{
+    void* buffer = mmap(NULL, size ? size : 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED)
+    {
+        printf("ERROR - could not map %lu bytes\n", size);
+        exit(1);
+    }
+    return buffer;
+}
+
+static void unmap_fresh(void* buffer, uint64_t size)
+{
+    munmap(buffer, size ? size : 1);
+}
+
+static char* read_fresh(const char* file_name, uint64_t size)
+{
+    char* buffer = (char*)map_fresh(size);
+    if (!read_whole_file(file_name, buffer, size))
+        printf("ERROR - could not read %s\n", file_name);
+    return buffer;
+}
+
+// phase is read, parse, compute or all
+int repetition_test_phases(const char* file_name, const char* phase, double try_for_sec)
+{
+    struct stat st;
+    if (stat(file_name, &st) != 0 || st.st_size == 0)
+    {
+        printf("ERROR - could not open %s\n", file_name);
+        return 1;
+    }
+    const uint64_t size = st.st_size;
+    uint8_t all = strcmp(phase, "all") == 0;
+    Repetition_Tester tester;
+    const Haversine_Kernel* kernel = haversine_kernel_select();
+
+    // the warm buffers, faulted in once here
+    char* text = (char*)malloc(size);
+    if (!read_whole_file(file_name, text, size))
+        printf("ERROR - could not read %s\n", file_name);
+    Point_Pairs pairs = {0};
+    parse_points_json(text, size, &pairs);
+    Points_SoA points = points_soa_from_pairs(&pairs);
+    printf("Repetition testing %s, %lu bytes %lu pairs, until the min hasn't improved for %0.1f sec\n",
+           file_name, size, pairs.pair_count, try_for_sec);
+
+    if (all || strcmp(phase, "read") == 0)
+    {
+        repetition_start(&tester, size, try_for_sec);
+        while (repetition_testing(&tester))
+        {
+            repetition_begin(&tester);
+            read_whole_file(file_name, text, size);
+            repetition_end(&tester);
+        }
+        repetition_print(&tester, "read warm");
+
+        repetition_start(&tester, size, try_for_sec);
+        while (repetition_testing(&tester))
+        {
+            repetition_begin(&tester);
+            char* fresh = read_fresh(file_name, size);
+            repetition_end(&tester);
+            unmap_fresh(fresh, size);
+        }
+        repetition_print(&tester, "read cold");
+    }
+
+    if (all || strcmp(phase, "parse") == 0)
+    {
+        repetition_start(&tester, size, try_for_sec);
+        while (repetition_testing(&tester))
+        {
+            pairs.pair_count = 0;
+            repetition_begin(&tester);
+            parse_points_json(text, size, &pairs);
+            repetition_end(&tester);
+        }
+        repetition_print(&tester, "parse warm");
+
+        repetition_start(&tester, size, try_for_sec);
+        // sized from the warm parse so the values never move to malloc'd memory
+        const uint64_t values_size = pairs.pair_count * sizeof(double) * 4;
+        while (repetition_testing(&tester))
+        {
+            char* fresh = read_fresh(file_name, size);
+            Point_Pairs fresh_pairs = {(double*)map_fresh(values_size), 0, pairs.pair_count};
+            repetition_begin(&tester);
+            parse_points_json(fresh, size, &fresh_pairs);
+            repetition_end(&tester);
+            unmap_fresh(fresh_pairs.values, values_size);
+            unmap_fresh(fresh, size);
+        }
+        repetition_print(&tester, "parse cold");
+    }
+
+    if (all || strcmp(phase, "compute") == 0)
+    {
+        double* distances = (double*)alloc_aligned_doubles(points.count);
+        memset(distances, 0, sizeof(double) * points.count);
+        repetition_start(&tester, points.count * sizeof(double) * 4, try_for_sec);
+        while (repetition_testing(&tester))
+        {
+            repetition_begin(&tester);
+            kernel->haversine(points.x1, points.y1, points.x2, points.y2, points.count, distances);
+            repetition_end(&tester);
+        }
+        repetition_print(&tester, "compute warm");
+        free(distances);
+
+        repetition_start(&tester, points.count * sizeof(double) * 4, try_for_sec);
+        while (repetition_testing(&tester))
+        {
+            Points_SoA fresh_points = points_soa_from_pairs(&pairs);
+            double* fresh_distances = (double*)map_fresh(fresh_points.count * sizeof(double));
+            repetition_begin(&tester);
+            kernel->haversine(fresh_points.x1, fresh_points.y1, fresh_points.x2, fresh_points.y2, fresh_points.count, fresh_distances);
+            repetition_end(&tester);
+            unmap_fresh(fresh_distances, fresh_points.count * sizeof(double));
+            points_soa_free(&fresh_points);
+        }
+        repetition_print(&tester, "compute cold");
+    }
+
+    free(text);
+    free(pairs.values);
+    points_soa_free(&points);
+    return 0;
+}
+
+/* ===================================================================
+    Profiled run of the phases, read parse convert and sum once each
+    with the zones in pap_helper.h. Built without -DPAP_PROFILER=1
+    only the total is printed
+    =================================================================*/
+int profile_phases(const char* file_name)
+{
+    struct stat st;
+    if (stat(file_name, &st) != 0 || st.st_size == 0)
+    {
+        printf("ERROR - could not open %s\n", file_name);
+        return 1;
+    }
+    const uint64_t size = st.st_size;
+    const Haversine_Kernel* kernel = haversine_kernel_select();
+
+    begin_profile();
+    char* text = read_fresh(file_name, size);
+    Point_Pairs pairs = {0};
+    parse_points_json(text, size, &pairs);
+    Points_SoA points = points_soa_from_pairs(&pairs);
+    double distance = kernel->haversine(points.x1, points.y1, points.x2, points.y2, points.count, NULL);
+    free(text);
+    free(pairs.values);
+    points_soa_free(&points);
+
+    printf("Pair count: %lu\nAverage distance: %0.12f (%s kernel)\n\n", points.count,
+           points.count ? distance / points.count : 0.0, kernel->name);
+    end_and_print_profile(stdout);
+    return 0;
+}
+
+/* ===================================================================
+    Binary point file, a header then the x1 y1 x2 y2 arrays as doubles
+    or floats, each starting on a 64 byte boundary so the mapped file
+    goes straight into the kernel with nothing to parse
+    =================================================================*/
+#define POINTS_FILE_MAGIC 0x4E535648    // "HVSN"
+#define POINTS_FILE_VERSION 1
+#define POINTS_FILE_ALIGN 64
+#define POINTS_LAYOUT_F64 0
+#define POINTS_LAYOUT_F32 1
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+    uint32_t layout;            // POINTS_LAYOUT_F64 or POINTS_LAYOUT_F32
+    uint32_t element_size;
+    uint64_t array_offset[4];   // x1 y1 x2 y2 from the start of the file
+} Points_File_Header;
+
+typedef struct
+{
+    const char* mapped;
+    uint64_t size;
+    const Points_File_Header* header;
+    const void* arrays[4];
+} Points_Binary;
+
+static uint64_t align_offset(uint64_t offset)
+{
+    return (offset + POINTS_FILE_ALIGN -1) & ~(uint64_t)(POINTS_FILE_ALIGN -1);
+}
+
+// header with the array offsets laid out, the file ends at the last one's aligned end
+static Points_File_Header points_file_header(uint64_t count, uint32_t layout)
+{
+    Points_File_Header header = {0};
+    header.magic = POINTS_FILE_MAGIC;
+    header.version = POINTS_FILE_VERSION;
+    header.count = count;
+    header.layout = layout;
+    header.element_size = layout == POINTS_LAYOUT_F32 ? sizeof(float) : sizeof(double);
+    uint64_t offset = align_offset(sizeof(header));
+    for (uint8_t a = 0; a < 4; ++a)
+    {
+        header.array_offset[a] = offset;
+        offset = align_offset(offset + count * header.element_size);
+    }
+    return header;
+}
+
+// 0 when the file could not be written in full, it is removed then
+static uint8_t write_points_binary_arrays(const char* binary_name, double* const arrays[4], uint64_t count, uint32_t layout)
+{
+    FILE* file = fopen(binary_name, "wb");
+    if (!file)
+    {
+        printf("ERROR - could not create %s\n", binary_name);
+        return 0;
+    }
+    Points_File_Header header = points_file_header(count, layout);
+    uint8_t ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    static const uint8_t zeros[POINTS_FILE_ALIGN] = {0};
+    uint64_t written = sizeof(header);
+    float* narrowed = layout == POINTS_LAYOUT_F32 ? (float*)malloc(sizeof(float) * (count ? count : 1)) : NULL;
+    for (uint8_t a = 0; a < 4 && ok; ++a)
+    {
+        ok = fwrite(zeros, 1, header.array_offset[a] - written, file) == header.array_offset[a] - written;
+        if (narrowed)
+        {
+            for (uint64_t i = 0; i < count; ++i)
+                narrowed[i] = (float)arrays[a][i];
+            ok = ok && fwrite(narrowed, sizeof(float), count, file) == count;
+        }
+        else ok = ok && fwrite(arrays[a], sizeof(double), count, file) == count;
+        written = header.array_offset[a] + count * header.element_size;
+    }
+    ok = ok && fwrite(zeros, 1, align_offset(written) - written, file) == align_offset(written) - written;
+    free(narrowed);
+    if (fclose(file) != 0 || !ok)
+    {
+        printf("ERROR - could not write %s, it was removed\n", binary_name);
+        unlink(binary_name);
+        return 0;
+    }
+    return 1;
+}
+
+// 0 when the file isn't a points file this version can read
+static uint8_t map_points_binary(const char* file_name, Points_Binary* binary)
+{
+    binary->mapped = map_input(file_name, &binary->size);
+    if (!binary->mapped)
+        return 0;
+    binary->header = (const Points_File_Header*)binary->mapped;
+    const Points_File_Header* header = binary->header;
+    if (binary->size < sizeof(Points_File_Header) || header->magic != POINTS_FILE_MAGIC || header->version != POINTS_FILE_VERSION
+            || (header->layout == POINTS_LAYOUT_F64 && header->element_size != sizeof(double))
+            || (header->layout == POINTS_LAYOUT_F32 && header->element_size != sizeof(float))
+            || (header->layout != POINTS_LAYOUT_F64 && header->layout != POINTS_LAYOUT_F32))
+    {
+        printf("ERROR - %s is not a version %d points file\n", file_name, POINTS_FILE_VERSION);
+        munmap((void*)binary->mapped, binary->size);
+        return 0;
+    }
+    for (uint8_t a = 0; a < 4; ++a)
+    {
+        // divided rather than multiplied, a crafted count would wrap the product past the check
+        if (header->array_offset[a] % POINTS_FILE_ALIGN || header->array_offset[a] > binary->size
+                || header->count > (binary->size - header->array_offset[a]) / header->element_size)
+        {
+            printf("ERROR - %s is truncated or its arrays are misaligned\n", file_name);
+            munmap((void*)binary->mapped, binary->size);
+            return 0;
+        }
+        binary->arrays[a] = binary->mapped + header->array_offset[a];
+    }
+    return 1;
+}
+
+// doubles go straight to the kernel, floats are widened a block at a time.
+// Each distance is also written to out when it isn't NULL
+static double points_binary_sum(const Points_Binary* binary, const Haversine_Kernel* kernel, double* out)
+{
+    const uint64_t count = binary->header->count;
+    if (binary->header->layout == POINTS_LAYOUT_F64)
+        return kernel->haversine((const double*)binary->arrays[0], (const double*)binary->arrays[1],
+                                 (const double*)binary->arrays[2], (const double*)binary->arrays[3], count, out);
+
+    double* block = (double*)alloc_aligned_doubles(THREAD_BLOCK_PAIRS * 4);
+    double sum = 0;
+    for (uint64_t first = 0; first < count; first += THREAD_BLOCK_PAIRS)
+    {
+        uint64_t block_count = count - first < THREAD_BLOCK_PAIRS ? count - first : THREAD_BLOCK_PAIRS;
+        for (uint8_t a = 0; a < 4; ++a)
+            for (uint64_t i = 0; i < block_count; ++i)
+                block[a * THREAD_BLOCK_PAIRS + i] = ((const float*)binary->arrays[a])[first + i];
+        sum += kernel->haversine(block, block + THREAD_BLOCK_PAIRS, block + THREAD_BLOCK_PAIRS * 2,
+                                 block + THREAD_BLOCK_PAIRS * 3, block_count, out ? out + first : NULL);
+    }
+    free(block);
+    return sum;
+}
+
+int calculate_avg_binary(const char* file_name, const char* answer_name)
+{
+    const Haversine_Kernel* kernel = haversine_kernel_select();
+    Timer t1, t2;
+    Points_Binary binary;
+    start_timer(&t1);
+    if (!map_points_binary(file_name, &binary))
+        return 1;
+    end_timer(&t1);
+    if (binary.header->count == 0)
+    {
+        printf("ERROR - no points in %s\n", file_name);
+        munmap((void*)binary.mapped, binary.size);
+        return 1;
+    }
+
+    double* distances = answer_name ? (double*)alloc_aligned_doubles(binary.header->count) : NULL;
+    start_timer(&t2);
+    double distance = points_binary_sum(&binary, kernel, distances);
+    end_timer(&t2);
+    printf("Avg: %0.2fkm over %lu pairs (%s, %s kernel)\n", distance / binary.header->count, binary.header->count,
+           binary.header->layout == POINTS_LAYOUT_F32 ? "float" : "double", kernel->name);
+    printf("Time taking:\n\tMap: %f sec\n\tHarversine Calc: %f sec (%0.3f GB/s)\n*ns per Haversine Calc %0.3f\n\tTotal: %f sec\n",
+           timer_sec(&t1), timer_sec(&t2), GB_PER_SEC(binary.size, timer_sec(&t2)),
+           (double)timer_nano(&t2) / binary.header->count, timer_sec(&t1) + timer_sec(&t2));
+
+    int failed = 0;
+    if (distances)
+    {
+        failed = verify_answers(answer_name, distances, binary.header->count, distance / binary.header->count);
+        free(distances);
+    }
+    munmap((void*)binary.mapped, binary.size);
+    return failed;
+}
+
+// the existing JSON format to the binary one, timing the parse and the write, non zero when the write failed
+int convert_json_to_binary(const char* json_name, const char* binary_name, uint32_t layout)
+{
+    Timer t1, t2;
+    Point_Pairs pairs = {0};
+    start_timer(&t1);
+    uint64_t bytes = parse_points_fast(json_name, &pairs);
+    Points_SoA points = points_soa_from_pairs(&pairs);
+    end_timer(&t1);
+    free(pairs.values);
+
+    start_timer(&t2);
+    double* const arrays[4] = {points.x1, points.y1, points.x2, points.y2};
+    uint8_t ok = write_points_binary_arrays(binary_name, arrays, points.count, layout);
+    end_timer(&t2);
+    if (!ok)
+    {
+        points_soa_free(&points);
+        return 1;
+    }
+    printf("Converted %lu pairs to %s (%s)\n\tParse: %f sec (%0.3f GB/s)\n\tWrite: %f sec\n", points.count, binary_name,
+           layout == POINTS_LAYOUT_F32 ? "float" : "double", timer_sec(&t1), GB_PER_SEC(bytes, timer_sec(&t1)), timer_sec(&t2));
+    points_soa_free(&points);
+    return 0;
+}
+
+/* ===================================================================
+    Answer file, the reference haversine_distance of every pair and
+    their average written next to the generated points, for checking
+    every faster parser or kernel against
+    =================================================================*/
+#define ANSWER_FILE_MAGIC 0x4E415648    // "HVAN"
+#define ANSWER_FILE_VERSION 1
+#define ANSWER_TOLERANCE_KM 1e-4        // near antipodal pairs lose about 1e-5km in any implementation
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+    double average;             // sum in pair order over count
+    uint64_t distances_offset;  // count doubles from the start of the file, 64 byte aligned
+} Answer_File_Header;
+
+// 0 when the file could not be written in full, it is removed then
+static uint8_t write_answers(const char* answer_name, const double* distances, uint64_t count)
+{
+    FILE* file = fopen(answer_name, "wb");
+    if (!file)
+    {
+        printf("ERROR - could not create %s\n", answer_name);
+        return 0;
+    }
+    double sum = 0;
+    for (uint64_t i = 0; i < count; ++i)
+        sum += distances[i];
+    Answer_File_Header header = {ANSWER_FILE_MAGIC, ANSWER_FILE_VERSION, count, count ? sum / count : 0, align_offset(sizeof(Answer_File_Header))};
+    static const uint8_t zeros[POINTS_FILE_ALIGN] = {0};
+    uint8_t written = fwrite(&header, sizeof(header), 1, file) == 1
+                      && fwrite(zeros, 1, header.distances_offset - sizeof(header), file) == header.distances_offset - sizeof(header)
+                      && fwrite(distances, sizeof(double), count, file) == count;
+    if (fclose(file) != 0 || !written)
+    {
+        printf("ERROR - could not write %s, it was removed\n", answer_name);
+        unlink(answer_name);
+        return 0;
+    }
+    return 1;
+}
+
+// maps the answer file into check, 0 when it can't be read or isn't an answer file
+static uint8_t answers_open(const char* answer_name, Answer_Check* check)
+{
+    *check = (Answer_Check){0};
+    check->name = answer_name;
+    check->mapped = map_input(answer_name, &check->size);
+    if (!check->mapped)
+        return 0;
+    const Answer_File_Header* header = (const Answer_File_Header*)check->mapped;
+    if (check->size < sizeof(Answer_File_Header) || header->magic != ANSWER_FILE_MAGIC || header->version != ANSWER_FILE_VERSION
+            || header->distances_offset > check->size
+            || header->count > (check->size - header->distances_offset) / sizeof(double))
+    {
+        printf("ERROR - %s is not a version %d answer file\n", answer_name, ANSWER_FILE_VERSION);
+        munmap((void*)check->mapped, check->size);
+        return 0;
+    }
+    check->expected = (const double*)(check->mapped + header->distances_offset);
+    check->expected_count = header->count;
+    check->expected_average = header->average;
+    return 1;
+}
+
+// the next count distances in pair order, the ones past the end of the answers are only counted
+static void answers_compare(Answer_Check* check, const double* distances, uint64_t count)
+{
+    uint64_t first = check->compared;
+    uint64_t checked = first >= check->expected_count ? 0
+                       : count < check->expected_count - first ? count : check->expected_count - first;
+    for (uint64_t i = 0; i < checked; ++i)
+    {
+        double error = fabs(distances[i] - check->expected[first + i]);
+        if (error > check->max_error)
+        {
+            check->max_error = error;
+            check->worst_index = first + i;
+        }
+        if (!(error <= ANSWER_TOLERANCE_KM))
+        {
+            if (check->mismatches == 0)
+            {
+                check->first_mismatch = first + i;
+                check->first_mismatch_value = distances[i];
+            }
+            check->mismatches++;
+        }
+    }
+    check->compared += count;
+}
+
+// prints the max absolute error and the first pair off by more than the tolerance, non zero when anything is off
+static int answers_finish(Answer_Check* check, uint64_t count, double average)
+{
+    int failed = 0;
+    if (check->expected_count != count)
+    {
+        printf("Answers: MISMATCH - %lu pairs computed, %lu in %s\n", count, check->expected_count, check->name);
+        failed = 1;
+    }
+    uint64_t checked = check->compared < check->expected_count ? check->compared : check->expected_count;
+    double average_error = fabs(average - check->expected_average);
+    printf("Answers: %lu pairs checked, max abs error %gkm (pair %lu), avg %0.6fkm expected %0.6fkm (error %g)\n",
+           checked, check->max_error, check->worst_index, average, check->expected_average, average_error);
+    if (check->mismatches)
+    {
+        printf("\tMISMATCH - %lu pairs off by more than %gkm, first at pair %lu: %0.12f expected %0.12f\n",
+               check->mismatches, ANSWER_TOLERANCE_KM, check->first_mismatch, check->first_mismatch_value,
+               check->expected[check->first_mismatch]);
+        failed = 1;
+    }
+    if (!(average_error <= ANSWER_TOLERANCE_KM))
+    {
+        printf("\tMISMATCH - the average is off by more than %gkm\n", ANSWER_TOLERANCE_KM);
+        failed = 1;
+    }
+    munmap((void*)check->mapped, check->size);
+    return failed;
+}
+
+// every distance at once, for the calculators that keep them all
+static int verify_answers(const char* answer_name, const double* distances, uint64_t count, double average)
+{
+    Answer_Check check;
+    if (!answers_open(answer_name, &check))
+        return 1;
+    answers_compare(&check, distances, count);
+    return answers_finish(&check, count, average);
+}
+
+static uint32_t parse_layout(int argc, char* argv[], int index)
+{
+    return argc > index && strcmp(argv[index], "f32") == 0 ? POINTS_LAYOUT_F32 : POINTS_LAYOUT_F64;
+}
+
+// optional file argument, missing or "-" is NULL
+static const char* optional_file(int argc, char* argv[], int index)
+{
+    return argc > index && strcmp(argv[index], "-") != 0 ? argv[index] : NULL;
+}
+
+/* ===================================================================
+    Seeded parallel generator. Every coordinate comes from SplitMix64
+    over (seed, pair, coordinate) and is drawn as an integer count of
+    1e-12 degrees, so the text is formatted by hand with no rounding
+    and the doubles in the binary file are exactly what parsing the
+    text gives. The first pass sizes every thread's records so each
+    one writes its own region of the file, the output is the same for
+    any thread count
+    =================================================================*/
+#define GENERATOR_BUFFER_SIZE (8 * 1024 * 1024)
+#define COORDINATE_SCALE 1000000000000ll   // 12 decimals like create_points_json
+#define JSON_HEAD "{\n\"points_on_earth\":["
+#define JSON_TAIL "\n]\n}\n"
+
+static uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// coordinate c (x1 y1 x2 y2) of pair i in 1e-12 degrees, latitudes within 90 and longitudes within 180
+static int64_t generated_coordinate(uint64_t seed, uint64_t pair, uint32_t c)
+{
+    uint64_t bits = splitmix64(splitmix64(seed) ^ (pair * 4 + c) * 0xD1B54A32D192ED03ull);
+    int64_t limit = (c & 1 ? 180 : 90) * COORDINATE_SCALE;
+    uint64_t range = (uint64_t)limit * 2 + 1;
+    return (int64_t)(((unsigned __int128)bits * range) >> 64) - limit;
+}
+
+static uint32_t fixed_length(int64_t value)
+{
+    uint64_t whole = (value < 0 ? -value : value) / COORDINATE_SCALE;
+    return (value < 0) + (whole >= 100 ? 3 : whole >= 10 ? 2 : 1) + 13;
+}
+
+static char* format_fixed(char* out, int64_t value)
+{
+    if (value < 0)
+    {
+        *out++ = '-';
+        value = -value;
+    }
+    uint64_t whole = (uint64_t)value / COORDINATE_SCALE;
+    uint64_t fraction = (uint64_t)value % COORDINATE_SCALE;
+    if (whole >= 100) *out++ = '0' + whole / 100;
+    if (whole >= 10) *out++ = '0' + whole / 10 % 10;
+    *out++ = '0' + whole % 10;
+    *out++ = '.';
+    for (int32_t d = 11; d >= 0; --d)
+    {
+        out[d] = '0' + fraction % 10;
+        fraction /= 10;
+    }
+    return out + 12;
+}
+
+// \n{"x1":, "y1":, "x2":, "y2":},  around the four numbers
+#define RECORD_FIXED_BYTES 30
+
+static char* format_record(char* out, const int64_t values[4])
+{
+    memcpy(out, "\n{\"x1\":", 7);
+    out = format_fixed(out + 7, values[0]);
+    memcpy(out, ", \"y1\":", 7);
+    out = format_fixed(out + 7, values[1]);
+    memcpy(out, ", \"x2\":", 7);
+    out = format_fixed(out + 7, values[2]);
+    memcpy(out, ", \"y2\":", 7);
+    out = format_fixed(out + 7, values[3]);
+    memcpy(out, "},", 2);
+    return out + 2;
+}
+
+// pwrite until all of it is out, 0 on failure
+static uint8_t write_at(int fd, const void* data, uint64_t size, uint64_t offset)
+{
+    const uint8_t* at = (const uint8_t*)data;
+    while (size)
+    {
+        ssize_t written = pwrite(fd, at, size, offset);
+        if (written <= 0)
+        {
+            printf("ERROR - write of %lu bytes at %lu failed\n", size, offset);
+            return 0;
+        }
+        at += written;
+        size -= written;
+        offset += written;
+    }
+    return 1;
+}
+
+typedef struct
+{
+    uint64_t seed;
+    uint64_t first;
+    uint64_t count;
+    uint64_t json_offset;   // pass one fills in the byte length, pass two writes from here
+    uint64_t json_bytes;
+    int json_fd;
+    int binary_fd;
+    Points_File_Header binary_header;
+    double* distances;      // reference distance per pair, NULL when no answers are written
+    uint8_t failed;         // a write failed or came up short
+} Generator_Task;
+
+static void* generator_size_run(void* data)
+{
+    Generator_Task* task = (Generator_Task*)data;
+    uint64_t bytes = 0;
+    for (uint64_t i = task->first; i < task->first + task->count; ++i)
+    {
+        bytes += RECORD_FIXED_BYTES;
+        for (uint32_t c = 0; c < 4; ++c)
+            bytes += fixed_length(generated_coordinate(task->seed, i, c));
+    }
+    task->json_bytes = bytes;
+    return NULL;
+}
+
+static void* generator_write_run(void* data)
+{
+    Generator_Task* task = (Generator_Task*)data;
+    char* buffer = (char*)malloc(GENERATOR_BUFFER_SIZE);
+    char* at = buffer;
+    uint64_t offset = task->json_offset;
+    const uint32_t element_size = task->binary_header.element_size;
+    uint8_t* arrays[4] = {0};
+    if (task->binary_fd >= 0)
+        for (uint32_t c = 0; c < 4; ++c)
+            arrays[c] = (uint8_t*)malloc(task->count * element_size + 1);
+
+    for (uint64_t i = 0; i < task->count; ++i)
+    {
+        int64_t values[4];
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            values[c] = generated_coordinate(task->seed, task->first + i, c);
+            if (arrays[c])
+            {
+                // n / 1e12 is correctly rounded, the same double strtod gives for the text
+                double value = (double)values[c] / (double)COORDINATE_SCALE;
+                if (element_size == sizeof(float))
+                    ((float*)arrays[c])[i] = (float)value;
+                else ((double*)arrays[c])[i] = value;
+            }
+        }
+        if (task->distances)
+            task->distances[task->first + i] = haversine_distance(
+                                                   (double)values[0] / (double)COORDINATE_SCALE, (double)values[1] / (double)COORDINATE_SCALE,
+                                                   (double)values[2] / (double)COORDINATE_SCALE, (double)values[3] / (double)COORDINATE_SCALE);
+        at = format_record(at, values);
+        if (at - buffer > GENERATOR_BUFFER_SIZE - 256)
+        {
+            if (!task->failed && !write_at(task->json_fd, buffer, at - buffer, offset))
+                task->failed = 1;
+            offset += at - buffer;
+            at = buffer;
+        }
+    }
+    if (!task->failed && !write_at(task->json_fd, buffer, at - buffer, offset))
+        task->failed = 1;
+    free(buffer);
+
+    for (uint32_t c = 0; c < 4 && arrays[c]; ++c)
+    {
+        if (!task->failed && !write_at(task->binary_fd, arrays[c], task->count * element_size,
+                                       task->binary_header.array_offset[c] + task->first * element_size))
+            task->failed = 1;
+        free(arrays[c]);
+    }
+    return NULL;
+}
+
+static void run_generator_threads(Generator_Task* tasks, uint32_t thread_count, void* (*run)(void*))
+{
+    pthread_t threads[MAX_THREADS];
+    for (uint32_t i = 1; i < thread_count; ++i)
+        pthread_create(&threads[i], NULL, run, &tasks[i]);
+    run(&tasks[0]);
+    for (uint32_t i = 1; i < thread_count; ++i)
+        pthread_join(threads[i], NULL);
+}
+
+// count pairs from seed into json_name (and binary_name and answer_name when they aren't NULL) on thread_count threads
+int generate_points_seeded(uint64_t count, uint64_t seed, const char* json_name, uint32_t thread_count,
+                           const char* binary_name, uint32_t layout, const char* answer_name)
+{
+    if (thread_count == 0)
+        thread_count = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+    if (thread_count > MAX_THREADS)
+        thread_count = MAX_THREADS;
+    if (thread_count > count)
+        thread_count = count ? count : 1;
+
+    int json_fd = open(json_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int binary_fd = binary_name ? open(binary_name, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+    if (json_fd < 0 || (binary_name && binary_fd < 0))
+    {
+        printf("ERROR - could not create %s\n", json_fd < 0 ? json_name : binary_name);
+        return 1;
+    }
+
+    Timer t;
+    start_timer(&t);
+    Generator_Task tasks[MAX_THREADS];
+    Points_File_Header header = points_file_header(count, layout);
+    double* distances = answer_name ? (double*)malloc(sizeof(double) * (count ? count : 1)) : NULL;
+    for (uint32_t i = 0; i < thread_count; ++i)
+    {
+        uint64_t first = count * i / thread_count;
+        tasks[i] = (Generator_Task){seed, first, count * (i + 1) / thread_count - first, 0, 0, json_fd, binary_fd, header, distances, 0};
+    }
+    run_generator_threads(tasks, thread_count, generator_size_run);
+
+    uint64_t offset = strlen(JSON_HEAD);
+    for (uint32_t i = 0; i < thread_count; ++i)
+    {
+        tasks[i].json_offset = offset;
+        offset += tasks[i].json_bytes;
+    }
+    uint8_t ok = write_at(json_fd, JSON_HEAD, strlen(JSON_HEAD), 0)
+                 && write_at(json_fd, JSON_TAIL, strlen(JSON_TAIL), offset);
+    uint64_t json_size = offset + strlen(JSON_TAIL);
+    if (ok && binary_fd >= 0)
+    {
+        ok = write_at(binary_fd, &header, sizeof(header), 0);
+        if (ok && ftruncate(binary_fd, align_offset(header.array_offset[3] + count * header.element_size)) != 0)
+        {
+            printf("ERROR - could not size %s\n", binary_name);
+            ok = 0;
+        }
+    }
+
+    if (ok)
+        run_generator_threads(tasks, thread_count, generator_write_run);
+    for (uint32_t i = 0; i < thread_count; ++i)
+        ok = ok && !tasks[i].failed;
+    // close reports the write errors that only show up once the data is flushed
+    if (close(json_fd) != 0)
+        ok = 0;
+    if (binary_fd >= 0 && close(binary_fd) != 0)
+        ok = 0;
+    if (distances)
+    {
+        ok = ok && write_answers(answer_name, distances, count);
+        free(distances);
+    }
+    end_timer(&t);
+
+    // a cut short file would still parse, so nothing is left behind
+    if (!ok)
+    {
+        printf("ERROR - generating into %s failed, the output files were removed\n", json_name);
+        unlink(json_name);
+        if (binary_name)
+            unlink(binary_name);
+        if (answer_name)
+            unlink(answer_name);
+        return 1;
+    }
+
+    printf("Generated %lu pairs with seed %lu into %s (%lu bytes) on %u threads\n", count, seed, json_name, json_size, thread_count);
+    printf("Time taking: %f sec (%0.3f GB/s)\n", timer_sec(&t), GB_PER_SEC(json_size, timer_sec(&t)));
+    return 0;
+}
+
 int main(int argc, char* argv[])
 {
     if (argc < 3)
     {
-        printf("Args required!\n\t<flag (-g--generate / -ca--calculate_avg_prelude)> <param1> <param2>\n");
+        printf("Args required!\n\t<flag (-g--generate / -ca--calculate_avg_prelude / -cm--calculate_avg_mmap / -pc--parse_compare / -nb--number_bench / -vk--vector_kernel / -mt--calculate_avg_threaded / -cb--calculate_avg_binary / -jb--json_to_binary / -gs--generate_seeded / -cs--calculate_avg_streaming / -rt--repetition_test / -pf--profile)> <param1> <param2>\n");
         return -2;
     }
 
     if (strcmp(argv[1], "-g") == 0 || strcmp(argv[1], "--generate") == 0)
-        create_points_json(atoi(argv[2]));
+        return create_points_json(atoi(argv[2]), optional_file(argc, argv, 3), parse_layout(argc, argv, 4), optional_file(argc, argv, 5));
     else if (strcmp(argv[1], "-ca") == 0 || strcmp(argv[1], "--calculate_avg_prelude") == 0)
         calculate_avg_prologue(argv[2], atoi(argv[3]));
+    else if (strcmp(argv[1], "-cm") == 0 || strcmp(argv[1], "--calculate_avg_mmap") == 0)
+        return calculate_avg_mmap(argv[2], optional_file(argc, argv, 3));
+    else if (strcmp(argv[1], "-pc") == 0 || strcmp(argv[1], "--parse_compare") == 0)
+        parse_compare(argv[2]);
+    else if (strcmp(argv[1], "-nb") == 0 || strcmp(argv[1], "--number_bench") == 0)
+        number_bench(atoi(argv[2]));
+    else if (strcmp(argv[1], "-vk") == 0 || strcmp(argv[1], "--vector_kernel") == 0)
+        return vector_kernel_report(argv[2], argc > 3 ? (uint32_t)atoi(argv[3]) : DEFAULT_MAX_ULP,
+                                    argc > 4 ? (uint32_t)atoi(argv[4]) : DEFAULT_MAX_DISTANCE_ULP);
+    else if (strcmp(argv[1], "-mt") == 0 || strcmp(argv[1], "--calculate_avg_threaded") == 0)
+        return calculate_avg_threaded(argv[2], argc > 3 ? (uint32_t)atoi(argv[3]) : 0, optional_file(argc, argv, 4));
+    else if (strcmp(argv[1], "-cb") == 0 || strcmp(argv[1], "--calculate_avg_binary") == 0)
+        return calculate_avg_binary(argv[2], optional_file(argc, argv, 3));
+    else if ((strcmp(argv[1], "-jb") == 0 || strcmp(argv[1], "--json_to_binary") == 0) && argc > 3)
+        return convert_json_to_binary(argv[2], argv[3], parse_layout(argc, argv, 4));
+    else if (strcmp(argv[1], "-cs") == 0 || strcmp(argv[1], "--calculate_avg_streaming") == 0)
+        return calculate_avg_streaming(argv[2], optional_file(argc, argv, 3));
+    else if (strcmp(argv[1], "-rt") == 0 || strcmp(argv[1], "--repetition_test") == 0)
+        return repetition_test_phases(argv[2], argc > 3 ? argv[3] : "all", argc > 4 ? atof(argv[4]) : DEFAULT_REPETITION_SEC);
+    else if (strcmp(argv[1], "-pf") == 0 || strcmp(argv[1], "--profile") == 0)
+        return profile_phases(argv[2]);
+    else if ((strcmp(argv[1], "-gs") == 0 || strcmp(argv[1], "--generate_seeded") == 0) && argc > 4)
+        return generate_points_seeded(strtoull(argv[2], NULL, 10), strtoull(argv[3], NULL, 10), argv[4],
+                                      argc > 5 ? (uint32_t)atoi(argv[5]) : 0, optional_file(argc, argv, 6), parse_layout(argc, argv, 7),
+                                      optional_file(argc, argv, 8));
 
     return 0;
 
 }
+
+PROFILER_END_OF_COMPILATION_UNIT
@@ -12,6 +12,8 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <time.h>
+#include <sys/resource.h>
+#include <x86intrin.h>
 
 /* ========================================================================
     Timer
@@ -29,6 +31,115 @@ double timer_sec(Timer* timer);
 uint64_t timer_nano(Timer* timer);
 void compare_timers(Timer* timer1, Timer* timer2);
 
+/* ========================================================================
+    Repetition Tester
+    Re-runs a piece of code until the fastest run hasn't improved for
+    try_for_sec, keeping min / max / avg time and page faults per run
+    ======================================================================== */
+typedef struct
+{
+    uint64_t bytes;             // processed per run, for the throughput
+    double try_for_sec;
+    struct timespec last_improvement;
+    uint64_t runs;
+    double min_sec, max_sec, total_sec;
+    uint64_t min_sec_faults, max_faults, total_faults;  // min_sec_faults are the faults of the fastest run
+    Timer run;                  // the run in progress
+    uint64_t faults_before;
+} Repetition_Tester;
+
+void repetition_start(Repetition_Tester* tester, uint64_t bytes, double try_for_sec);
+/* true while the tester wants another run */
+int repetition_testing(Repetition_Tester* tester);
+void repetition_begin(Repetition_Tester* tester);
+void repetition_end(Repetition_Tester* tester);
+void repetition_print(const Repetition_Tester* tester, const char* label);
+
+/* ========================================================================
+    Profiler
+    A zone times its scope with rdtsc into a table indexed at compile time
+    by __COUNTER__, nested zones take their cycles out of the parent's
+    exclusive count. Build with -DPAP_PROFILER=1 to turn zones on, without
+    it they compile to nothing and only the total time is printed. Every
+    thread has its own table, zones go in one translation unit only
+    ======================================================================== */
+#ifndef PAP_PROFILER
+#define PAP_PROFILER 0
+#endif
+
+#define PROFILE_MAX_ZONES 1024
+
+typedef struct
+{
+    const char* label;
+    uint64_t hit_count;
+    uint64_t inclusive_cycles;  // with the zones inside it
+    uint64_t exclusive_cycles;  // only its own
+    uint64_t bytes;
+} Profile_Zone;
+
+typedef struct
+{
+    Profile_Zone zones[PROFILE_MAX_ZONES];  // 0 is the root, no zone uses it
+    uint32_t current_parent;
+    uint64_t start;
+} Profiler;
+
+extern _Thread_local Profiler global_profiler;
+
+void begin_profile(void);
+void end_and_print_profile(FILE* out);
+uint64_t estimate_cpu_timer_freq(void);
+
+#if PAP_PROFILER
+typedef struct
+{
+    const char* label;
+    uint32_t zone_index;
+    uint32_t parent_index;
+    uint64_t old_inclusive;     // a recursive zone only counts its outermost run
+    uint64_t start;
+} Profile_Block;
+
+static inline Profile_Block profile_block_begin(const char* label, const uint32_t zone_index, const uint64_t bytes)
+{
+    Profile_Block block;
+    block.label = label;
+    block.zone_index = zone_index;
+    block.parent_index = global_profiler.current_parent;
+    block.old_inclusive = global_profiler.zones[zone_index].inclusive_cycles;
+    global_profiler.zones[zone_index].bytes += bytes;
+    global_profiler.current_parent = zone_index;
+    block.start = __rdtsc();
+    return block;
+}
+
+static inline void profile_block_end(Profile_Block* block)
+{
+    uint64_t elapsed = __rdtsc() - block->start;
+    Profile_Zone* zone = &global_profiler.zones[block->zone_index];
+    global_profiler.zones[block->parent_index].exclusive_cycles -= elapsed;
+    zone->exclusive_cycles += elapsed;
+    zone->inclusive_cycles = block->old_inclusive + elapsed;
+    zone->hit_count++;
+    zone->label = block->label;
+    global_profiler.current_parent = block->parent_index;
+}
+
+#define PROFILE_GLUE_(a, b) a##b
+#define PROFILE_GLUE(a, b) PROFILE_GLUE_(a, b)
+#define PROFILE_ZONE_BYTES(label, bytes) Profile_Block PROFILE_GLUE(profile_block_, __LINE__) \
+        __attribute__((cleanup(profile_block_end))) = profile_block_begin(label, __COUNTER__ + 1, bytes)
+#define PROFILE_ZONE(label) PROFILE_ZONE_BYTES(label, 0)
+#define PROFILE_FUNCTION PROFILE_ZONE(__func__)
+#define PROFILER_END_OF_COMPILATION_UNIT _Static_assert(__COUNTER__ < PROFILE_MAX_ZONES, "ERROR - too many profile zones");
+#else
+#define PROFILE_ZONE_BYTES(label, bytes)
+#define PROFILE_ZONE(label)
+#define PROFILE_FUNCTION
+#define PROFILER_END_OF_COMPILATION_UNIT
+#endif
+
 /* ========================================================================
     Arena Memory Allocator
     ======================================================================== */
@@ -116,6 +227,121 @@ void compare_timers(Timer* timer1, Timer* timer2)
         printf("Both timers are equal\n");
 }
 
+// Repetition tester implementation
+static uint64_t page_faults(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+void repetition_start(Repetition_Tester* tester, uint64_t bytes, double try_for_sec)
+{
+    memset(tester, 0, sizeof(*tester));
+    tester->bytes = bytes;
+    tester->try_for_sec = try_for_sec;
+    tester->min_sec = 1e30;
+    clock_gettime(CLOCK_MONOTONIC, &tester->last_improvement);
+}
+
+int repetition_testing(Repetition_Tester* tester)
+{
+    if (tester->runs == 0)
+        return 1;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double since = (now.tv_sec - tester->last_improvement.tv_sec) + (now.tv_nsec - tester->last_improvement.tv_nsec) / 1e9;
+    return since < tester->try_for_sec;
+}
+
+void repetition_begin(Repetition_Tester* tester)
+{
+    tester->faults_before = page_faults();
+    start_timer(&tester->run);
+}
+
+void repetition_end(Repetition_Tester* tester)
+{
+    end_timer(&tester->run);
+    uint64_t faults = page_faults() - tester->faults_before;
+    double sec = timer_sec(&tester->run);
+
+    tester->runs++;
+    tester->total_sec += sec;
+    tester->total_faults += faults;
+    if (sec > tester->max_sec)
+        tester->max_sec = sec;
+    if (faults > tester->max_faults)
+        tester->max_faults = faults;
+    if (sec < tester->min_sec)
+    {
+        tester->min_sec = sec;
+        tester->min_sec_faults = faults;
+        clock_gettime(CLOCK_MONOTONIC, &tester->last_improvement);
+    }
+}
+
+void repetition_print(const Repetition_Tester* tester, const char* label)
+{
+    if (tester->runs == 0)
+        return;
+    double avg_sec = tester->total_sec / tester->runs;
+    printf("%s, %lu runs:\n", label, tester->runs);
+    printf("\tMin: %f sec %0.3f GB/s %lu faults\n", tester->min_sec, tester->bytes / tester->min_sec / 1e9, tester->min_sec_faults);
+    printf("\tMax: %f sec %0.3f GB/s %lu faults\n", tester->max_sec, tester->bytes / tester->max_sec / 1e9, tester->max_faults);
+    printf("\tAvg: %f sec %0.3f GB/s %0.1f faults\n", avg_sec, tester->bytes / avg_sec / 1e9, (double)tester->total_faults / tester->runs);
+}
+
+// Profiler implementation
+_Thread_local Profiler global_profiler;
+
+// rdtsc ticks over 100ms of the monotonic clock
+uint64_t estimate_cpu_timer_freq(void)
+{
+    Timer t;
+    start_timer(&t);
+    uint64_t cpu_start = __rdtsc();
+    do
+        end_timer(&t);
+    while (timer_nano(&t) < 100000000);
+    return (uint64_t)((__rdtsc() - cpu_start) / timer_sec(&t));
+}
+
+void begin_profile(void)
+{
+    memset(&global_profiler, 0, sizeof(global_profiler));
+    global_profiler.start = __rdtsc();
+}
+
+void end_and_print_profile(FILE* out)
+{
+    uint64_t total = __rdtsc() - global_profiler.start;
+    uint64_t freq = estimate_cpu_timer_freq();
+    fprintf(out, "Total time: %0.4f ms (timer freq %lu)\n", 1000.0 * total / freq, freq);
+    if (!PAP_PROFILER)
+    {
+        fprintf(out, "\tbuild with -DPAP_PROFILER=1 for the zones\n");
+        return;
+    }
+    for (uint32_t i = 1; i < PROFILE_MAX_ZONES; ++i)
+    {
+        const Profile_Zone* zone = &global_profiler.zones[i];
+        if (zone->hit_count == 0)
+            continue;
+        fprintf(out, "\t%s[%lu]: %lu (%0.2f%%", zone->label, zone->hit_count, zone->exclusive_cycles,
+                100.0 * zone->exclusive_cycles / total);
+        if (zone->inclusive_cycles != zone->exclusive_cycles)
+            fprintf(out, ", %0.2f%% w/children", 100.0 * zone->inclusive_cycles / total);
+        fprintf(out, ")");
+        if (zone->bytes)
+        {
+            double sec = (double)zone->inclusive_cycles / freq;
+            fprintf(out, " %0.3f MB at %0.3f GB/s", zone->bytes / (1024.0 * 1024.0), zone->bytes / sec / 1e9);
+        }
+        fprintf(out, "\n");
+    }
+}
+
 // Arena memory implementation
 static Arena_Block* arena_add_block(Arena *arena, size_t minimumSize)
 {